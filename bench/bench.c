@@ -0,0 +1,237 @@
+#define _POSIX_C_SOURCE 200809L
+#include <esh.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include "trace.h"
+
+/*
+ * Keystroke trace benchmark. Replays each trace through esh_rx() with output
+ * discarded, and reports for it:
+ *
+ *  - ns/byte:  time spent in esh_rx() per input byte
+ *  - out/byte: bytes esh printed per input byte
+ *  - ns/cmd:   time from receiving the newline to entering the command
+ *              callback, averaged over all commands run
+ *
+ * Usage: bench_CONFIG [-c BASELINE] TRACE...
+ *
+ * With -c, each result is compared against the line for the same config and
+ * trace in BASELINE, which is earlier output of this program. Output is
+ * deterministic, so any growth in out/byte fails the comparison; timings only
+ * get flagged, as they depend on the machine.
+ *
+ * See trace.h for the format of traces.
+ */
+
+#define TARGET_BYTES    2000000     // Replay each trace at least this much
+#define SLOWER          1.25        // Flag timings this much over baseline
+
+static uint64_t rx_start;
+static uint64_t dispatch_ns;
+static unsigned long commands;
+static unsigned long printed;
+
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec;
+}
+
+
+static void print_cb(esh_t * esh, char c, void * arg)
+{
+    (void) esh;
+    (void) c;
+    (void) arg;
+    ++printed;
+}
+
+
+static int command_cb(esh_t * esh, int argc, char ** argv, void * arg)
+{
+    (void) esh;
+    (void) argc;
+    (void) argv;
+    (void) arg;
+    dispatch_ns += now_ns() - rx_start;
+    ++commands;
+    return 0;
+}
+
+
+#if defined(ESH_STATIC_CALLBACKS)
+void ESH_PRINT_CALLBACK(esh_t * esh, char c, void * arg)
+{
+    print_cb(esh, c, arg);
+}
+
+
+int ESH_COMMAND_CALLBACK(esh_t * esh, int argc, char ** argv, void * arg)
+{
+    return command_cb(esh, argc, argv, arg);
+}
+#elif defined(ESH_COMPACT)
+static const struct esh_ops ops = { &command_cb, &print_cb, NULL };
+#endif
+
+
+static esh_t * setup(void)
+{
+    esh_t * esh = esh_init();
+
+    if (!esh) {
+        fprintf(stderr, "esh_init failed\n");
+        exit(1);
+    }
+#if defined(ESH_COMPACT) && !defined(ESH_STATIC_CALLBACKS)
+    esh_register_ops(esh, &ops);
+#elif !defined(ESH_STATIC_CALLBACKS)
+    esh_register_command(esh, &command_cb);
+    esh_register_print(esh, &print_cb);
+#endif
+    return esh;
+}
+
+
+struct result {
+    double ns_per_byte;
+    double out_per_byte;
+    double ns_per_cmd;
+};
+
+
+static void run(esh_t * esh, char const * keys, size_t len,
+        struct result * res)
+{
+    unsigned long const reps = (TARGET_BYTES + len - 1) / len;
+
+    // One pass to warm up, and to leave the history as it will be for the
+    // rest.
+    for (size_t i = 0; i < len; ++i) {
+        esh_rx(esh, keys[i]);
+    }
+
+    printed = 0;
+    commands = 0;
+    dispatch_ns = 0;
+
+    uint64_t const t0 = now_ns();
+    for (unsigned long r = 0; r < reps; ++r) {
+        for (size_t i = 0; i < len; ++i) {
+            if (keys[i] == '\n') {
+                rx_start = now_ns();
+            }
+            esh_rx(esh, keys[i]);
+        }
+    }
+    uint64_t const ns = now_ns() - t0;
+    double const bytes = (double) len * reps;
+
+    res->ns_per_byte = ns / bytes;
+    res->out_per_byte = printed / bytes;
+    res->ns_per_cmd = commands ? (double) dispatch_ns / commands : 0;
+}
+
+
+/**
+ * Find the baseline result for a config and trace.
+ * @return false if there is none
+ */
+static bool find_baseline(char const * path, char const * trace,
+        struct result * res)
+{
+    FILE * f = fopen(path, "r");
+    char line[256];
+    bool found = false;
+
+    if (!f) {
+        perror(path);
+        exit(1);
+    }
+
+    while (!found && fgets(line, sizeof line, f)) {
+        char config[32], name[32];
+
+        found = line[0] != '#'
+            && sscanf(line, "%31s %31s %lf %lf %lf", config, name,
+                &res->ns_per_byte, &res->out_per_byte, &res->ns_per_cmd) == 5
+            && !strcmp(config, CONFIG) && !strcmp(name, trace);
+    }
+    fclose(f);
+    return found;
+}
+
+
+static double change(double now, double then)
+{
+    return then ? (now / then - 1) * 100 : 0;
+}
+
+
+int main(int argc, char ** argv)
+{
+    char const * baseline = NULL;
+    int status = 0;
+    int i = 1;
+
+    if (argc > 2 && !strcmp(argv[1], "-c")) {
+        baseline = argv[2];
+        i = 3;
+    }
+    if (i == argc) {
+        fprintf(stderr, "usage: %s [-c BASELINE] TRACE...\n", argv[0]);
+        return 2;
+    }
+
+    esh_t * esh = setup();
+
+    for (; i < argc; ++i) {
+        size_t len;
+        char * keys = trace_load(argv[i], &len);
+        char name[32];
+        struct result res, base;
+
+        if (!keys) {
+            return 2;
+        } else if (!len) {
+            free(keys);
+            continue;
+        }
+
+        trace_name(argv[i], name, sizeof name);
+        run(esh, keys, len, &res);
+        free(keys);
+
+        printf("%-10s %-10s %8.2f %8.4f %8.0f", CONFIG, name,
+                res.ns_per_byte, res.out_per_byte, res.ns_per_cmd);
+
+        if (!baseline) {
+            // Nothing to compare against
+        } else if (!find_baseline(baseline, name, &base)) {
+            printf("   (no baseline)");
+        } else {
+            bool const bigger = res.out_per_byte > base.out_per_byte * 1.001;
+            bool const slower = res.ns_per_byte > base.ns_per_byte * SLOWER
+                || res.ns_per_cmd > base.ns_per_cmd * SLOWER;
+
+            printf("   %+6.1f%% %+6.1f%% %+6.1f%%%s%s",
+                    change(res.ns_per_byte, base.ns_per_byte),
+                    change(res.out_per_byte, base.out_per_byte),
+                    change(res.ns_per_cmd, base.ns_per_cmd),
+                    slower ? "  SLOWER" : "",
+                    bigger ? "  MORE OUTPUT" : "");
+            if (bigger) {
+                status = 1;
+            }
+        }
+        printf("\n");
+    }
+
+    return status;
+}
@@ -0,0 +1,25 @@
+#define ESH_PROMPT "% "
+#define ESH_BUFFER_LEN 200
+#define ESH_ARGC_MAX 10
+
+#define ESH_HIST_ALLOC MALLOC
+#define ESH_HIST_LEN 4096
+
+#define ESH_ALLOC MALLOC
+
+#define ESH_VIEWPORT
+#define ESH_TERM_WIDTH 80
+
+#define ESH_BRACE_EXPANSION
+
+#define ESH_PIPE
+#define ESH_PIPE_STAGES 4
+#define ESH_PIPE_LINE_LEN 80
+#define ESH_PIPE_TAIL_LEN 512
+
+#define ESH_VARS
+#define ESH_VARS_LEN 256
+#define ESH_VARS_SLOTS 16
+
+#define ESH_MACROS
+#define ESH_MACRO_LEN 256
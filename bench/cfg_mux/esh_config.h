@@ -0,0 +1,11 @@
+#define ESH_PROMPT "% "
+#define ESH_BUFFER_LEN 200
+#define ESH_ARGC_MAX 10
+
+#define ESH_ALLOC MALLOC
+#define ESH_HIST_ALLOC MALLOC
+#define ESH_HIST_LEN 256
+
+#define ESH_MUX
+#define ESH_MUX_CHANNELS 4
+#define ESH_MUX_TX_LEN 64
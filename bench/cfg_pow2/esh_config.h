@@ -0,0 +1,9 @@
+#define ESH_PROMPT "% "
+#define ESH_BUFFER_LEN 200
+#define ESH_ARGC_MAX 10
+
+#define ESH_HIST_ALLOC STATIC
+#define ESH_HIST_LEN 512
+
+#define ESH_ALLOC STATIC
+#define ESH_STATIC_CALLBACKS
@@ -0,0 +1,7 @@
+#define ESH_PROMPT "% "
+#define ESH_BUFFER_LEN 300
+#define ESH_ARGC_MAX 6
+
+#define ESH_ALLOC STATIC
+
+#define ESH_RPC
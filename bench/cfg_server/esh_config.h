@@ -0,0 +1,14 @@
+#define ESH_PROMPT "% "
+#define ESH_BUFFER_LEN 120
+#define ESH_ARGC_MAX 10
+
+#define ESH_HIST_ALLOC MALLOC
+#define ESH_HIST_LEN 256
+
+#define ESH_ALLOC MALLOC
+
+#define ESH_POSIX
+#define ESH_POSIX_BUF_LEN 1024
+
+#define ESH_SERVER
+#define ESH_SERVER_SESSIONS 16384
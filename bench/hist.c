@@ -0,0 +1,129 @@
+#define _POSIX_C_SOURCE 200809L
+#include <esh.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_CYCLES
+#endif
+
+/*
+ * History replay benchmark. Types a stream of commands of varying length,
+ * and after each one scrolls back through the history and down again, so the
+ * time goes into adding to, searching and printing from the ring buffer.
+ * Build once per esh_config.h to compare ring lengths.
+ */
+
+#define COMMANDS    2000    // Commands in the trace
+#define DEPTH       8       // How far back to scroll after each command
+#define ROUNDS      20      // Times to replay the trace
+
+static char * trace;
+static size_t trace_len;
+static unsigned long printed;
+
+
+void ESH_PRINT_CALLBACK(esh_t * esh, char c, void * arg)
+{
+    (void) esh;
+    (void) c;
+    (void) arg;
+    ++printed;
+}
+
+
+int ESH_COMMAND_CALLBACK(esh_t * esh, int argc, char ** argv, void * arg)
+{
+    (void) esh;
+    (void) argc;
+    (void) argv;
+    (void) arg;
+    return 0;
+}
+
+
+static void put(char const * s)
+{
+    size_t const n = strlen(s);
+    memcpy(&trace[trace_len], s, n);
+    trace_len += n;
+}
+
+
+/**
+ * Build the trace. Commands are 8 to 71 characters of lowercase words, from a
+ * fixed seed so every build replays the same keystrokes.
+ */
+static void make_trace(void)
+{
+    uint32_t seed = 1;
+
+    trace = malloc(COMMANDS * (72 + 1 + DEPTH * 2 * 3));
+    if (!trace) {
+        perror("malloc");
+        exit(1);
+    }
+
+    for (int i = 0; i < COMMANDS; ++i) {
+        seed = seed * 1103515245 + 12345;
+        int const len = 8 + (seed >> 16) % 64;
+
+        for (int j = 0; j < len; ++j) {
+            seed = seed * 1103515245 + 12345;
+            int const r = (seed >> 16) % 32;
+            trace[trace_len++] = (r < 26 && j) ? (char)('a' + r) : ' ';
+        }
+        put("\n");
+        for (int j = 0; j < DEPTH; ++j) {
+            put("\33[A");
+        }
+        for (int j = 0; j < DEPTH; ++j) {
+            put("\33[B");
+        }
+    }
+}
+
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec;
+}
+
+
+int main(void)
+{
+    esh_t * esh = esh_init();
+
+    make_trace();
+
+    uint64_t const t0 = now_ns();
+#ifdef HAVE_CYCLES
+    uint64_t const c0 = __rdtsc();
+#endif
+    for (int round = 0; round < ROUNDS; ++round) {
+        for (size_t i = 0; i < trace_len; ++i) {
+            esh_rx(esh, trace[i]);
+        }
+    }
+#ifdef HAVE_CYCLES
+    uint64_t const cycles = __rdtsc() - c0;
+#endif
+    uint64_t const ns = now_ns() - t0;
+    double const keys = (double) trace_len * ROUNDS;
+
+    printf("ESH_HIST_LEN %-6d %10.0f keys %8.2f ns/key", ESH_HIST_LEN,
+            keys, ns / keys);
+#ifdef HAVE_CYCLES
+    printf(" %8.2f cycles/key", cycles / keys);
+#endif
+    printf(" %8.2f out/key\n", printed / keys);
+
+    free(trace);
+    return 0;
+}
@@ -0,0 +1,429 @@
+#define _DEFAULT_SOURCE
+#include <esh.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * Socket server load test. Forks an esh server, opens SESSIONS connections to
+ * it at once, and has each run ROUNDS commands, one at a time, checking every
+ * reply. Reports commands per second and the time from sending a command to
+ * having its reply and the next prompt. Then hangs up every client, and checks
+ * the server has freed their sessions.
+ *
+ * Usage: load_server [-t] [SESSIONS [ROUNDS]]
+ *
+ * Sessions run over a Unix socket, or with -t, over telnet on loopback TCP,
+ * where each client also sends its window size and an option to be refused.
+ */
+
+#define PROMPT          "% "
+#define IAC             "\377"
+#define TIMEOUT_MS      10000   // Longest wait for any progress
+
+enum client_state {
+    PROMPT_WAIT,            ///< Waiting for the prompt after connecting
+    REPLY_WAIT,             ///< Waiting for a reply
+    DONE,
+};
+
+struct client {
+    int fd;
+    int state;
+    int round;
+    int skip;               ///< Telnet command bytes still to skip
+    uint64_t sent;          ///< When the command went out
+    size_t len;
+    char buf[256];
+};
+
+static bool telnet;
+static char path[64];
+static int tcp_port;
+static volatile bool stop;
+static esh_server_t * server;
+
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec;
+}
+
+
+static int command_cb(esh_t * esh, int argc, char ** argv, void * arg)
+{
+    (void) arg;
+    char line[32];
+
+    if (argc && !strcmp(argv[0], "echo")) {
+        for (int i = 1; i < argc; ++i) {
+            esh_print(esh, argv[i]);
+            esh_print(esh, i + 1 < argc ? " " : "\n");
+        }
+    } else if (argc == 1 && !strcmp(argv[0], "sessions")) {
+        snprintf(line, sizeof line, "%zu\n", esh_server_sessions(server));
+        esh_print(esh, line);
+    } else if (argc == 1 && !strcmp(argv[0], "shutdown")) {
+        stop = true;
+    } else if (argc == 1 && !strcmp(argv[0], "exit")) {
+        esh_server_hangup(esh);
+    } else {
+        esh_print(esh, "?\n");
+        return 1;
+    }
+    return 0;
+}
+
+
+static void session_cb(esh_t * esh, bool open, void * arg)
+{
+    (void) arg;
+    if (open) {
+        esh_register_command(esh, &command_cb);
+    }
+}
+
+
+static int connect_server(void)
+{
+    int fd;
+
+    if (telnet) {
+        struct sockaddr_in addr = {
+            .sin_family = AF_INET,
+            .sin_port = htons((uint16_t) tcp_port),
+            .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+        };
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd >= 0 && connect(fd, (struct sockaddr *) &addr, sizeof addr)) {
+            close(fd);
+            fd = -1;
+        }
+    } else {
+        struct sockaddr_un addr = { .sun_family = AF_UNIX };
+        strcpy(addr.sun_path, path);
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd >= 0 && connect(fd, (struct sockaddr *) &addr, sizeof addr)) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    if (fd < 0) {
+        perror("connect");
+        return -1;
+    }
+
+    if (telnet) {
+        // Agree to what the server asked, give a width, and offer terminal
+        // type, which it should refuse.
+        static char const hello[] =
+            IAC "\375\001" IAC "\375\003" IAC "\373\037"
+            IAC "\372\037\000\144\000\050" IAC "\360"
+            IAC "\373\030";
+        if (write(fd, hello, sizeof hello - 1) != sizeof hello - 1) {
+            perror("write");
+            close(fd);
+            return -1;
+        }
+    }
+    return fd;
+}
+
+
+static bool send_line(struct client * c, char const * line)
+{
+    char out[64];
+    int const n = snprintf(out, sizeof out, "%s%s", line,
+            telnet ? "\r\n" : "\r");
+
+    c->len = 0;
+    c->sent = now_ns();
+    return write(c->fd, out, (size_t) n) == n;
+}
+
+
+/**
+ * Take in what a client was sent, less telnet commands.
+ * @return false if the connection closed or the reply didn't fit
+ */
+static bool receive(struct client * c)
+{
+    char in[512];
+    ssize_t const n = read(c->fd, in, sizeof in);
+
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return true;
+    } else if (n <= 0) {
+        return false;
+    }
+
+    for (ssize_t i = 0; i < n; ++i) {
+        if (c->skip) {
+            --c->skip;
+        } else if (telnet && in[i] == IAC[0]) {
+            c->skip = 2;
+        } else if (c->len + 1 < sizeof c->buf) {
+            c->buf[c->len++] = in[i];
+        } else {
+            return false;
+        }
+    }
+    c->buf[c->len] = 0;
+    return true;
+}
+
+
+static bool at_prompt(struct client const * c)
+{
+    return c->len >= strlen(PROMPT)
+        && !strcmp(&c->buf[c->len - strlen(PROMPT)], PROMPT);
+}
+
+
+/**
+ * Run one command on a connection of its own.
+ * @return reply, or NULL
+ */
+static char const * ask(char const * cmd)
+{
+    static struct client c;
+
+    memset(&c, 0, sizeof c);
+    c.fd = connect_server();
+    if (c.fd < 0) {
+        return NULL;
+    }
+
+    struct pollfd pfd = { c.fd, POLLIN, 0 };
+    bool sent = false;
+    while (poll(&pfd, 1, TIMEOUT_MS) == 1 && receive(&c)) {
+        if (at_prompt(&c) && sent) {
+            break;
+        } else if (at_prompt(&c)) {
+            sent = send_line(&c, cmd);
+        }
+    }
+    close(c.fd);
+    return sent && at_prompt(&c) ? c.buf : NULL;
+}
+
+
+static int compare(void const * a, void const * b)
+{
+    uint64_t const x = *(uint64_t const *) a;
+    uint64_t const y = *(uint64_t const *) b;
+    return (x > y) - (x < y);
+}
+
+
+static void run_server(void)
+{
+    while (!stop && esh_server_run(server, 100) >= 0) {
+    }
+    esh_server_close(server);
+    _exit(0);
+}
+
+
+int main(int argc, char ** argv)
+{
+    if (argc > 1 && !strcmp(argv[1], "-t")) {
+        telnet = true;
+        --argc;
+        ++argv;
+    }
+    int sessions = argc > 1 ? atoi(argv[1]) : 2000;
+    int const rounds = argc > 2 ? atoi(argv[2]) : 20;
+    if (sessions < 1 || rounds < 1) {
+        fprintf(stderr, "usage: load_server [-t] [SESSIONS [ROUNDS]]\n");
+        return 2;
+    }
+
+    // Each end holds a descriptor per session.
+    struct rlimit rl;
+    getrlimit(RLIMIT_NOFILE, &rl);
+    rl.rlim_cur = rl.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rl);
+    if (rl.rlim_cur != RLIM_INFINITY && (rlim_t) sessions + 16 > rl.rlim_cur) {
+        sessions = (int) rl.rlim_cur - 16;
+        fprintf(stderr, "load_server: only %d sessions allowed\n", sessions);
+    }
+
+    server = esh_server_init(&session_cb, NULL);
+    if (!server) {
+        perror("esh_server_init");
+        return 1;
+    }
+    int listening;
+    if (telnet) {
+        listening = tcp_port = esh_server_listen_tcp(server, 0, true);
+    } else {
+        snprintf(path, sizeof path, "/tmp/esh-load-%d.sock", (int) getpid());
+        listening = esh_server_listen_unix(server, path);
+    }
+    if (listening < 0) {
+        perror("listen");
+        return 1;
+    }
+
+    pid_t const pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return 1;
+    } else if (pid == 0) {
+        run_server();
+    }
+
+    struct client * clients = calloc((size_t) sessions, sizeof *clients);
+    uint64_t * latency = calloc((size_t) sessions * rounds, sizeof *latency);
+    int const epfd = epoll_create1(0);
+    if (!clients || !latency || epfd < 0) {
+        perror("load_server");
+        kill(pid, SIGTERM);
+        return 1;
+    }
+
+    bool ok = true;
+    for (int i = 0; i < sessions && ok; ++i) {
+        clients[i].fd = connect_server();
+        ok = clients[i].fd >= 0;
+        if (ok) {
+            fcntl(clients[i].fd, F_SETFL, O_NONBLOCK);
+            struct epoll_event ev = {
+                .events = EPOLLIN, .data.ptr = &clients[i] };
+            epoll_ctl(epfd, EPOLL_CTL_ADD, clients[i].fd, &ev);
+        }
+    }
+
+    // Get every session to its prompt before starting, so they all run at
+    // once.
+    size_t n_lat = 0;
+    int waiting = sessions;
+    int done = 0;
+    uint64_t start = 0;
+    struct epoll_event events[256];
+
+    while (ok && done < sessions) {
+        int const n = epoll_wait(epfd, events, 256, TIMEOUT_MS);
+        if (n <= 0) {
+            fprintf(stderr, "load_server: timed out, %d sessions done\n", done);
+            ok = false;
+            break;
+        }
+
+        for (int i = 0; i < n && ok; ++i) {
+            struct client * const c = events[i].data.ptr;
+
+            if (!receive(c)) {
+                fprintf(stderr, "load_server: session %d: lost connection\n",
+                        (int) (c - clients));
+                ok = false;
+            } else if (!at_prompt(c)) {
+                continue;
+            } else if (c->state == PROMPT_WAIT) {
+                c->state = REPLY_WAIT;
+                c->len = 0;
+                if (--waiting == 0) {
+                    start = now_ns();
+                    for (int j = 0; j < sessions && ok; ++j) {
+                        char cmd[32];
+                        snprintf(cmd, sizeof cmd, "echo s%d r0", j);
+                        ok = send_line(&clients[j], cmd);
+                    }
+                }
+            } else if (c->state == REPLY_WAIT) {
+                char want[32];
+                snprintf(want, sizeof want, "\r\ns%d r%d\r\n",
+                        (int) (c - clients), c->round);
+                if (!strstr(c->buf, want)) {
+                    fprintf(stderr,
+                            "load_server: session %d: wrong reply: %s\n",
+                            (int) (c - clients), c->buf);
+                    ok = false;
+                    break;
+                }
+                latency[n_lat++] = now_ns() - c->sent;
+
+                if (++c->round == rounds) {
+                    c->state = DONE;
+                    ++done;
+                } else {
+                    char cmd[32];
+                    snprintf(cmd, sizeof cmd, "echo s%d r%d",
+                            (int) (c - clients), c->round);
+                    ok = send_line(c, cmd);
+                }
+            }
+        }
+    }
+
+    if (ok) {
+        double const secs = (double) (now_ns() - start) / 1e9;
+        qsort(latency, n_lat, sizeof *latency, &compare);
+        printf("# transport  sessions  commands     cmd/s"
+                "  p50 us  p99 us  max us\n");
+        printf("%-10s %9d %9zu %9.0f %7.0f %7.0f %7.0f\n",
+                telnet ? "telnet" : "unix", sessions, n_lat,
+                (double) n_lat / secs, (double) latency[n_lat / 2] / 1e3,
+                (double) latency[n_lat * 99 / 100] / 1e3,
+                (double) latency[n_lat - 1] / 1e3);
+
+        // Every session is open, plus the one asking.
+        char want[32];
+        char const * reply = ask("sessions");
+        snprintf(want, sizeof want, "\r\n%d\r\n", sessions + 1);
+        if (!reply || !strstr(reply, want)) {
+            fprintf(stderr, "load_server: expected %d sessions open\n",
+                    sessions + 1);
+            ok = false;
+        }
+    }
+
+    for (int i = 0; i < sessions; ++i) {
+        if (clients[i].fd > 0) {
+            close(clients[i].fd);
+        }
+    }
+
+    // The server finds out about the hangups in its own time.
+    bool freed = false;
+    for (int i = 0; i < 100 && !freed; ++i) {
+        char const * const reply = ask("sessions");
+        freed = reply && strstr(reply, "\r\n1\r\n");
+        if (!freed) {
+            usleep(20000);
+        }
+    }
+    if (!freed) {
+        fprintf(stderr, "load_server: sessions were not freed\n");
+        ok = false;
+    }
+
+    ask("shutdown");
+    int status;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status)) {
+        fprintf(stderr, "load_server: server failed\n");
+        ok = false;
+    }
+
+    free(clients);
+    free(latency);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,376 @@
+#include <esh.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+/*
+ * Multiplexer check. Builds link frames the way a peer would, feeds them to
+ * esh_mux_rx() whole and a byte at a time, splits what the multiplexer writes
+ * back into channels, and checks the argv each instance's commands were given
+ * and where their output went: frames split across reads, channels
+ * interleaved, plain text on channel 0 with DLE escaped both ways, output
+ * longer than a frame or the channel buffer, and flow control.
+ *
+ * Usage: mux_check
+ */
+
+#define DLE     0x10
+#define XON     0x11
+#define XOFF    0x13
+#define CTRL    0x80
+#define CHANNELS 3                  // Channels with an instance attached
+
+static esh_mux_t * mux;
+static esh_t * esh[CHANNELS];
+
+static unsigned char out[8192];     // What the mux wrote since the last feed
+static size_t out_len;
+
+static char ran[1024];              // Commands run, as CHANNEL:[arg] [arg]
+static int failures;
+
+/**
+ * What was written, split up by channel.
+ */
+static struct {
+    char text[CHANNELS + 1][4096];  ///< Data for each channel; the extra one
+                                    ///< gets anything for a bad channel
+    size_t len[CHANNELS + 1];
+    unsigned char controls[16];     ///< Control frames: channel, then op
+    size_t n_controls;
+    size_t longest;                 ///< Longest data frame
+    bool bad;                       ///< Zero length frame, or truncated
+} link;
+
+
+#define CHECK(cond, what) do { \
+    if (!(cond)) { \
+        printf("FAIL %s:%d: %s\n", __func__, __LINE__, what); \
+        ++failures; \
+    } \
+} while (0)
+
+
+static void write_cb(char const * buf, size_t len, void * arg)
+{
+    (void) arg;
+    if (out_len + len <= sizeof out) {
+        memcpy(&out[out_len], buf, len);
+        out_len += len;
+    }
+}
+
+
+/**
+ * Record the command with the channel it ran on, then act on it: `say X`
+ * prints <X>, and `spew N` prints N bytes counting through the alphabet.
+ */
+static int command_cb(esh_t * e, int argc, char ** argv, void * arg)
+{
+    (void) arg;
+    size_t len = strlen(ran);
+    int chan = 0;
+
+    while (chan < CHANNELS && esh[chan] != e) {
+        ++chan;
+    }
+    len += (size_t) snprintf(&ran[len], sizeof ran - len, "%d:", chan);
+    for (int i = 0; i < argc; ++i) {
+        len += (size_t) snprintf(&ran[len], sizeof ran - len, "%s[%s]",
+                i ? " " : "", argv[i]);
+    }
+    len += (size_t) snprintf(&ran[len], sizeof ran - len, "\n");
+
+    if (!strcmp(argv[0], "say") && argc == 2) {
+        esh_print(e, "<");
+        esh_print(e, argv[1]);
+        esh_print(e, ">");
+    } else if (!strcmp(argv[0], "spew") && argc == 2) {
+        for (int i = 0; i < atoi(argv[1]); ++i) {
+            char const c = (char) ('a' + i % 26);
+            esh_write(e, &c, 1);
+        }
+    } else if (!strcmp(argv[0], "dle")) {
+        esh_print(e, "[\x10]");
+    }
+    return 0;
+}
+
+
+/**
+ * Return whether the bytes were written, in a row.
+ */
+static bool sent(char const * s)
+{
+    size_t const len = strlen(s);
+
+    for (size_t i = 0; i + len <= out_len; ++i) {
+        if (!memcmp(&out[i], s, len)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/**
+ * Split what was written into channels, following the framing the mux
+ * documents.
+ * @param plain0 - bytes outside frames are plain text for channel 0
+ */
+static void parse(bool plain0)
+{
+    memset(&link, 0, sizeof link);
+
+    for (size_t i = 0; i < out_len; ) {
+        unsigned chan = 0;
+        size_t len = 1;
+        unsigned char const * data = &out[i];
+
+        if (out[i] != DLE) {
+            ++i;
+            if (!plain0) {
+                link.bad = true;
+                continue;
+            }
+        } else if (i + 1 < out_len && out[i + 1] == DLE) {
+            // Escaped DLE
+            i += 2;
+            link.bad |= !plain0;
+        } else if (i + 2 < out_len && (out[i + 1] & CTRL)) {
+            if (link.n_controls + 2 <= sizeof link.controls) {
+                link.controls[link.n_controls++] = out[i + 1] & ~CTRL;
+                link.controls[link.n_controls++] = out[i + 2];
+            }
+            i += 3;
+            continue;
+        } else if (i + 2 < out_len) {
+            chan = out[i + 1];
+            len = out[i + 2];
+            data = &out[i + 3];
+            i += 3 + len;
+            link.bad |= !len || i > out_len;
+            link.longest = len > link.longest ? len : link.longest;
+        } else {
+            link.bad = true;
+            break;
+        }
+
+        if (chan > CHANNELS) {
+            chan = CHANNELS;
+        }
+        if (link.len[chan] + len < sizeof link.text[chan]) {
+            memcpy(&link.text[chan][link.len[chan]], data, len);
+            link.len[chan] += len;
+        }
+    }
+}
+
+
+/**
+ * Pass bytes to the mux, whole or a byte at a time, and clear the record of
+ * what was written first.
+ */
+static void feed(void const * buf, size_t len, bool bytewise)
+{
+    out_len = 0;
+    ran[0] = 0;
+    if (bytewise) {
+        for (size_t i = 0; i < len; ++i) {
+            esh_mux_rx(mux, (char const *) buf + i, 1);
+        }
+    } else {
+        esh_mux_rx(mux, buf, len);
+    }
+}
+
+
+/**
+ * Build a data frame for a channel.
+ * @return frame length
+ */
+static size_t frame(unsigned char * buf, unsigned chan, char const * data)
+{
+    size_t const len = strlen(data);
+
+    buf[0] = DLE;
+    buf[1] = (unsigned char) chan;
+    buf[2] = (unsigned char) len;
+    memcpy(&buf[3], data, len);
+    return len + 3;
+}
+
+
+/**
+ * Set up a fresh mux with instances on the first CHANNELS channels.
+ */
+static void start(bool plain0)
+{
+    if (mux) {
+        for (int i = 0; i < CHANNELS; ++i) {
+            esh_free(esh[i]);
+        }
+        free(mux);
+    }
+
+    mux = esh_mux_init(&write_cb, NULL, plain0);
+    for (int i = 0; i < CHANNELS; ++i) {
+        esh[i] = esh_init();
+        esh_register_command(esh[i], &command_cb);
+        esh_mux_attach(mux, (unsigned) i, esh[i]);
+    }
+}
+
+
+static void test_framed(bool bytewise)
+{
+    unsigned char buf[1024];
+
+    start(false);
+    feed(buf, frame(buf, 1, "say one\n"), bytewise);
+    CHECK(!strcmp(ran, "1:[say] [one]\n"), "command run on channel 1");
+    parse(false);
+    CHECK(!link.bad, "everything written is framed");
+    CHECK(strstr(link.text[1], "<one>") && !strstr(link.text[0], "<one>"),
+            "output on channel 1 only");
+
+    // Two channels in one read, the first line in two frames around the
+    // second channel's.
+    size_t len = frame(buf, 2, "say tw");
+    len += frame(&buf[len], 0, "say three\n");
+    len += frame(&buf[len], 2, "o\n");
+    feed(buf, len, bytewise);
+    CHECK(!strcmp(ran, "0:[say] [three]\n2:[say] [two]\n"),
+            "interleaved channels kept apart");
+    parse(false);
+    CHECK(strstr(link.text[0], "<three>") && strstr(link.text[2], "<two>")
+            && !strstr(link.text[0], "<two>"), "output on the right channels");
+
+    // Text outside frames is noise when channel 0 is framed too.
+    feed("say noise\n", 10, bytewise);
+    CHECK(!ran[0], "unframed text ignored");
+}
+
+
+static void test_bad_frames(void)
+{
+    unsigned char buf[1024];
+
+    start(false);
+    // Empty frame, then frames for a channel with no instance and one out
+    // of range, then a good one.
+    size_t len = 0;
+    buf[len++] = DLE;
+    buf[len++] = 1;
+    buf[len++] = 0;
+    len += frame(&buf[len], 3, "say none\n");
+    len += frame(&buf[len], 0x7f, "say none\n");
+    len += frame(&buf[len], 1, "say ok\n");
+    feed(buf, len, false);
+    CHECK(!strcmp(ran, "1:[say] [ok]\n"),
+            "frames for nobody dropped, and the link stays in step");
+
+    // A DLE inside a frame's data is just data, here a nop key.
+    len = frame(buf, 1, "say \x10x\n");
+    feed(buf, len, true);
+    CHECK(!strcmp(ran, "1:[say] [x]\n"), "DLE inside data taken as data");
+}
+
+
+static void test_plain0(bool bytewise)
+{
+    unsigned char buf[1024];
+
+    start(true);
+    feed("say plain\n", 10, bytewise);
+    CHECK(!strcmp(ran, "0:[say] [plain]\n"), "plain text to channel 0");
+    parse(true);
+    CHECK(!link.bad && link.len[1] == 0 && strstr(link.text[0], "<plain>"),
+            "channel 0 output sent plain");
+
+    // Plain text before and after a frame, and DLE DLE as one byte.
+    size_t len = 0;
+    memcpy(buf, "sa", 2);
+    len = 2;
+    len += frame(&buf[len], 1, "say framed\n");
+    memcpy(&buf[len], "y \x10\x10z\n", 6);
+    len += 6;
+    feed(buf, len, bytewise);
+    CHECK(!strcmp(ran, "1:[say] [framed]\n0:[say] [z]\n"),
+            "plain text around a frame, DLE DLE taken as one byte");
+
+    feed("dle\n", 4, bytewise);
+    CHECK(!strcmp(ran, "0:[dle]\n"), "dle run");
+    CHECK(sent("[\x10\x10]"),
+            "DLE in plain output doubled");
+    parse(true);
+    CHECK(!link.bad && strstr(link.text[0], "[\x10]"),
+            "plain output with DLE parsed back");
+}
+
+
+static void test_long_output(void)
+{
+    unsigned char buf[64];
+
+    start(false);
+    feed(buf, frame(buf, 2, "spew 300\n"), false);
+    parse(false);
+    CHECK(!link.bad && link.longest <= 64, "long output split into frames");
+
+    char want[301];
+    for (int i = 0; i < 300; ++i) {
+        want[i] = (char) ('a' + i % 26);
+    }
+    want[300] = 0;
+    CHECK(strstr(link.text[2], want) != NULL, "long output arrives whole");
+}
+
+
+static void test_flow(void)
+{
+    unsigned char buf[64];
+    unsigned char const xoff[] = { DLE, CTRL | 1, XOFF };
+    unsigned char const xon[] = { DLE, CTRL | 1, XON };
+
+    start(false);
+    feed(xoff, sizeof xoff, false);
+    feed(buf, frame(buf, 1, "spew 100\n"), true);
+    CHECK(!strcmp(ran, "1:[spew] [100]\n"), "paused channel still runs");
+    parse(false);
+    CHECK(link.len[1] == 0, "nothing sent on a paused channel");
+    CHECK(esh_mux_dropped(mux, 1) > 0, "overflow while paused counted");
+
+    feed(buf, frame(buf, 2, "say other\n"), false);
+    parse(false);
+    CHECK(strstr(link.text[2], "<other>") != NULL,
+            "other channels not paused");
+
+    feed(xon, sizeof xon, false);
+    parse(false);
+    CHECK(link.len[1] == 64, "held output sent on XON");
+
+    out_len = 0;
+    esh_mux_throttle(mux, 2, true);
+    esh_mux_throttle(mux, 2, false);
+    parse(false);
+    CHECK(link.n_controls == 4 && link.controls[0] == 2
+            && link.controls[1] == XOFF && link.controls[3] == XON,
+            "throttle sends XOFF and XON");
+}
+
+
+int main(void)
+{
+    test_framed(false);
+    test_framed(true);
+    test_bad_frames();
+    test_plain0(false);
+    test_plain0(true);
+    test_long_output();
+    test_flow();
+
+    printf("mux: %s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,271 @@
+#define _POSIX_C_SOURCE 200809L
+#include <esh.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include "trace.h"
+
+/*
+ * Session replay. Reads the output of `esh-record` from a console log, decodes
+ * it, and feeds the bytes through esh_rx() as fast as it will take them,
+ * reporting what bench_CONFIG would for a trace. With -w, also saves the bytes
+ * as a trace, so a session from the field can join traces/ and be benchmarked
+ * and checked from then on.
+ *
+ * Usage: replay_CONFIG [-w TRACE] LOG
+ *
+ * If the log holds more than one recording, the last is used. Build with the
+ * esh_config.h of the device it came from, as far as the host allows.
+ */
+
+#define TARGET_BYTES    2000000     // Replay at least this much, for timing
+
+static unsigned long commands;
+static unsigned long printed;
+
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec;
+}
+
+
+static void print_cb(esh_t * esh, char c, void * arg)
+{
+    (void) esh;
+    (void) c;
+    (void) arg;
+    ++printed;
+}
+
+
+static int command_cb(esh_t * esh, int argc, char ** argv, void * arg)
+{
+    (void) esh;
+    (void) argc;
+    (void) argv;
+    (void) arg;
+    ++commands;
+    return 0;
+}
+
+
+#if defined(ESH_STATIC_CALLBACKS)
+void ESH_PRINT_CALLBACK(esh_t * esh, char c, void * arg)
+{
+    print_cb(esh, c, arg);
+}
+
+
+int ESH_COMMAND_CALLBACK(esh_t * esh, int argc, char ** argv, void * arg)
+{
+    return command_cb(esh, argc, argv, arg);
+}
+#elif defined(ESH_COMPACT)
+static const struct esh_ops ops = { &command_cb, &print_cb, NULL };
+#endif
+
+
+static esh_t * setup(void)
+{
+    esh_t * esh = esh_init();
+
+    if (!esh) {
+        fprintf(stderr, "esh_init failed\n");
+        exit(1);
+    }
+#if defined(ESH_COMPACT) && !defined(ESH_STATIC_CALLBACKS)
+    esh_register_ops(esh, &ops);
+#elif !defined(ESH_STATIC_CALLBACKS)
+    esh_register_command(esh, &command_cb);
+    esh_register_print(esh, &print_cb);
+#endif
+    return esh;
+}
+
+
+/**
+ * A decoded recording: each byte received, and the ticks since the one before.
+ */
+struct session {
+    char * keys;
+    uint32_t * gaps;
+    size_t len;
+};
+
+
+/**
+ * Find the last recording in a log and return its raw records.
+ * @param raw - on return, the records, to be freed
+ * @return their length, or -1 having said why
+ */
+static long read_records(FILE * f, uint8_t ** raw)
+{
+    char line[256];
+    long want = -1;
+    long len = -1;
+    bool in_block = false;
+
+    *raw = NULL;
+    while (fgets(line, sizeof line, f)) {
+        unsigned long n;
+        char end;
+
+        line[strcspn(line, "\r\n")] = 0;
+        if (sscanf(line, "esh-record %lu%c", &n, &end) == 1) {
+            // A new recording; forget any earlier one
+            uint8_t * const buf = realloc(*raw, n ? n : 1);
+            if (!buf) {
+                perror("realloc");
+                exit(1);
+            }
+            *raw = buf;
+            want = (long) n;
+            len = 0;
+            in_block = true;
+        } else if (in_block && !strcmp(line, "esh-record end")) {
+            in_block = false;
+        } else if (in_block) {
+            for (char const * p = line; p[0] && p[1]; p += 2) {
+                unsigned b;
+                if (len == want || sscanf(p, "%2x", &b) != 1) {
+                    fprintf(stderr, "bad recording line: %s\n", line);
+                    return -1;
+                }
+                (*raw)[len++] = (uint8_t) b;
+            }
+        }
+    }
+
+    if (want < 0) {
+        fprintf(stderr, "no esh-record output found\n");
+    } else if (in_block || len != want) {
+        fprintf(stderr, "recording cut short: %ld of %ld bytes\n", len, want);
+    } else {
+        return len;
+    }
+    return -1;
+}
+
+
+/**
+ * Decode records: the gap as a little-endian base-128 number, then the byte.
+ */
+static bool decode(uint8_t const * raw, size_t len, struct session * s)
+{
+    s->keys = malloc(len ? len : 1);
+    s->gaps = malloc((len ? len : 1) * sizeof *s->gaps);
+    s->len = 0;
+    if (!s->keys || !s->gaps) {
+        perror("malloc");
+        exit(1);
+    }
+
+    for (size_t i = 0; i < len;) {
+        uint32_t gap = 0;
+        unsigned shift = 0;
+
+        while (i < len && (raw[i] & 0x80) && shift < 28) {
+            gap |= (uint32_t) (raw[i++] & 0x7f) << shift;
+            shift += 7;
+        }
+        if (i + 1 >= len) {
+            fprintf(stderr, "bad record at byte %zu\n", i);
+            return false;
+        }
+        gap |= (uint32_t) raw[i++] << shift;
+        s->gaps[s->len] = gap;
+        s->keys[s->len++] = (char) raw[i++];
+    }
+    return true;
+}
+
+
+int main(int argc, char ** argv)
+{
+    char const * save = NULL;
+    int i = 1;
+
+    if (argc > 2 && !strcmp(argv[1], "-w")) {
+        save = argv[2];
+        i = 3;
+    }
+    if (i != argc - 1) {
+        fprintf(stderr, "usage: %s [-w TRACE] LOG\n", argv[0]);
+        return 2;
+    }
+
+    FILE * f = fopen(argv[i], "r");
+    if (!f) {
+        perror(argv[i]);
+        return 2;
+    }
+
+    uint8_t * raw;
+    long const raw_len = read_records(f, &raw);
+    struct session s;
+
+    fclose(f);
+    if (raw_len < 0 || !decode(raw, raw_len, &s)) {
+        return 1;
+    }
+    free(raw);
+
+    // The first gap is from a byte that has since been dropped.
+    uint64_t ticks = 0;
+    uint32_t longest = 0;
+    size_t longest_at = 0;
+    for (size_t k = 1; k < s.len; ++k) {
+        ticks += s.gaps[k];
+        if (s.gaps[k] > longest) {
+            longest = s.gaps[k];
+            longest_at = k;
+        }
+    }
+
+    printf("recorded   %zu bytes over %llu ticks", s.len,
+            (unsigned long long) ticks);
+    if (longest) {
+        printf(", longest gap %lu ticks before byte %zu",
+                (unsigned long) longest, longest_at);
+    }
+    printf("\n");
+
+    if (save && !trace_save(save, s.keys, s.len)) {
+        return 1;
+    }
+    if (!s.len) {
+        return 0;
+    }
+
+    // First pass on a fresh instance, as the device saw it
+    esh_t * esh = setup();
+    for (size_t k = 0; k < s.len; ++k) {
+        esh_rx(esh, s.keys[k]);
+    }
+    unsigned long const first_commands = commands;
+    unsigned long const first_printed = printed;
+
+    // Then again for timing
+    unsigned long const reps = (TARGET_BYTES + s.len - 1) / s.len;
+    uint64_t const t0 = now_ns();
+    for (unsigned long r = 0; r < reps; ++r) {
+        for (size_t k = 0; k < s.len; ++k) {
+            esh_rx(esh, s.keys[k]);
+        }
+    }
+    uint64_t const ns = now_ns() - t0;
+
+    printf("replayed   %s: %lu commands, %.4f out/byte, %.2f ns/byte\n",
+            CONFIG, first_commands, (double) first_printed / s.len,
+            (double) ns / ((double) s.len * reps));
+
+    free(s.keys);
+    free(s.gaps);
+    return 0;
+}
@@ -0,0 +1,451 @@
+#include <esh.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+/*
+ * RPC check. Builds COBS request frames the way a host would, feeds them to
+ * esh_rx_buf() whole, a byte at a time and split at awkward places, and
+ * decodes the framed responses, checking the argv each command was given,
+ * what it printed, and the status: bad CRCs, unknown command indexes, too
+ * many arguments, requests too long for the buffer, blocks of 254 bytes,
+ * typed input around frames, and requests that stop arriving.
+ *
+ * Usage: rpc_check
+ */
+
+#define MAX_FRAME   1024
+
+static esh_t * esh;
+
+static unsigned char out[4096];     // What esh sent back since the last feed
+static size_t out_len;
+
+static char ran[1024];              // Commands run, each argument in brackets
+static unsigned long commands;
+static bool was_binary;             // esh_rx_binary() inside the command
+static int failures;
+
+static char const * const names[] = { "led", "reset" };
+
+/**
+ * A decoded response.
+ */
+static struct {
+    unsigned char tag;
+    unsigned char output[2048];
+    size_t output_len;
+    unsigned char status;
+    unsigned char exit;
+} reply;
+
+
+#define CHECK(cond, what) do { \
+    if (!(cond)) { \
+        printf("FAIL %s:%d: %s\n", __func__, __LINE__, what); \
+        ++failures; \
+    } \
+} while (0)
+
+
+static void print_cb(esh_t * esh, char c, void * arg)
+{
+    (void) esh;
+    (void) arg;
+    if (out_len < sizeof out) {
+        out[out_len++] = (unsigned char) c;
+    }
+}
+
+
+/**
+ * Record the command, then act on it: `echo` prints its arguments, `long`
+ * prints more than a COBS block holds. Returns the argument count.
+ */
+static int command_cb(esh_t * esh, int argc, char ** argv, void * arg)
+{
+    (void) arg;
+    size_t len = strlen(ran);
+
+    ++commands;
+    was_binary = esh_rx_binary(esh);
+    for (int i = 0; i < argc; ++i) {
+        len += (size_t) snprintf(&ran[len], sizeof ran - len, "%s[%s]",
+                i ? " " : "", argv[i]);
+    }
+
+    if (!strcmp(argv[0], "echo")) {
+        for (int i = 1; i < argc; ++i) {
+            esh_print(esh, argv[i]);
+            esh_print(esh, i == argc - 1 ? "\n" : " ");
+        }
+    } else if (!strcmp(argv[0], "long")) {
+        for (int i = 0; i < 600; ++i) {
+            char const c = (char) ('a' + i % 26);
+            esh_write(esh, &c, 1);
+        }
+    }
+    return argc;
+}
+
+
+/**
+ * CRC-16/XMODEM, worked out here rather than taken from esh, so the two
+ * check each other.
+ */
+static uint16_t crc16(unsigned char const * p, size_t len)
+{
+    uint16_t crc = 0;
+
+    while (len--) {
+        crc ^= (uint16_t) (*p++ << 8);
+        for (int i = 0; i < 8; ++i) {
+            crc = (crc & 0x8000) ? (uint16_t) ((crc << 1) ^ 0x1021)
+                : (uint16_t) (crc << 1);
+        }
+    }
+    return crc;
+}
+
+
+/**
+ * COBS-encode a frame's payload, without its delimiters.
+ * @return encoded length
+ */
+static size_t cobs_encode(unsigned char const * in, size_t len,
+        unsigned char * enc)
+{
+    size_t code_i = 0;
+    size_t o = 1;
+    unsigned char code = 1;
+
+    for (size_t i = 0; i < len; ++i) {
+        if (in[i]) {
+            enc[o++] = in[i];
+            ++code;
+        }
+        if (!in[i] || code == 0xff) {
+            enc[code_i] = code;
+            code = 1;
+            code_i = o++;
+        }
+    }
+    enc[code_i] = code;
+    return o;
+}
+
+
+static size_t cobs_decode(unsigned char const * enc, size_t len,
+        unsigned char * dec)
+{
+    size_t o = 0;
+
+    for (size_t i = 0; i < len; ) {
+        unsigned char const code = enc[i++];
+        for (unsigned k = 1; k < code && i < len; ++k) {
+            dec[o++] = enc[i++];
+        }
+        if (code != 0xff && i < len) {
+            dec[o++] = 0;
+        }
+    }
+    return o;
+}
+
+
+/**
+ * Build a request frame, NUL to NUL.
+ * @param index - command name index, or 0xff for a name in args[0]
+ * @param args - arguments, NULL-terminated
+ * @return frame length
+ */
+static size_t request(unsigned char * frame, unsigned char tag,
+        unsigned char index, char const * const * args)
+{
+    static unsigned char raw[MAX_FRAME];
+    size_t n = 0;
+
+    raw[n++] = tag;
+    raw[n++] = index;
+    for (; *args; ++args) {
+        size_t const len = strlen(*args) + 1;
+        memcpy(&raw[n], *args, len);
+        n += len;
+    }
+
+    uint16_t const crc = crc16(raw, n);
+    raw[n++] = (unsigned char) (crc >> 8);
+    raw[n++] = (unsigned char) crc;
+
+    frame[0] = 0;
+    size_t const len = 1 + cobs_encode(raw, n, &frame[1]);
+    frame[len] = 0;
+    return len + 1;
+}
+
+
+/**
+ * Pass bytes to esh, whole or a byte at a time, and clear the reply buffer
+ * first.
+ */
+static void feed(void const * buf, size_t len, bool bytewise)
+{
+    out_len = 0;
+    ran[0] = 0;
+    if (bytewise) {
+        for (size_t i = 0; i < len; ++i) {
+            esh_rx_buf(esh, (char const *) buf + i, 1);
+        }
+    } else {
+        esh_rx_buf(esh, buf, len);
+    }
+}
+
+
+/**
+ * Decode the response in what esh sent back.
+ * @return false if there isn't exactly one well formed response
+ */
+static bool got_reply(void)
+{
+    unsigned char const * start = memchr(out, 0, out_len);
+    if (!start) {
+        return false;
+    }
+    ++start;
+    unsigned char const * end = memchr(start, 0, out_len - (start - out));
+    if (!end || end != &out[out_len - 1]) {
+        return false;
+    }
+
+    unsigned char dec[MAX_FRAME * 2];
+    size_t const n = cobs_decode(start, end - start, dec);
+    if (n < 5 || crc16(dec, n - 2) != ((dec[n - 2] << 8) | dec[n - 1])) {
+        return false;
+    }
+
+    reply.tag = dec[0];
+    reply.output_len = n - 5;
+    memcpy(reply.output, &dec[1], reply.output_len);
+    reply.output[reply.output_len] = 0;
+    reply.status = dec[n - 4];
+    reply.exit = dec[n - 3];
+    return true;
+}
+
+
+static void test_inline(bool bytewise)
+{
+    unsigned char frame[MAX_FRAME];
+    char const * const args[] = { "echo", "one", "two words", NULL };
+
+    feed(frame, request(frame, 0x42, 0xff, args), bytewise);
+    CHECK(!strcmp(ran, "[echo] [one] [two words]"), "argv as sent");
+    CHECK(was_binary, "binary while the command runs");
+    CHECK(got_reply(), "one well formed response");
+    CHECK(reply.tag == 0x42, "tag echoed");
+    CHECK(reply.status == ESH_RPC_OK && reply.exit == 3, "status and exit");
+    CHECK(!strcmp((char *) reply.output, "one two words\n"),
+            "output captured, newline untranslated");
+    CHECK(!esh_rx_binary(esh), "text again after the response");
+}
+
+
+static void test_index(void)
+{
+    unsigned char frame[MAX_FRAME];
+    char const * const args[] = { "now", NULL };
+    char const * const none[] = { NULL };
+
+    feed(frame, request(frame, 1, 1, args), false);
+    CHECK(!strcmp(ran, "[reset] [now]"), "name taken from the table");
+    CHECK(got_reply() && reply.status == ESH_RPC_OK, "indexed command ok");
+
+    feed(frame, request(frame, 2, 2, args), false);
+    CHECK(!ran[0], "unknown index not run");
+    CHECK(got_reply() && reply.status == ESH_RPC_BAD_COMMAND
+            && reply.tag == 2, "unknown index rejected");
+
+    feed(frame, request(frame, 3, 0xff, none), false);
+    CHECK(!ran[0], "request with no name not run");
+    CHECK(got_reply() && reply.status == ESH_RPC_BAD_COMMAND,
+            "request with no name rejected");
+}
+
+
+static void test_bad(void)
+{
+    unsigned char frame[MAX_FRAME];
+    char const * const args[] = { "echo", "x", NULL };
+    char const * const many[] = { "echo", "1", "2", "3", "4", "5", "6", NULL };
+
+    size_t len = request(frame, 7, 0xff, args);
+    frame[len - 2] ^= 0x01;
+    feed(frame, len, false);
+    CHECK(!ran[0], "bad CRC not run");
+    CHECK(got_reply() && reply.status == ESH_RPC_BAD_FRAME && reply.tag == 7,
+            "bad CRC rejected");
+
+    // Three bytes is too short to hold a CRC.
+    feed("\0\x04\x07\x01\x01\0", 6, false);
+    CHECK(!ran[0], "short frame not run");
+    CHECK(got_reply() && reply.status == ESH_RPC_BAD_FRAME,
+            "short frame rejected");
+
+    feed(frame, request(frame, 8, 0xff, many), true);
+    CHECK(!ran[0], "too many arguments not run");
+    CHECK(got_reply() && reply.status == ESH_RPC_OVERFLOW,
+            "too many arguments rejected");
+}
+
+
+static void test_split(void)
+{
+    unsigned char frame[MAX_FRAME];
+    char const * const args[] = { "echo", "split", NULL };
+    size_t const len = request(frame, 9, 0xff, args);
+
+    // Lead-in alone, then a cut inside the first block, then the rest.
+    out_len = 0;
+    ran[0] = 0;
+    esh_rx_buf(esh, (char *) frame, 1);
+    CHECK(esh_rx_binary(esh), "binary from the lead-in");
+    esh_rx_buf(esh, (char *) &frame[1], 4);
+    CHECK(!ran[0], "nothing run before the end");
+    esh_rx_buf(esh, (char *) &frame[5], len - 5);
+    CHECK(!strcmp(ran, "[echo] [split]"), "split request run");
+    CHECK(got_reply() && !strcmp((char *) reply.output, "split\n"),
+            "split request answered");
+
+    // Repeated NULs before a frame are all lead-in.
+    unsigned char twice[MAX_FRAME + 1] = { 0 };
+    memcpy(&twice[1], frame, len);
+    feed(twice, len + 1, false);
+    CHECK(!strcmp(ran, "[echo] [split]"), "double lead-in accepted");
+}
+
+
+static void test_long(bool bytewise)
+{
+    unsigned char frame[MAX_FRAME];
+    char arg[281];
+    char const * const args[] = { "echo", arg, NULL };
+    char const * const long_args[] = { "long", NULL };
+
+    // More than 254 bytes without a zero takes a full COBS block.
+    memset(arg, 'z', sizeof arg - 1);
+    arg[sizeof arg - 1] = 0;
+    feed(frame, request(frame, 10, 0xff, args), bytewise);
+    CHECK(got_reply() && reply.status == ESH_RPC_OK
+            && reply.output_len == sizeof arg
+            && !memcmp(reply.output, arg, sizeof arg - 1),
+            "argument longer than a COBS block");
+
+    feed(frame, request(frame, 11, 0xff, long_args), false);
+    CHECK(got_reply() && reply.output_len == 600
+            && reply.output[599] == 'a' + 599 % 26,
+            "output longer than a COBS block");
+}
+
+
+static void test_oversized(bool bytewise)
+{
+    unsigned char frame[MAX_FRAME];
+    char arg[400];
+    char const * const args[] = { "echo", arg, NULL };
+
+    // Newlines in it must never reach the line editor.
+    for (size_t i = 0; i < sizeof arg - 1; ++i) {
+        arg[i] = (i % 10 == 9) ? '\n' : 'a' + i % 26;
+    }
+    arg[sizeof arg - 1] = 0;
+
+    unsigned long const before = commands;
+    size_t const len = request(frame, 12, 0xff, args);
+    feed(frame, len - 1, bytewise);
+    CHECK(commands == before, "nothing run from an oversized request");
+    CHECK(esh_rx_binary(esh), "still binary up to its end");
+    CHECK(out_len == 0, "nothing sent before its end");
+
+    out_len = 0;
+    esh_rx_buf(esh, (char *) &frame[len - 1], 1);
+    CHECK(commands == before, "nothing run at its end");
+    CHECK(got_reply() && reply.status == ESH_RPC_BAD_FRAME
+            && reply.tag == 12, "oversized request rejected");
+    CHECK(!esh_rx_binary(esh), "text again after it");
+
+    feed("true\n", 5, false);
+    CHECK(!strcmp(ran, "[true]"), "typed input works afterwards");
+
+    char const * const next[] = { "echo", "next", NULL };
+    feed(frame, request(frame, 13, 0xff, next), false);
+    CHECK(got_reply() && !strcmp((char *) reply.output, "next\n"),
+            "next request answered");
+}
+
+
+static void test_typed(void)
+{
+    unsigned char frame[MAX_FRAME];
+    char const * const args[] = { "echo", "host", NULL };
+    unsigned char buf[MAX_FRAME + 32];
+
+    // Half a typed line, a request, then a typed command.
+    size_t len = request(frame, 14, 0xff, args);
+    memcpy(buf, "partial", 7);
+    memcpy(&buf[7], frame, len);
+    memcpy(&buf[7 + len], "echo typed\n", 11);
+    feed(buf, 7 + len + 11, false);
+    CHECK(!strcmp(ran, "[echo] [host][echo] [typed]"),
+            "half-typed line dropped, typed command after the frame run");
+}
+
+
+static void test_stray_nul(void)
+{
+    // A NUL from the keyboard, then typing, which goes nowhere.
+    feed("\0echo lost\n", 11, false);
+    CHECK(!ran[0], "typing after a stray NUL not run");
+    CHECK(esh_rx_binary(esh), "binary after a stray NUL");
+
+    out_len = 0;
+    esh_rpc_tick(esh);
+    CHECK(esh_rx_binary(esh), "first tick only starts the clock");
+    esh_rpc_tick(esh);
+    CHECK(!esh_rx_binary(esh), "dropped after a quiet tick");
+    CHECK(out_len >= 2 && !memcmp(&out[out_len - 2], "% ", 2),
+            "fresh prompt printed");
+
+    feed("echo back\n", 10, false);
+    CHECK(!strcmp(ran, "[echo] [back]"), "typed input works afterwards");
+}
+
+
+int main(void)
+{
+    esh = esh_init();
+    if (!esh) {
+        fprintf(stderr, "esh_init failed\n");
+        return 1;
+    }
+    esh_register_command(esh, &command_cb);
+    esh_register_print(esh, &print_cb);
+    esh_rpc_set_commands(esh, names, sizeof names / sizeof names[0]);
+
+    test_inline(false);
+    test_inline(true);
+    test_index();
+    test_bad();
+    test_split();
+    test_long(false);
+    test_long(true);
+    test_oversized(false);
+    test_oversized(true);
+    test_typed();
+    test_stray_nul();
+
+    printf("rpc: %s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
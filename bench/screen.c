@@ -0,0 +1,552 @@
+#include <esh.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include "trace.h"
+#define ESH_INTERNAL_INCLUDE
+#include <esh_internal.h>
+
+/*
+ * Screen model check. esh prints into a small VT100 emulator, and after every
+ * keystroke of a trace, the line the emulator's cursor is on must read the
+ * prompt followed by what esh holds, drawn the way a full esh_restore() would
+ * draw it, with the cursor at the insertion point. Incremental redraws are
+ * what this checks: however few bytes an edit sends, the terminal has to end
+ * up showing the same thing as if the whole line had been redrawn.
+ *
+ * It also counts what each kind of edit costs in output bytes.
+ *
+ * A trace can also say what esh must parse it into: traces/NAME.CONFIG.argv
+ * lists the commands NAME.trace hands to the callback under that
+ * configuration, one per line with each argument in brackets, and the check
+ * fails if they differ.
+ *
+ * Usage: screen_CONFIG TRACE...
+ *
+ * Exits with 1 if any keystroke left the screen wrong.
+ */
+
+#define ROWS        24
+#ifdef ESH_TERM_WIDTH
+#   define COLS     ESH_TERM_WIDTH
+#else
+#   define COLS     (ESH_BUFFER_LEN + 32)   // Lines never wrap
+#endif
+#define MAX_REPORTS 5                       // Mismatches shown per trace
+#define RAN_LEN     4096                    // Recorded commands per trace
+#define PROMPT_LEN  (sizeof(ESH_PROMPT) - 1)
+
+/**
+ * The emulated terminal. Only what esh sends is understood; anything else
+ * counts as an unknown sequence and fails the check.
+ */
+static struct {
+    char cell[ROWS][COLS];
+    int row, col;
+    int saved_row, saved_col;
+    bool wrap_pending;          ///< At the last column, and it's been written
+    enum { GROUND, ESCAPE, CSI } state;
+    int params[4];
+    int n_params;
+    unsigned long unknown;      ///< Sequences not understood
+    unsigned long printed;      ///< Bytes received
+} term;
+
+
+static void scroll_up(void)
+{
+    memmove(&term.cell[0], &term.cell[1], sizeof term.cell[0] * (ROWS - 1));
+    memset(&term.cell[ROWS - 1], ' ', COLS);
+}
+
+
+static void line_feed(void)
+{
+    if (term.row == ROWS - 1) {
+        scroll_up();
+    } else {
+        ++term.row;
+    }
+}
+
+
+static void clamp_cursor(void)
+{
+    term.row = (term.row < 0) ? 0 : (term.row >= ROWS) ? ROWS - 1 : term.row;
+    term.col = (term.col < 0) ? 0 : (term.col >= COLS) ? COLS - 1 : term.col;
+    term.wrap_pending = false;
+}
+
+
+static void term_reset(void)
+{
+    memset(&term, 0, sizeof term);
+    memset(term.cell, ' ', sizeof term.cell);
+}
+
+
+/**
+ * Carry out a CSI sequence, with final character c.
+ */
+static void csi(char c)
+{
+    int const n = (term.n_params && term.params[0]) ? term.params[0] : 1;
+    int const p0 = term.n_params ? term.params[0] : 0;
+
+    switch (c) {
+        case 'A':
+            term.row -= n;
+            break;
+        case 'B':
+            term.row += n;
+            break;
+        case 'C':
+            term.col += n;
+            break;
+        case 'D':
+            term.col -= n;
+            break;
+        case 'G':
+            term.col = n - 1;
+            break;
+        case 'H':
+        case 'f':
+            term.row = n - 1;
+            term.col = (term.n_params > 1 && term.params[1])
+                ? term.params[1] - 1 : 0;
+            break;
+        case 'K':
+            if (p0 == 0) {
+                memset(&term.cell[term.row][term.col], ' ', COLS - term.col);
+            } else if (p0 == 1) {
+                memset(&term.cell[term.row][0], ' ', term.col + 1);
+            } else {
+                memset(&term.cell[term.row][0], ' ', COLS);
+            }
+            break;
+        case 'J':
+            if (p0 == 2) {
+                memset(term.cell, ' ', sizeof term.cell);
+            } else {
+                ++term.unknown;
+            }
+            break;
+        case 'n':   // Status report request; a terminal would answer
+        case 'r':   // Scrolling region; no use for it here
+        case 'm':   // Attributes
+            break;
+        default:
+            ++term.unknown;
+    }
+    clamp_cursor();
+}
+
+
+static void term_putc(char c)
+{
+    ++term.printed;
+
+    if (term.state == ESCAPE) {
+        term.state = GROUND;
+        if (c == '[') {
+            term.state = CSI;
+            term.n_params = 0;
+            memset(term.params, 0, sizeof term.params);
+        } else if (c == '7') {
+            term.saved_row = term.row;
+            term.saved_col = term.col;
+        } else if (c == '8') {
+            term.row = term.saved_row;
+            term.col = term.saved_col;
+            term.wrap_pending = false;
+        } else if (c == 'D') {
+            line_feed();
+        } else {
+            ++term.unknown;
+        }
+    } else if (term.state == CSI) {
+        if (c >= '0' && c <= '9') {
+            if (!term.n_params) {
+                term.n_params = 1;
+            }
+            int * const p = &term.params[term.n_params - 1];
+            *p = (*p < 10000) ? *p * 10 + (c - '0') : *p;
+        } else if (c == ';') {
+            term.n_params += (term.n_params < 4) ? (term.n_params ? 1 : 2) : 0;
+        } else if (c == '?') {
+            // Private mode; the final character is all that matters here
+        } else {
+            term.state = GROUND;
+            csi(c);
+        }
+    } else if (c == 27) {
+        term.state = ESCAPE;
+    } else if (c == '\n') {
+        // The print callback of a real port turns this into \r\n.
+        term.col = 0;
+        term.wrap_pending = false;
+        line_feed();
+    } else if (c == '\r') {
+        term.col = 0;
+        term.wrap_pending = false;
+    } else if (c == '\b') {
+        if (term.col > 0) {
+            --term.col;
+        }
+        term.wrap_pending = false;
+    } else if (c == 7) {
+        // Bell
+    } else if ((unsigned char) c < ' ') {
+        ++term.unknown;
+    } else {
+        if (term.wrap_pending) {
+            term.col = 0;
+            term.wrap_pending = false;
+            line_feed();
+        }
+        term.cell[term.row][term.col] = c;
+        if (term.col == COLS - 1) {
+            term.wrap_pending = true;
+        } else {
+            ++term.col;
+        }
+    }
+}
+
+
+static void print_cb(esh_t * esh, char c, void * arg)
+{
+    (void) esh;
+    (void) arg;
+    term_putc(c);
+}
+
+
+/**
+ * Commands run in the current trace, as they're written in .argv files.
+ */
+static char ran[RAN_LEN];
+static size_t ran_len;
+
+
+static int command_cb(esh_t * esh, int argc, char ** argv, void * arg)
+{
+    (void) esh;
+    (void) arg;
+    for (int i = 0; i < argc && ran_len < RAN_LEN - 1; ++i) {
+        int const n = snprintf(&ran[ran_len], RAN_LEN - ran_len, "%s[%s]",
+                i ? " " : "", argv[i]);
+        ran_len = (n < 0 || (size_t) n >= RAN_LEN - ran_len)
+            ? RAN_LEN - 1 : ran_len + (size_t) n;
+    }
+    if (ran_len < RAN_LEN - 1) {
+        ran[ran_len++] = '\n';
+        ran[ran_len] = 0;
+    }
+    // Something has to fail for the traces to check && and ||.
+    return strcmp(argv[0], "false") == 0;
+}
+
+
+#if defined(ESH_STATIC_CALLBACKS)
+void ESH_PRINT_CALLBACK(esh_t * esh, char c, void * arg)
+{
+    print_cb(esh, c, arg);
+}
+
+
+int ESH_COMMAND_CALLBACK(esh_t * esh, int argc, char ** argv, void * arg)
+{
+    return command_cb(esh, argc, argv, arg);
+}
+#elif defined(ESH_COMPACT)
+static const struct esh_ops ops = { &command_cb, &print_cb, NULL };
+#endif
+
+
+/**
+ * Get the characters of the line being shown: the buffer, or the history
+ * entry being browsed.
+ * @param text - room for ESH_BUFFER_LEN + 1
+ * @param len - on return, number of characters
+ * @return false if the line is the buffer, true if it's a history entry
+ */
+static bool shown_text(esh_t * esh, char * text, size_t * len)
+{
+#ifdef ESH_HIST_ALLOC
+    if (esh->hist.idx) {
+        int const offset = esh_hist_nth(esh, esh->hist.idx - 1);
+        size_t n = 0;
+
+        for (int i = offset; offset >= 0 && esh->hist.ring.hist[i]
+                && n < ESH_BUFFER_LEN; i = (i + 1) % ESH_HIST_LEN) {
+            text[n++] = esh->hist.ring.hist[i];
+        }
+        *len = n;
+        return true;
+    }
+#endif
+    *len = (esh->cnt > ESH_BUFFER_LEN) ? ESH_BUFFER_LEN : esh->cnt;
+    memcpy(text, esh->buffer, *len);
+    return false;
+}
+
+
+/**
+ * Work out what the cursor line should read and where the cursor should be,
+ * from esh's own state, the way esh_restore() and esh_hist_print() draw it.
+ */
+static void expected(esh_t * esh, char * line, int * col)
+{
+    char text[ESH_BUFFER_LEN + 1];
+    size_t len;
+    bool const browsing = shown_text(esh, text, &len);
+    size_t ins = browsing ? len
+        : (esh->ins > ESH_BUFFER_LEN) ? ESH_BUFFER_LEN : esh->ins;
+    size_t n = 0;
+
+    memcpy(line, ESH_PROMPT, PROMPT_LEN);
+    n = PROMPT_LEN;
+
+#ifdef ESH_VIEWPORT
+    size_t const cols = esh_viewport_cols(esh);
+
+    if (browsing) {
+        if (len > cols) {
+            line[n++] = '<';
+            memcpy(&line[n], &text[len - cols + 1], cols - 1);
+            n += cols - 1;
+            ins = cols;
+        } else {
+            memcpy(&line[n], text, len);
+            n += len;
+        }
+    } else {
+        size_t const start = esh->vp.start;
+        bool const more = len > start + cols;
+        size_t const end = more ? start + cols - 1 : len;
+        size_t i = start;
+
+        if (start) {
+            line[n++] = '<';
+            ++i;
+        }
+        for (; i < end; ++i) {
+            line[n++] = text[i];
+        }
+        if (more) {
+            line[n++] = '>';
+        }
+        ins -= start;
+    }
+#else
+    memcpy(&line[n], text, len);
+    n += len;
+#endif
+
+    // Trailing spaces can't be seen, so they aren't compared.
+    while (line[n - 1] == ' ') {
+        --n;
+    }
+    line[n] = 0;
+    *col = (int) (PROMPT_LEN + ins);
+}
+
+
+/**
+ * Copy out the line the cursor is on, without trailing spaces.
+ */
+static void actual(char * line)
+{
+    int n = COLS;
+
+    while (n && term.cell[term.row][n - 1] == ' ') {
+        --n;
+    }
+    memcpy(line, term.cell[term.row], n);
+    line[n] = 0;
+}
+
+
+/**
+ * Kinds of edit that output is counted for.
+ */
+enum edit {
+    TYPE,           ///< Character typed at the end of the line
+    INSERT,         ///< Character typed before the end
+    ERASE,          ///< Backspace at the end of the line
+    ERASE_MID,      ///< Backspace before the end
+    MOVE,           ///< Cursor movement key
+    HISTORY,        ///< Up or down
+    ENTER,          ///< Running a command, up to the next prompt
+    N_EDITS,
+    PENDING = N_EDITS,  ///< Part of an escape sequence
+};
+
+static char const * const edit_names[N_EDITS] = {
+    "type", "insert", "erase", "erase-mid", "move", "history", "enter",
+};
+
+
+/**
+ * Tell what kind of edit a keystroke finishes.
+ * @param in_esc - escape sequence state, kept between calls
+ */
+static enum edit classify(esh_t * esh, char c, int * in_esc)
+{
+    bool const at_end = esh->ins >= esh->cnt || esh->cnt > ESH_BUFFER_LEN;
+
+    if (*in_esc == 1) {
+        *in_esc = (c == '[' || c == 'O') ? 2 : 0;
+        return *in_esc ? PENDING : MOVE;
+    } else if (*in_esc == 2) {
+        if ((c >= '0' && c <= '9') || c == ';') {
+            return PENDING;
+        }
+        *in_esc = 0;
+        return (c == 'A' || c == 'B') ? HISTORY : MOVE;
+    } else if (c == 27) {
+        *in_esc = 1;
+        return PENDING;
+    } else if (c == '\n') {
+        return ENTER;
+    } else if (c == '\b' || c == 127) {
+        return at_end ? ERASE : ERASE_MID;
+    } else {
+        return at_end ? TYPE : INSERT;
+    }
+}
+
+
+/**
+ * Replay a trace, checking the screen after every keystroke.
+ * @return number of keystrokes after which the screen was wrong
+ */
+static unsigned long check(esh_t * esh, char const * name,
+        char const * keys, size_t len)
+{
+    unsigned long bytes[N_EDITS] = {0};
+    unsigned long count[N_EDITS] = {0};
+    unsigned long bad = 0;
+    unsigned long pending = 0;
+    int in_esc = 0;
+
+    for (size_t i = 0; i < len; ++i) {
+        enum edit const kind = classify(esh, keys[i], &in_esc);
+        unsigned long const before = term.printed;
+
+        esh_rx(esh, keys[i]);
+        pending += term.printed - before;
+        if (kind != PENDING) {
+            bytes[kind] += pending;
+            ++count[kind];
+            pending = 0;
+        }
+
+        char want[COLS + 1], got[COLS + 1];
+        int col;
+
+        expected(esh, want, &col);
+        actual(got);
+        if (in_esc || (!strcmp(want, got) && col == term.col)) {
+            continue;
+        }
+        if (++bad <= MAX_REPORTS) {
+            printf("%-10s %-10s key %zu:\n    want \"%s\" at %d\n"
+                    "    got  \"%s\" at %d\n",
+                    CONFIG, name, i, want, col, got, term.col);
+        }
+    }
+
+    for (int k = 0; k < N_EDITS; ++k) {
+        if (count[k]) {
+            printf("%-10s %-10s %-10s %6lu %8.2f\n", CONFIG, name,
+                    edit_names[k], count[k], (double) bytes[k] / count[k]);
+        }
+    }
+    return bad;
+}
+
+
+/**
+ * Compare the commands a trace ran with its .argv file for this
+ * configuration, if it has one.
+ * @return 1 if they differ, else 0
+ */
+static unsigned long check_argv(char const * path, char const * name)
+{
+    char argv_path[256];
+    size_t const base = strlen(path) - (strstr(path, ".trace") ? 6 : 0);
+
+    snprintf(argv_path, sizeof argv_path, "%.*s.%s.argv", (int) base, path,
+            CONFIG);
+    FILE * f = fopen(argv_path, "r");
+    if (!f) {
+        return 0;
+    }
+
+    char want[RAN_LEN];
+    size_t const n = fread(want, 1, sizeof want - 1, f);
+    want[n] = 0;
+    fclose(f);
+
+    if (!strcmp(want, ran)) {
+        return 0;
+    }
+    printf("%-10s %-10s commands differ from %s; got:\n%s", CONFIG, name,
+            argv_path, ran);
+    return 1;
+}
+
+
+int main(int argc, char ** argv)
+{
+    unsigned long bad = 0;
+
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s TRACE...\n", argv[0]);
+        return 2;
+    }
+
+    esh_t * esh = esh_init();
+    if (!esh) {
+        fprintf(stderr, "esh_init failed\n");
+        return 2;
+    }
+#if defined(ESH_COMPACT) && !defined(ESH_STATIC_CALLBACKS)
+    esh_register_ops(esh, &ops);
+#elif !defined(ESH_STATIC_CALLBACKS)
+    esh_register_command(esh, &command_cb);
+    esh_register_print(esh, &print_cb);
+#endif
+
+    for (int i = 1; i < argc; ++i) {
+        size_t len;
+        char * keys = trace_load(argv[i], &len);
+        char name[32];
+
+        if (!keys) {
+            return 2;
+        }
+        trace_name(argv[i], name, sizeof name);
+
+        // Every trace starts on a fresh screen. Traces end with a newline,
+        // so the line is empty.
+        term_reset();
+        esh_print_prompt(esh);
+        ran_len = 0;
+        ran[0] = 0;
+
+        bad += check(esh, name, keys, len);
+        bad += check_argv(argv[i], name);
+        if (term.unknown) {
+            printf("%-10s %-10s %lu unknown escape sequences\n",
+                    CONFIG, name, term.unknown);
+            ++bad;
+        }
+        free(keys);
+    }
+
+    return bad ? 1 : 0;
+}
@@ -0,0 +1,133 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include "trace.h"
+
+static int hex_digit(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    } else {
+        return -1;
+    }
+}
+
+
+char * trace_load(char const * path, size_t * len)
+{
+    FILE * f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        return NULL;
+    }
+
+    fseek(f, 0, SEEK_END);
+    long const size = ftell(f);
+    rewind(f);
+
+    char * buf = malloc(size + 1);
+    if (!buf || fread(buf, 1, size, f) != (size_t) size) {
+        fprintf(stderr, "%s: can't read\n", path);
+        fclose(f);
+        free(buf);
+        return NULL;
+    }
+    fclose(f);
+
+    size_t n = 0;
+    bool bol = true;
+
+    for (long i = 0; i < size; ++i) {
+        char c = buf[i];
+
+        if (bol && c == '#') {
+            while (i < size && buf[i] != '\n') {
+                ++i;
+            }
+            continue;
+        }
+        bol = (c == '\n');
+        if (c == '\n' || c == '\r') {
+            continue;
+        } else if (c != '\\' || i + 1 == size) {
+            buf[n++] = c;
+            continue;
+        }
+
+        c = buf[++i];
+        if (c == 'x' && i + 2 < size && hex_digit(buf[i + 1]) >= 0
+                && hex_digit(buf[i + 2]) >= 0) {
+            c = (char) (hex_digit(buf[i + 1]) * 16 + hex_digit(buf[i + 2]));
+            i += 2;
+        } else {
+            char const * const from = "nrtbe";
+            char const * const to = "\n\r\t\b\33";
+            char const * const p = strchr(from, c);
+
+            if (p && c) {
+                c = to[p - from];
+            }
+        }
+        buf[n++] = c;
+    }
+
+    *len = n;
+    return buf;
+}
+
+
+bool trace_save(char const * path, char const * keys, size_t len)
+{
+    FILE * f = fopen(path, "w");
+    if (!f) {
+        perror(path);
+        return false;
+    }
+
+    for (size_t i = 0; i < len; ++i) {
+        char const c = keys[i];
+        char const * const from = "\n\r\t\b\33\\";
+        char const * const to = "nrtbe\\";
+        char const * const p = c ? strchr(from, c) : NULL;
+
+        if (p) {
+            fprintf(f, "\\%c", to[p - from]);
+        } else if (c < 0x20 || c >= 0x7f || c == '#') {
+            // # would start a comment at the start of a line
+            fprintf(f, "\\x%02x", (unsigned char) c);
+        } else {
+            fputc(c, f);
+        }
+        if (c == '\n') {
+            fputc('\n', f);
+        }
+    }
+
+    if (len && keys[len - 1] != '\n') {
+        fputc('\n', f);
+    }
+    if (fclose(f)) {
+        perror(path);
+        return false;
+    }
+    return true;
+}
+
+
+void trace_name(char const * path, char * name, size_t size)
+{
+    char const * slash = strrchr(path, '/');
+    char const * base = slash ? slash + 1 : path;
+    size_t n = strcspn(base, ".");
+
+    if (n >= size) {
+        n = size - 1;
+    }
+    memcpy(name, base, n);
+    name[n] = 0;
+}
@@ -0,0 +1,33 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+ * Keystroke traces for the benchmarks. Traces are text. Newlines in the file
+ * are ignored, so long input can be wrapped, and lines starting with # are
+ * comments. Keys are written with escapes: \n (enter), \r, \t, \b, \e
+ * (escape), \\ and \xHH.
+ */
+
+/**
+ * Read a trace file and decode it.
+ * @param len - on return, the number of keystrokes
+ * @return the keystrokes, to be freed, or NULL having said why
+ */
+char * trace_load(char const * path, size_t * len);
+
+/**
+ * Write keystrokes as a trace file, one line per command.
+ * @return false having said why, if it couldn't be written
+ */
+bool trace_save(char const * path, char const * keys, size_t len);
+
+/**
+ * Return the name of a trace, for reports: its file name without the
+ * directory or extension.
+ */
+void trace_name(char const * path, char * name, size_t size);
+
+#endif // TRACE_H
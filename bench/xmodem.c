@@ -0,0 +1,433 @@
+#include <esh.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+/*
+ * File transfer check. Builds XMODEM, XMODEM-1K and YMODEM packets the way sx
+ * and sb frame them, feeds them to esh_rx_buf() whole and a byte at a time,
+ * and checks what the receiver answers and what reaches the sink: CRC
+ * rejection, repeated and out of order blocks, block numbers wrapping past
+ * 255, YMODEM headers and file sizes, and cancellation by the sender.
+ *
+ * Usage: xmodem_check
+ */
+
+#define SOH 0x01
+#define STX 0x02
+#define EOT 0x04
+#define ACK 0x06
+#define NAK 0x15
+#define CAN 0x18
+#define SUB 0x1a    // sx pads the last block with these
+
+static esh_t * esh;
+static char work[ESH_XMODEM_WORK_LEN];
+
+static char out[4096];          // What esh sent back since the last feed
+static size_t out_len;
+
+static char got[8192];          // File data given to the sink
+static size_t got_len;
+static char file_name[64];
+static int events[4];           // Count of each esh_xmodem_event
+static unsigned long commands;
+static int failures;
+
+
+#define CHECK(cond, what) do { \
+    if (!(cond)) { \
+        printf("FAIL %s:%d: %s\n", __func__, __LINE__, what); \
+        ++failures; \
+    } \
+} while (0)
+
+
+static void print_cb(esh_t * esh, char c, void * arg)
+{
+    (void) esh;
+    (void) arg;
+    if (out_len < sizeof out) {
+        out[out_len++] = c;
+    }
+}
+
+
+static bool sink(esh_t * esh, enum esh_xmodem_event ev,
+        char const * data, size_t len, void * arg)
+{
+    (void) esh;
+    (void) arg;
+    ++events[ev];
+
+    if (ev == ESH_XMODEM_FILE) {
+        snprintf(file_name, sizeof file_name, "%s", data);
+    } else if (ev == ESH_XMODEM_DATA && got_len + len <= sizeof got) {
+        memcpy(&got[got_len], data, len);
+        got_len += len;
+    }
+    return true;
+}
+
+
+static int command_cb(esh_t * esh, int argc, char ** argv, void * arg)
+{
+    (void) arg;
+    ++commands;
+    if (argc == 1 && !strcmp(argv[0], "rx")) {
+        esh_xmodem_receive(esh, work, &sink, NULL);
+    }
+    return 0;
+}
+
+
+/**
+ * CRC-16/XMODEM, worked out here rather than taken from esh, so the two
+ * check each other.
+ */
+static uint16_t crc16(unsigned char const * p, size_t len)
+{
+    uint16_t crc = 0;
+
+    while (len--) {
+        crc ^= (uint16_t) (*p++ << 8);
+        for (int i = 0; i < 8; ++i) {
+            crc = (crc & 0x8000) ? (uint16_t) (crc << 1 ^ 0x1021)
+                : (uint16_t) (crc << 1);
+        }
+    }
+    return crc;
+}
+
+
+/**
+ * Frame a block.
+ * @param start - SOH for 128 bytes, STX for 1024
+ * @param pad - byte to fill the rest of the block with
+ * @return packet length
+ */
+static size_t frame(unsigned char * pkt, int start, uint8_t block,
+        char const * data, size_t len, unsigned char pad)
+{
+    size_t const size = start == STX ? 1024 : 128;
+
+    pkt[0] = (unsigned char) start;
+    pkt[1] = block;
+    pkt[2] = (unsigned char) ~block;
+    memset(&pkt[3], pad, size);
+    memcpy(&pkt[3], data, len);
+
+    uint16_t const crc = crc16(&pkt[3], size);
+    pkt[3 + size] = (unsigned char) (crc >> 8);
+    pkt[4 + size] = (unsigned char) crc;
+    return size + 5;
+}
+
+
+/**
+ * Pass bytes to esh, whole or a byte at a time, and clear the reply buffer
+ * first.
+ */
+static void feed(void const * buf, size_t len, bool bytewise)
+{
+    out_len = 0;
+    if (bytewise) {
+        for (size_t i = 0; i < len; ++i) {
+            esh_rx_buf(esh, (char const *) buf + i, 1);
+        }
+    } else {
+        esh_rx_buf(esh, buf, len);
+    }
+}
+
+
+static void feed_byte(unsigned char c)
+{
+    feed(&c, 1, false);
+}
+
+
+static bool replied(char const * want, size_t len)
+{
+    return out_len >= len && !memcmp(out, want, len);
+}
+
+
+static void start(void)
+{
+    memset(events, 0, sizeof events);
+    got_len = 0;
+    file_name[0] = 0;
+    feed("rx\n", 3, false);
+    CHECK(out_len && out[out_len - 1] == 'C', "receiver asks for CRC mode");
+    CHECK(esh_rx_binary(esh), "input is binary during a transfer");
+}
+
+
+static void test_xmodem_128(bool bytewise)
+{
+    unsigned char pkt[1029];
+    char data[256];
+
+    for (size_t i = 0; i < sizeof data; ++i) {
+        data[i] = (char) (i * 7 + 3);
+    }
+
+    start();
+    feed(pkt, frame(pkt, SOH, 1, data, 128, SUB), bytewise);
+    CHECK(replied("\x06", 1), "block 1 acknowledged");
+    feed(pkt, frame(pkt, SOH, 2, &data[128], 100, SUB), bytewise);
+    CHECK(replied("\x06", 1), "block 2 acknowledged");
+    feed_byte(EOT);
+    CHECK(replied("\x06", 1), "EOT acknowledged");
+    CHECK(events[ESH_XMODEM_DONE] == 1, "transfer done");
+    CHECK(!esh_rx_binary(esh), "back at the prompt");
+
+    // Plain XMODEM has no file size, so the padding comes through too.
+    CHECK(got_len == 256, "two blocks delivered");
+    CHECK(!memcmp(got, data, 228), "data delivered intact");
+    CHECK(got[228] == SUB && got[255] == SUB, "padding delivered");
+}
+
+
+static void test_xmodem_1k(void)
+{
+    unsigned char pkt[1029];
+    char data[1024 + 128];
+
+    for (size_t i = 0; i < sizeof data; ++i) {
+        data[i] = (char) (i ^ (i >> 8));
+    }
+
+    start();
+    // sx -k sends 1K blocks, and 128-byte ones for a short tail.
+    feed(pkt, frame(pkt, STX, 1, data, 1024, SUB), true);
+    CHECK(replied("\x06", 1), "1K block acknowledged");
+    feed(pkt, frame(pkt, SOH, 2, &data[1024], 128, SUB), false);
+    CHECK(replied("\x06", 1), "128-byte block after 1K acknowledged");
+    feed_byte(EOT);
+    CHECK(events[ESH_XMODEM_DONE] == 1, "transfer done");
+    CHECK(got_len == sizeof data && !memcmp(got, data, sizeof data),
+            "1K and 128-byte blocks delivered intact");
+}
+
+
+static void test_bad_crc(void)
+{
+    unsigned char pkt[1029];
+    char data[128] = "first";
+
+    start();
+    feed(pkt, frame(pkt, SOH, 1, data, sizeof data, SUB), false);
+    CHECK(replied("\x06", 1), "block 1 acknowledged");
+
+    strcpy(data, "second");
+    size_t const len = frame(pkt, SOH, 2, data, sizeof data, SUB);
+    pkt[len - 1] ^= 0x01;
+    feed(pkt, len, false);
+    CHECK(replied("\x15", 1), "bad CRC rejected");
+    CHECK(got_len == 128, "bad block not delivered");
+
+    pkt[len - 1] ^= 0x01;
+    pkt[10] ^= 0x40;
+    feed(pkt, len, true);
+    CHECK(replied("\x15", 1), "corrupt data rejected");
+    CHECK(got_len == 128, "corrupt block not delivered");
+
+    pkt[10] ^= 0x40;
+    pkt[2] = 0;
+    feed(pkt, len, false);
+    CHECK(replied("\x15", 1), "bad block number complement rejected");
+
+    feed(pkt, frame(pkt, SOH, 2, data, sizeof data, SUB), false);
+    CHECK(replied("\x06", 1), "block 2 accepted when resent");
+    CHECK(got_len == 256 && !strcmp(&got[128], "second"),
+            "resent block delivered");
+
+    feed_byte(EOT);
+    CHECK(events[ESH_XMODEM_DONE] == 1, "transfer done");
+}
+
+
+static void test_repeat(void)
+{
+    unsigned char pkt[1029];
+    char data[128] = "once";
+
+    start();
+    size_t const len = frame(pkt, SOH, 1, data, sizeof data, SUB);
+    feed(pkt, len, false);
+    CHECK(replied("\x06", 1), "block 1 acknowledged");
+
+    // Our ACK was lost, so the sender tries again.
+    feed(pkt, len, false);
+    CHECK(replied("\x06", 1), "repeated block acknowledged");
+    CHECK(got_len == 128, "repeated block not delivered twice");
+
+    // A block from further ahead means the two ends have lost each other.
+    feed(pkt, frame(pkt, SOH, 3, data, sizeof data, SUB), false);
+    CHECK(replied("\x18\x18\x18", 3), "skipped block cancels");
+    CHECK(events[ESH_XMODEM_FAILED] == 1, "transfer failed");
+    CHECK(!esh_rx_binary(esh), "back at the prompt");
+}
+
+
+static void test_ymodem(bool bytewise)
+{
+    unsigned char pkt[1029];
+    char header[128];
+    char data[1024];
+
+    for (size_t i = 0; i < sizeof data; ++i) {
+        data[i] = (char) (i * 13);
+    }
+
+    // sb: name, NUL, size in decimal, then mtime and mode in octal
+    memset(header, 0, sizeof header);
+    int const n = snprintf(header, sizeof header,
+            "file.bin%c300 14532606732 100644", 0);
+
+    start();
+    feed(pkt, frame(pkt, SOH, 0, header, (size_t) n, 0), bytewise);
+    CHECK(replied("\x06" "C", 2), "header acknowledged, data requested");
+    CHECK(events[ESH_XMODEM_FILE] == 1 && !strcmp(file_name, "file.bin"),
+            "file name given to the sink");
+
+    // Block 0 again: the ACK was lost.
+    feed(pkt, frame(pkt, SOH, 0, header, (size_t) n, 0), false);
+    CHECK(replied("\x06" "C", 2), "repeated header acknowledged");
+    CHECK(events[ESH_XMODEM_FILE] == 1, "repeated header not given twice");
+
+    feed(pkt, frame(pkt, STX, 1, data, 300, SUB), bytewise);
+    CHECK(replied("\x06", 1), "data block acknowledged");
+    CHECK(got_len == 300 && !memcmp(got, data, 300),
+            "padding past the file size removed");
+
+    feed_byte(EOT);
+    CHECK(replied("\x06" "C", 2), "EOT acknowledged, next header requested");
+    CHECK(events[ESH_XMODEM_DONE] == 0, "transfer still open");
+
+    memset(header, 0, sizeof header);
+    feed(pkt, frame(pkt, SOH, 0, header, 0, 0), bytewise);
+    CHECK(replied("\x06", 1), "empty header acknowledged");
+    CHECK(events[ESH_XMODEM_DONE] == 1, "empty header ends the batch");
+    CHECK(!esh_rx_binary(esh), "back at the prompt");
+}
+
+
+static void test_wrap(void)
+{
+    unsigned char pkt[1029];
+    char header[128] = "big.bin";
+    char data[128];
+
+    start();
+    feed(pkt, frame(pkt, SOH, 0, header, sizeof header, 0), false);
+    CHECK(replied("\x06" "C", 2), "header acknowledged, data requested");
+
+    // Block 256 goes out numbered 0, like the header.
+    for (int block = 1; block <= 256; ++block) {
+        memset(data, block, sizeof data);
+        feed(pkt, frame(pkt, SOH, (uint8_t) block, data, sizeof data, SUB),
+                false);
+    }
+    CHECK(events[ESH_XMODEM_DATA] == 256, "256 blocks delivered");
+
+    // Its ACK was lost. This isn't the header, so there's no second 'C',
+    // which the sender would take as a NAK.
+    feed(pkt, frame(pkt, SOH, 0, data, sizeof data, SUB), false);
+    CHECK(out_len == 1 && replied("\x06", 1),
+            "repeated block 0 acknowledged once, with no 'C'");
+    CHECK(events[ESH_XMODEM_DATA] == 256, "repeated block not delivered");
+
+    feed(pkt, frame(pkt, SOH, 1, data, sizeof data, SUB), false);
+    CHECK(replied("\x06", 1), "block 257 acknowledged");
+    CHECK(events[ESH_XMODEM_DATA] == 257, "block 257 delivered");
+
+    feed_byte(EOT);
+    memset(header, 0, sizeof header);
+    feed(pkt, frame(pkt, SOH, 0, header, 0, 0), false);
+    CHECK(events[ESH_XMODEM_DONE] == 1, "transfer done");
+}
+
+
+static void test_cancel(void)
+{
+    unsigned char pkt[1029];
+    char data[128] = "partial";
+
+    start();
+    feed(pkt, frame(pkt, SOH, 1, data, sizeof data, SUB), false);
+    CHECK(replied("\x06", 1), "block 1 acknowledged");
+
+    // One CAN may be line noise; two in a row cancel.
+    feed_byte(CAN);
+    CHECK(esh_rx_binary(esh), "one CAN ignored");
+    feed_byte(CAN);
+    CHECK(events[ESH_XMODEM_FAILED] == 1, "two CANs cancel");
+    CHECK(!esh_rx_binary(esh), "back at the prompt");
+
+    // The console works again afterwards.
+    unsigned long const before = commands;
+    feed("true\n", 5, false);
+    CHECK(commands == before + 1, "commands run after a cancel");
+
+    // A CAN inside a packet is data, not a cancel.
+    start();
+    memset(data, CAN, sizeof data);
+    feed(pkt, frame(pkt, SOH, 1, data, sizeof data, SUB), true);
+    CHECK(replied("\x06", 1), "block full of CAN bytes acknowledged");
+    CHECK(events[ESH_XMODEM_FAILED] == 0, "CAN bytes in a block don't cancel");
+    CHECK(got_len == 128 && (unsigned char) got[127] == CAN,
+            "CAN bytes delivered");
+
+    // Cancelling from this end tells the sender.
+    out_len = 0;
+    esh_xmodem_cancel(esh);
+    CHECK(replied("\x18\x18\x18", 3), "cancel sent to the sender");
+    CHECK(events[ESH_XMODEM_FAILED] == 1, "transfer failed");
+}
+
+
+static void test_timeout(void)
+{
+    start();
+    out_len = 0;
+    esh_xmodem_tick(esh);
+    CHECK(out_len == 0, "first tick only starts the clock");
+    esh_xmodem_tick(esh);
+    CHECK(replied("C", 1), "sender asked again after a quiet tick");
+
+    for (int i = 0; i < 20 && esh_rx_binary(esh); ++i) {
+        esh_xmodem_tick(esh);
+    }
+    CHECK(events[ESH_XMODEM_FAILED] == 1, "receiver gives up in the end");
+}
+
+
+int main(void)
+{
+    esh = esh_init();
+    if (!esh) {
+        fprintf(stderr, "esh_init failed\n");
+        return 1;
+    }
+    esh_register_command(esh, &command_cb);
+    esh_register_print(esh, &print_cb);
+
+    test_xmodem_128(false);
+    test_xmodem_128(true);
+    test_xmodem_1k();
+    test_bad_crc();
+    test_repeat();
+    test_ymodem(false);
+    test_ymodem(true);
+    test_wrap();
+    test_cancel();
+    test_timeout();
+
+    printf("xmodem: %s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
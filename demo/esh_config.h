@@ -4,6 +4,54 @@
 
 #define ESH_HIST_ALLOC STATIC
 #define ESH_HIST_LEN 4096
+#define ESH_HIST_PERSIST
 
 #define ESH_ALLOC STATIC
 #define ESH_INSTANCES 1
+
+#define ESH_VIEWPORT
+#define ESH_TERM_WIDTH 80
+
+#define ESH_DATA_MODE
+#define ESH_XMODEM
+#define ESH_BRACE_EXPANSION
+
+#define ESH_PIPE
+#define ESH_PIPE_STAGES 4
+#define ESH_PIPE_LINE_LEN 80
+#define ESH_PIPE_TAIL_LEN 512
+
+#define ESH_VARS
+#define ESH_VARS_LEN 256
+#define ESH_VARS_SLOTS 16
+
+#define ESH_MACROS
+#define ESH_MACRO_LEN 256
+#define ESH_MACROS_BUILTIN \
+    ESH_MACRO("yes", \
+        ESH_MACRO_SEQ ESH_MACRO_ARG("true") \
+        ESH_MACRO_AND ESH_MACRO_ARG("echo") ESH_MACRO_ARG("yes") \
+        ESH_MACRO_OR ESH_MACRO_ARG("echo") ESH_MACRO_ARG("no"))
+
+#define ESH_WATCH
+#define ESH_WATCH_ROWS 20
+#define ESH_WATCH_COLS 79
+
+#define ESH_STATUSBAR
+#define ESH_STATUSBAR_LINES 1
+#define ESH_STATUSBAR_COLS 79
+#define ESH_STATUSBAR_TICKS 1
+
+#define ESH_STATS
+
+#define ESH_TRACE
+#define ESH_TRACE_LEN 256
+#define ESH_TRACE_CMDS 8
+#define ESH_TRACE_CLOCK demo_clock
+
+#define ESH_RECORD
+#define ESH_RECORD_LEN 4096
+#define ESH_RECORD_CLOCK demo_clock
+
+#define ESH_POSIX
+#define ESH_POSIX_BUF_LEN 1024
@@ -1,42 +1,195 @@
+// Before any system header, for clock_gettime()
+#define _POSIX_C_SOURCE 200809L
+
 #include <esh.h>
 #include <stdio.h>
-#include <termios.h>
+#include <stdarg.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+
+int esh_command_cb(esh_t * esh, int argc, char ** argv, void * arg);
+uint32_t demo_clock(void);
+static void load_cb(esh_t * esh, char const * data, size_t len, void * arg);
+static bool rx_cb(esh_t * esh, enum esh_xmodem_event ev,
+        char const * data, size_t len, void * arg);
+static bool hist_read(size_t addr, char * buf, size_t len, void * arg);
+static bool hist_write(size_t addr, char const * buf, size_t len, void * arg);
+static bool hist_erase(size_t sector, void * arg);
+static void say(esh_t * esh, char const * fmt, ...);
+static void close_port(void);
+
+static esh_posix_t * port;
+static size_t load_count;
+static char load_term[ESH_BUFFER_LEN + 1];
+static char rx_work[ESH_XMODEM_WORK_LEN];
+static unsigned long command_count;
+static int hist_fd;
+
+#define HIST_SECTOR_LEN 1024
+
+// The history is kept in a file, laid out like a small flash chip.
+static struct esh_hist_store const hist_store = {
+    .read = hist_read,
+    .write = hist_write,
+    .erase = hist_erase,
+    .arg = &hist_fd,
+    .sector_len = HIST_SECTOR_LEN,
+    .sectors = 4,
+};
+
+int esh_command_cb(esh_t * esh, int argc, char ** argv, void * arg)
+{
+    (void) esh;
+    (void) arg;
+
+    // The status bar only goes out on the next tick, however often this
+    // changes.
+    char bar[ESH_STATUSBAR_COLS + 1];
+    snprintf(bar, sizeof bar, "esh demo | commands run: %lu", ++command_count);
+    esh_statusbar_set(esh, 0, bar);
+
+    if (argc && (!strcmp(argv[0], "exit") || !strcmp(argv[0], "quit"))) {
+        esh_statusbar_setup(esh, 0);
+        exit(0);
+    }
+
+    if (argc == 2 && !strcmp(argv[0], "bar")) {
+        // Terminal height; 0 removes the bar
+        esh_statusbar_setup(esh, strtoul(argv[1], NULL, 10));
+        return 0;
+    }
+
+    if (argc == 2 && !strcmp(argv[0], "load")) {
+        say(esh, "Send data, then '%s' on a line by itself.\n", argv[1]);
+        load_count = 0;
+        strcpy(load_term, argv[1]);
+        esh_data_until(esh, load_term, load_cb, NULL);
+        return 0;
+    }
+
+    if (argc == 1 && !strcmp(argv[0], "rx")) {
+        say(esh, "Start XMODEM or YMODEM send now.\n");
+        load_count = 0;
+        esh_xmodem_receive(esh, rx_work, rx_cb, NULL);
+        return 0;
+    }
+
+    if (argc == 1 && !strcmp(argv[0], "true")) {
+        return 0;
+    }
+
+    if (argc == 1 && !strcmp(argv[0], "false")) {
+        return 1;
+    }
+
+    if (argc == 1 && !strcmp(argv[0], "status")) {
+        say(esh, "%d\n", esh_last_status(esh));
+        return 0;
+    }
+
+    // Print through esh, so the output can be piped to filters.
+    char line[ESH_BUFFER_LEN + 16];
+
+    snprintf(line, sizeof line, "argc     = %d\n", argc);
+    esh_print(esh, line);
+
+    for (int i = 0; i < argc; ++i) {
+        snprintf(line, sizeof line, "argv[% 2d] = %s\n", i, argv[i]);
+        esh_print(esh, line);
+    }
+    return 0;
+}
 
-void esh_print_cb(esh_t * esh, char c, void * arg);
-void esh_command_cb(esh_t * esh, int argc, char ** argv, void * arg);
-static void set_terminal_raw(void);
-static void restore_terminal(void);
 
-static struct termios saved_term;
+/**
+ * Print through esh, printf style.
+ */
+static void say(esh_t * esh, char const * fmt, ...)
+{
+    char line[ESH_BUFFER_LEN + 64];
+    va_list ap;
+
+    va_start(ap, fmt);
+    vsnprintf(line, sizeof line, fmt, ap);
+    va_end(ap);
+    esh_print(esh, line);
+}
+
 
-void esh_print_cb(esh_t * esh, char c, void * arg)
+static void load_cb(esh_t * esh, char const * data, size_t len, void * arg)
 {
     (void) esh;
     (void) arg;
-    if (c == '\n') {
-        fputc('\r', stdout);
+
+    if (data) {
+        load_count += len;
+    } else {
+        say(esh, "received %zu bytes\n", load_count);
     }
-    fputc(c, stdout);
 }
 
 
-void esh_command_cb(esh_t * esh, int argc, char ** argv, void * arg)
+static bool rx_cb(esh_t * esh, enum esh_xmodem_event ev,
+        char const * data, size_t len, void * arg)
 {
     (void) esh;
+    (void) data;
     (void) arg;
 
-    if (argc && (!strcmp(argv[0], "exit") || !strcmp(argv[0], "quit"))) {
-        exit(0);
+    if (ev == ESH_XMODEM_DATA) {
+        load_count += len;
+    } else if (ev == ESH_XMODEM_DONE) {
+        say(esh, "\nreceived %zu bytes\n", load_count);
+    } else if (ev == ESH_XMODEM_FAILED) {
+        say(esh, "\ntransfer failed\n");
     }
+    return true;
+}
 
-    printf("argc     = %d\r\n", argc);
 
-    for (int i = 0; i < argc; ++i) {
-        printf("argv[% 2d] = %s\r\n", i, argv[i]);
+static bool hist_read(size_t addr, char * buf, size_t len, void * arg)
+{
+    int fd = *(int *) arg;
+    ssize_t n = 0;
+
+    if (lseek(fd, (off_t) addr, SEEK_SET) < 0 || (n = read(fd, buf, len)) < 0) {
+        return false;
     }
+    // Past the end of the file reads as erased.
+    memset(buf + n, 0xff, len - (size_t) n);
+    return true;
+}
+
+
+static bool hist_write(size_t addr, char const * buf, size_t len, void * arg)
+{
+    int fd = *(int *) arg;
+
+    return lseek(fd, (off_t) addr, SEEK_SET) >= 0
+        && write(fd, buf, len) == (ssize_t) len;
+}
+
+
+static bool hist_erase(size_t sector, void * arg)
+{
+    char erased[HIST_SECTOR_LEN];
+
+    memset(erased, 0xff, sizeof erased);
+    return hist_write(sector * sizeof erased, erased, sizeof erased, arg);
+}
+
+
+// Trace and recording timestamps: microseconds of wall time. Processor time
+// would stand still while the demo waits for a key.
+uint32_t demo_clock(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t) ts.tv_sec * 1000000u + (uint32_t) (ts.tv_nsec / 1000);
 }
 
 
@@ -47,33 +200,33 @@ int main(int argc, char ** argv)
 
     esh_t *esh = esh_init();
     esh_register_command(esh, esh_command_cb);
-    esh_register_print(esh, esh_print_cb);
 
-    if (!isatty(STDIN_FILENO)) {
-        fprintf(stderr, "%s\n", "esh demo must run on a tty");
-        exit(1);
+    hist_fd = open(".esh_history", O_RDWR | O_CREAT, 0600);
+    if (hist_fd >= 0) {
+        esh_hist_load(esh, &hist_store);
     }
 
-    if (tcgetattr(STDIN_FILENO, &saved_term) < 0) {
-        perror("tcgetattr");
+    port = esh_posix_open(esh, STDIN_FILENO, STDOUT_FILENO);
+    if (!port) {
+        perror("esh_posix_open");
         exit(1);
     }
 
-    if (atexit(&restore_terminal)) {
+    if (atexit(&close_port)) {
         perror("atexit");
         exit(1);
     }
-    set_terminal_raw();
 
-    printf("%s\r\n", "Use 'quit' or 'exit' to quit.");
+    esh_print(esh, "Use 'quit' or 'exit' to quit.\n");
     esh_rx(esh, '\n');
     for (;;) {
-        int c = getchar();
-        if (c > 0 && c <= 255) {
-            if (c == '\r') {
-                c = '\n';
-            }
-            esh_rx(esh, c);
+        int const n = esh_posix_poll(port, 800);
+        if (n < 0) {
+            break;
+        } else if (n == 0) {
+            esh_xmodem_tick(esh);
+            esh_watch_tick(esh);
+            esh_statusbar_tick(esh);
         }
     }
 
@@ -81,24 +234,7 @@ int main(int argc, char ** argv)
 }
 
 
-void set_terminal_raw(void)
-{
-    struct termios term = saved_term;
-
-    term.c_iflag &= ~(BRKINT | ICRNL | INPCK | ISTRIP | IXON);
-    term.c_oflag &= ~(OPOST);
-    term.c_cflag |= CS8;
-    term.c_lflag &= ~(ECHO | ICANON | IEXTEN | ISIG);
-    term.c_cc[VMIN] = 0;    term.c_cc[VTIME] = 8;
-
-    if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &term) < 0) {
-        perror("tcsetattr");
-        exit(1);
-    }
-}
-
-
-void restore_terminal(void)
+void close_port(void)
 {
-    tcsetattr(STDIN_FILENO, TCSAFLUSH, &saved_term);
+    esh_posix_close(port);
 }
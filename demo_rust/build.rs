@@ -6,6 +6,22 @@ fn main()
         .file("../esh.c")
         .file("../esh_hist.c")
         .file("../esh_argparser.c")
+        .file("../esh_viewport.c")
+        .file("../esh_data.c")
+        .file("../esh_xmodem.c")
+        .file("../esh_crc.c")
+        .file("../esh_rpc.c")
+        .file("../esh_mux.c")
+        .file("../esh_pipe.c")
+        .file("../esh_vars.c")
+        .file("../esh_macro.c")
+        .file("../esh_watch.c")
+        .file("../esh_statusbar.c")
+        .file("../esh_stats.c")
+        .file("../esh_trace.c")
+        .file("../esh_record.c")
+        .file("../esh_posix.c")
+        .file("../esh_server.c")
         .include("..")
         .flag("-iquotesrc")
         .flag("-Wall").flag("-Wextra").flag("-Werror")
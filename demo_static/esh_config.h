@@ -7,3 +7,4 @@
 
 #define ESH_ALLOC STATIC
 #define ESH_STATIC_CALLBACKS
+#define ESH_COMPACT
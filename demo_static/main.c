@@ -23,7 +23,7 @@ void ESH_PRINT_CALLBACK(esh_t * esh, char c, void * arg)
 }
 
 
-void ESH_COMMAND_CALLBACK(esh_t * esh, int argc, char ** argv, void * arg)
+int ESH_COMMAND_CALLBACK(esh_t * esh, int argc, char ** argv, void * arg)
 {
     (void) esh;
     (void) arg;
@@ -37,6 +37,7 @@ void ESH_COMMAND_CALLBACK(esh_t * esh, int argc, char ** argv, void * arg)
     for (int i = 0; i < argc; ++i) {
         printf("argv[% 2d] = %s\r\n", i, argv[i]);
     }
+    return 0;
 }
 
 
@@ -32,26 +32,42 @@ enum esh_flags {
     IN_NUMERIC_ESCAPE = 0x04,
 };
 
+#ifdef ESH_SIZE_LIMIT
+/**
+ * Refuse to build if esh_t is larger than ESH_SIZE_LIMIT. A static assertion
+ * can't say by how much, so this declares an array twice instead: when the
+ * sizes differ, the compiler reports "conflicting types" and shows
+ * sizeof(esh_t) as the length of the first declaration.
+ */
+extern char esh_t_size[sizeof(esh_t) <= ESH_SIZE_LIMIT ? 1 : sizeof(esh_t)];
+extern char esh_t_size[1];
+#endif
+
 static esh_t * allocate_esh(void);
 static void free_last_allocated(esh_t * esh);
 static void do_print_callback(esh_t * esh, char c);
-static void do_command(esh_t * esh, int argc, char ** argv);
+static int do_command(esh_t * esh, int argc, char ** argv);
+static int run_command(esh_t * esh, int argc, char ** argv);
 static void do_overflow_callback(esh_t * esh, char const * buffer);
 static bool command_is_nop(esh_t * esh);
 static void execute_command(esh_t * esh);
+static void run_line(esh_t * esh);
+static bool exec_line(esh_t * esh, char const * line, size_t len,
+        unsigned flags);
 static void handle_char(esh_t * esh, char c);
 static void handle_esc(esh_t * esh, char esc);
 static void handle_ctrl(esh_t * esh, char c);
 static void ins_del(esh_t * esh, char c);
-static void term_cursor_move(esh_t * esh, int n);
+static void term_follow(esh_t * esh, int n);
 static void cursor_move(esh_t * esh, int n);
 static void word_move(esh_t * esh, int dir);
+static size_t rx_divert(esh_t * esh, char const * buf, size_t len);
 
 void esh_default_overflow(esh_t * esh, char const * buffer, void * arg);
 
 #ifdef ESH_STATIC_CALLBACKS
 extern void ESH_PRINT_CALLBACK(esh_t * esh, char c, void * arg);
-extern void ESH_COMMAND_CALLBACK(
+extern int ESH_COMMAND_CALLBACK(
     esh_t * esh, int argc, char ** argv, void * arg);
 __attribute__((weak))
 void ESH_OVERFLOW_CALLBACK(esh_t * esh, char const * buffer, void * arg)
@@ -59,6 +75,12 @@ void ESH_OVERFLOW_CALLBACK(esh_t * esh, char const * buffer, void * arg)
     (void) arg;
     esh_default_overflow(esh, buffer, arg);
 }
+#elif defined(ESH_COMPACT)
+void esh_register_ops(esh_t * esh, struct esh_ops const * ops)
+{
+    (void) esh;
+    ESH_INSTANCE->ops = ops;
+}
 #else
 void esh_register_command(esh_t * esh, esh_cb_command callback)
 {
@@ -105,36 +127,93 @@ void esh_set_overflow_arg(esh_t * esh, void * arg)
 static void do_print_callback(esh_t * esh, char c)
 {
     (void) esh;
+    ESH_STAT_INC(ESH_INSTANCE, tx);
 #ifdef ESH_STATIC_CALLBACKS
     ESH_PRINT_CALLBACK(ESH_INSTANCE, c, ESH_INSTANCE->cb_print_arg);
+#elif defined(ESH_COMPACT)
+    ESH_INSTANCE->ops->print(ESH_INSTANCE, c, ESH_INSTANCE->cb_print_arg);
 #else
     ESH_INSTANCE->print(ESH_INSTANCE, c, ESH_INSTANCE->cb_print_arg);
 #endif
 }
 
 
-static void do_command(esh_t * esh, int argc, char ** argv)
+static int do_command(esh_t * esh, int argc, char ** argv)
+{
+    (void) esh;
+    struct esh_trace_mark const mark
+        = esh_trace_command_begin(ESH_INSTANCE, argv[0]);
+    int const status = run_command(ESH_INSTANCE, argc, argv);
+    esh_trace_command_end(ESH_INSTANCE, &mark);
+    return status;
+}
+
+
+/**
+ * Run a command, built-in or from the command callback, without tracing it.
+ */
+static int run_command(esh_t * esh, int argc, char ** argv)
 {
     (void) esh;
+    int * const status = &ESH_INSTANCE->status;
+
+    ESH_STAT_INC(ESH_INSTANCE, commands);
+    if (esh_stats_command(ESH_INSTANCE, argc, argv, status)
+            || esh_trace_command(ESH_INSTANCE, argc, argv, status)
+            || esh_record_command(ESH_INSTANCE, argc, argv, status)
+            || esh_vars_command(ESH_INSTANCE, argc, argv, status)
+            || esh_watch_command(ESH_INSTANCE, argc, argv, status)
+            || esh_macro_run(ESH_INSTANCE, argc, argv)) {
+        return ESH_INSTANCE->status;
+    }
 #ifdef ESH_STATIC_CALLBACKS
-    ESH_COMMAND_CALLBACK(ESH_INSTANCE, argc, argv, ESH_INSTANCE->cb_command_arg);
+    ESH_INSTANCE->status = ESH_COMMAND_CALLBACK(
+            ESH_INSTANCE, argc, argv, ESH_INSTANCE->cb_command_arg);
+#elif defined(ESH_COMPACT)
+    ESH_INSTANCE->status = ESH_INSTANCE->ops->command(
+            ESH_INSTANCE, argc, argv, ESH_INSTANCE->cb_command_arg);
 #else
-    ESH_INSTANCE->cb_command(ESH_INSTANCE, argc, argv, ESH_INSTANCE->cb_command_arg);
+    ESH_INSTANCE->status = ESH_INSTANCE->cb_command(
+            ESH_INSTANCE, argc, argv, ESH_INSTANCE->cb_command_arg);
 #endif
+    return ESH_INSTANCE->status;
 }
 
 
 static void do_overflow_callback(esh_t * esh, char const * buffer)
 {
     (void) esh;
+    ESH_STAT_INC(ESH_INSTANCE, overflows);
 #ifdef ESH_STATIC_CALLBACKS
     ESH_OVERFLOW_CALLBACK(ESH_INSTANCE, buffer, ESH_INSTANCE->cb_overflow_arg);
+#elif defined(ESH_COMPACT)
+    esh_cb_overflow const overflow = ESH_INSTANCE->ops->overflow;
+    (overflow ? overflow : &esh_default_overflow)(
+            ESH_INSTANCE, buffer, ESH_INSTANCE->cb_overflow_arg);
 #else
     ESH_INSTANCE->overflow(ESH_INSTANCE, buffer, ESH_INSTANCE->cb_overflow_arg);
 #endif
 }
 
 
+void esh_do_print_callback(esh_t * esh, char c)
+{
+    do_print_callback(esh, c);
+}
+
+
+int esh_do_callback(esh_t * esh, int argc, char ** argv)
+{
+    return do_command(esh, argc, argv);
+}
+
+
+void esh_do_overflow_callback(esh_t * esh, char const * buffer)
+{
+    do_overflow_callback(esh, buffer);
+}
+
+
 /**
  * For the static allocator, this is global so free_last_allocated() can
  * decrement it.
@@ -185,10 +264,14 @@ esh_t * esh_init(void)
 {
     esh_t * esh = allocate_esh();
 
+    if (!esh) {
+        return NULL;
+    }
     memset(esh, 0, sizeof(*esh));
-#ifndef ESH_STATIC_CALLBACKS
+#if !defined(ESH_STATIC_CALLBACKS) && !defined(ESH_COMPACT)
     esh->overflow = &esh_default_overflow;
 #endif
+    esh_viewport_init(ESH_INSTANCE);
 
     if (esh_hist_init(ESH_INSTANCE)) {
         free_last_allocated(ESH_INSTANCE);
@@ -199,11 +282,31 @@ esh_t * esh_init(void)
 }
 
 
+void esh_free(esh_t * esh)
+{
+    (void) esh;
+    esh_hist_free(ESH_INSTANCE);
+    free_last_allocated(ESH_INSTANCE);
+}
+
+
 // API WARNING: This function is separately declared in lib.rs
 void esh_rx(esh_t * esh, char c)
 {
     (void) esh;
-    if (ESH_INSTANCE->flags & (IN_BRACKET_ESCAPE | IN_NUMERIC_ESCAPE)) {
+    ESH_STAT_INC(ESH_INSTANCE, rx);
+    esh_record_rx(ESH_INSTANCE, &c, 1);
+    if (rx_divert(ESH_INSTANCE, &c, 1)) {
+        return;
+    }
+
+    ESH_TRACE_BEGIN(ESH_INSTANCE, ESH_TRACE_INPUT, c);
+    if (esh_watch_active(ESH_INSTANCE)) {
+        // Only ^C means anything while watching.
+        if (c == 3) {
+            handle_ctrl(ESH_INSTANCE, c);
+        }
+    } else if (ESH_INSTANCE->flags & (IN_BRACKET_ESCAPE | IN_NUMERIC_ESCAPE)) {
         handle_esc(ESH_INSTANCE, c);
     } else if (ESH_INSTANCE->flags & IN_ESCAPE) {
         if (c == '[' || c == 'O') {
@@ -221,6 +324,57 @@ void esh_rx(esh_t * esh, char c)
             handle_ctrl(ESH_INSTANCE, c);
         }
     }
+    ESH_TRACE_END(ESH_INSTANCE, ESH_TRACE_INPUT, c);
+}
+
+
+// API WARNING: This function is separately declared in lib.rs
+void esh_rx_buf(esh_t * esh, char const * buf, size_t len)
+{
+    (void) esh;
+
+    while (len) {
+        // Data mode can begin or end anywhere in the buffer, so check again
+        // after every piece.
+        size_t n = rx_divert(ESH_INSTANCE, buf, len);
+
+        if (!n) {
+            esh_rx(ESH_INSTANCE, *buf);
+            n = 1;
+        } else {
+            ESH_STAT_ADD(ESH_INSTANCE, rx, n);
+            esh_record_rx(ESH_INSTANCE, buf, n);
+        }
+
+        buf += n;
+        len -= n;
+    }
+}
+
+
+bool esh_rx_binary(esh_t * esh)
+{
+    (void) esh;
+    return esh_data_binary(ESH_INSTANCE) || esh_xmodem_active(ESH_INSTANCE)
+        || esh_rpc_binary(ESH_INSTANCE);
+}
+
+
+/**
+ * If input is currently diverted away from the line editor (data mode or a
+ * file transfer), hand it over.
+ * @return number of bytes consumed, or 0 if input is not diverted
+ */
+static size_t rx_divert(esh_t * esh, char const * buf, size_t len)
+{
+    (void) esh;
+    if (esh_data_active(ESH_INSTANCE)) {
+        return esh_data_rx(ESH_INSTANCE, buf, len);
+    } else if (esh_xmodem_active(ESH_INSTANCE)) {
+        return esh_xmodem_rx(ESH_INSTANCE, buf, len);
+    } else {
+        return esh_rpc_rx(ESH_INSTANCE, buf, len);
+    }
 }
 
 
@@ -258,12 +412,15 @@ static void handle_ctrl(esh_t * esh, char c)
     (void) esh;
     switch (c) {
         case 27: // escape
+            ESH_STAT_INC(ESH_INSTANCE, escapes);
             ESH_INSTANCE->flags |= IN_ESCAPE;
             break;
         case 3:  // ^C
+            esh_watch_stop(ESH_INSTANCE);
             esh_puts_flash(ESH_INSTANCE, FSTR("^C\n"));
             esh_print_prompt(ESH_INSTANCE);
             ESH_INSTANCE->cnt = ESH_INSTANCE->ins = 0;
+            esh_viewport_adjust(ESH_INSTANCE);
             break;
         case '\n':
             execute_command(ESH_INSTANCE);
@@ -290,6 +447,8 @@ static void handle_esc(esh_t * esh, char esc)
     (void) esh;
     int cdelta;
 
+    esh_viewport_esc(ESH_INSTANCE, esc);
+
     if (esc >= '0' && esc <= '9') {
         ESH_INSTANCE->flags
             |= IN_ESCAPE | IN_BRACKET_ESCAPE | IN_NUMERIC_ESCAPE;
@@ -312,6 +471,9 @@ static void handle_esc(esh_t * esh, char esc)
     case ESCCHAR_UP:
     case ESCCHAR_DOWN:
         if (esc == ESCCHAR_UP) {
+            if (!ESH_INSTANCE->hist.idx) {
+                esh_hist_mark(ESH_INSTANCE);
+            }
             ++ESH_INSTANCE->hist.idx;
         } else if (ESH_INSTANCE->hist.idx) {
             --ESH_INSTANCE->hist.idx;
@@ -389,6 +551,7 @@ static void execute_command(esh_t * esh)
     if (ESH_INSTANCE->cnt >= ESH_BUFFER_LEN) {
         do_overflow_callback(ESH_INSTANCE, ESH_INSTANCE->buffer);
         ESH_INSTANCE->cnt = ESH_INSTANCE->ins = 0;
+        esh_viewport_adjust(ESH_INSTANCE);
         esh_print_prompt(ESH_INSTANCE);
         return;
     } else {
@@ -400,17 +563,191 @@ static void execute_command(esh_t * esh)
     if (!command_is_nop(ESH_INSTANCE)) {
         esh_hist_add(ESH_INSTANCE, ESH_INSTANCE->buffer);
 
-        int argc = esh_parse_args(ESH_INSTANCE);
+        if (!esh_macro_define(ESH_INSTANCE)) {
+            run_line(ESH_INSTANCE);
+        }
+    }
+
+    ESH_INSTANCE->cnt = ESH_INSTANCE->ins = 0;
+    esh_viewport_adjust(ESH_INSTANCE);
+
+    // If the command switched to data mode, started a transfer or is being
+    // watched, the prompt waits until it ends.
+    if (!esh_console_held(ESH_INSTANCE)) {
+        esh_print_prompt(ESH_INSTANCE);
+    }
+}
+
+
+/**
+ * Parse and run the commands in the buffer, one at a time.
+ */
+static void run_line(esh_t * esh)
+{
+    (void) esh;
+    struct esh_parse_pos pos = {0, 0};
+    enum esh_chain op = ESH_CHAIN_SEQ;
+    enum esh_chain prev;
+    bool ran = true;
+    ESH_ARGV(argv);
+
+    // Commands are parsed one at a time as they are reached, since
+    // parsing reuses argv.
+    do {
+        prev = op;
+        size_t const start = pos.i;
+        int argc = esh_parse_args(ESH_INSTANCE, &pos, &op, argv);
 
         if (argc > ESH_ARGC_MAX) {
-            do_overflow_callback(ESH_INSTANCE, ESH_INSTANCE->buffer);
-        } else if (argc > 0) {
-            do_command(ESH_INSTANCE, argc, ESH_INSTANCE->argv);
+            do_overflow_callback(ESH_INSTANCE, &ESH_INSTANCE->buffer[start]);
+            ESH_INSTANCE->status = ESH_STATUS_OVERFLOW;
+            break;
+        } else if (argc < 0) {
+            // The parser has already said what was wrong with the filters.
+            ESH_INSTANCE->status = ESH_STATUS_BAD_FILTER;
+            break;
+        } else if (argc == 0) {
+            continue;
+        }
+
+        ran = esh_chain_continues(ESH_INSTANCE, prev, ran);
+        if (ran) {
+            esh_pipe_begin(ESH_INSTANCE);
+            do_command(ESH_INSTANCE, argc, argv);
+            esh_pipe_end(ESH_INSTANCE);
+        }
+        // A command that holds the console ends the line. Nothing is said
+        // about the rest, which would land in a binary stream.
+    } while (op != ESH_CHAIN_END && !esh_console_held(ESH_INSTANCE));
+}
+
+
+/**
+ * Run one line of a script. Tabs are taken as spaces.
+ * @return false if the line was blank or a comment, and nothing was run
+ */
+static bool exec_line(esh_t * esh, char const * line, size_t len,
+        unsigned flags)
+{
+    (void) esh;
+    size_t i;
+
+    for (i = 0; i < len && (line[i] == ' ' || line[i] == '\t'); ++i);
+    if (i == len || line[i] == '#') {
+        return false;
+    }
+
+    if (flags & ESH_EXEC_ECHO) {
+        esh_print_prompt(ESH_INSTANCE);
+        for (i = 0; i < len; ++i) {
+            esh_putc(ESH_INSTANCE, line[i]);
+        }
+        esh_putc(ESH_INSTANCE, '\n');
+    }
+
+    bool const overflow = len >= ESH_BUFFER_LEN;
+    if (overflow) {
+        len = ESH_BUFFER_LEN;
+    }
+    for (i = 0; i < len; ++i) {
+        ESH_INSTANCE->buffer[i] = (line[i] == '\t') ? ' ' : line[i];
+    }
+    ESH_INSTANCE->buffer[len] = 0;
+    ESH_INSTANCE->cnt = len;
+
+    if (overflow) {
+        do_overflow_callback(ESH_INSTANCE, ESH_INSTANCE->buffer);
+        ESH_INSTANCE->status = ESH_STATUS_OVERFLOW;
+        return true;
+    }
+
+    if (flags & ESH_EXEC_HISTORY) {
+        esh_hist_add(ESH_INSTANCE, ESH_INSTANCE->buffer);
+    }
+    if (!esh_macro_define(ESH_INSTANCE)) {
+        run_line(ESH_INSTANCE);
+    }
+    return true;
+}
+
+
+int esh_exec_buf(esh_t * esh, char const * script, size_t len,
+        unsigned flags)
+{
+    (void) esh;
+    unsigned long line = 0;
+    int status = 0;
+
+    while (len && !esh_console_held(ESH_INSTANCE)) {
+        size_t n, next;
+
+        for (n = 0; n < len && script[n] != '\n'; ++n);
+        next = (n < len) ? n + 1 : n;
+        if (n && script[n - 1] == '\r') {
+            --n;
+        }
+        ++line;
+
+        bool const ran = exec_line(ESH_INSTANCE, script, n, flags);
+        script += next;
+        len -= next;
+
+        if (!ran) {
+            continue;
+        }
+        status = ESH_INSTANCE->status;
+        if (status && (flags & ESH_EXEC_REPORT)) {
+            esh_puts_flash(ESH_INSTANCE, FSTR("esh: line "));
+            esh_putu(ESH_INSTANCE, line);
+            esh_puts_flash(ESH_INSTANCE, FSTR(": status "));
+            if (status < 0) {
+                esh_putc(ESH_INSTANCE, '-');
+                esh_putu(ESH_INSTANCE, 0ul - (unsigned long) status);
+            } else {
+                esh_putu(ESH_INSTANCE, (unsigned long) status);
+            }
+            esh_putc(ESH_INSTANCE, '\n');
+        }
+        if (status && (flags & ESH_EXEC_STOP)) {
+            break;
         }
     }
 
     ESH_INSTANCE->cnt = ESH_INSTANCE->ins = 0;
-    esh_print_prompt(ESH_INSTANCE);
+    esh_viewport_adjust(ESH_INSTANCE);
+    return status;
+}
+
+
+bool esh_chain_continues(esh_t * esh, enum esh_chain op, bool ran)
+{
+    (void) esh;
+    switch (op) {
+    case ESH_CHAIN_AND:
+        return ESH_INSTANCE->status == 0;
+    case ESH_CHAIN_NEXT:
+        return ran && ESH_INSTANCE->status == 0;
+    case ESH_CHAIN_OR:
+        return ESH_INSTANCE->status != 0;
+    default:
+        return true;
+    }
+}
+
+
+bool esh_console_held(esh_t * esh)
+{
+    (void) esh;
+    return esh_data_active(ESH_INSTANCE)
+        || esh_xmodem_active(ESH_INSTANCE)
+        || esh_watch_active(ESH_INSTANCE);
+}
+
+
+int esh_last_status(esh_t * esh)
+{
+    (void) esh;
+    return ESH_INSTANCE->status;
 }
 
 
@@ -438,7 +775,11 @@ bool esh_putc(esh_t * esh, char c)
 {
     (void) esh;
 
-    do_print_callback(ESH_INSTANCE, c);
+    if (!esh_watch_putc(ESH_INSTANCE, c)
+            && !esh_pipe_putc(ESH_INSTANCE, c)
+            && !esh_rpc_putc(ESH_INSTANCE, c)) {
+        do_print_callback(ESH_INSTANCE, c);
+    }
     return false;
 }
 
@@ -455,6 +796,22 @@ bool esh_puts(esh_t * esh, char const * s)
 }
 
 
+void esh_print(esh_t * esh, char const * s)
+{
+    esh_puts(esh, s);
+}
+
+
+void esh_write(esh_t * esh, char const * buf, size_t len)
+{
+    (void) esh;
+
+    while (len--) {
+        esh_putc(ESH_INSTANCE, *buf++);
+    }
+}
+
+
 #ifdef __AVR_ARCH__
 bool esh_puts_flash(esh_t * esh, char const __flash * s)
 {
@@ -472,13 +829,19 @@ bool esh_puts_flash(esh_t * esh, char const __flash * s)
 void esh_restore(esh_t * esh)
 {
     (void) esh;
+    ESH_STAT_INC(ESH_INSTANCE, redraws);
+    ESH_TRACE_BEGIN(ESH_INSTANCE, ESH_TRACE_REDRAW, 0);
 
     esh_puts_flash(ESH_INSTANCE, FSTR(ESC_ERASE_LINE "\r")); // Clear line
     esh_print_prompt(ESH_INSTANCE);
     ESH_INSTANCE->buffer[ESH_INSTANCE->cnt] = 0;
-    esh_puts(ESH_INSTANCE, ESH_INSTANCE->buffer);
-    term_cursor_move(ESH_INSTANCE,
-            -(int)(ESH_INSTANCE->cnt - ESH_INSTANCE->ins));
+
+    if (!esh_viewport_draw(ESH_INSTANCE)) {
+        esh_puts(ESH_INSTANCE, ESH_INSTANCE->buffer);
+        esh_term_cursor_move(ESH_INSTANCE,
+                -(int)(ESH_INSTANCE->cnt - ESH_INSTANCE->ins));
+    }
+    ESH_TRACE_END(ESH_INSTANCE, ESH_TRACE_REDRAW, 0);
 }
 
 
@@ -491,19 +854,51 @@ size_t esh_get_slice_size(void)
 #endif
 
 
-/**
- * Move only the terminal cursor. This does not move the insertion point.
- */
-static void term_cursor_move(esh_t * esh, int n)
+bool esh_putu(esh_t * esh, unsigned long n)
 {
     (void) esh;
+    char digits[3 * sizeof n];
+    size_t i = 0;
 
-    for ( ; n > 0; --n) {
-        esh_puts_flash(ESH_INSTANCE, FSTR(ESC_CURSOR_RIGHT));
+    do {
+        digits[i++] = '0' + n % 10;
+        n /= 10;
+    } while (n);
+
+    while (i) {
+        esh_putc(ESH_INSTANCE, digits[--i]);
     }
+    return false;
+}
 
-    for ( ; n < 0; ++n) {
-        esh_puts_flash(ESH_INSTANCE, FSTR(ESC_CURSOR_LEFT));
+
+void esh_term_cursor_move(esh_t * esh, int n)
+{
+    (void) esh;
+
+    // One counted sequence rather than n single steps; this keeps Home/End on
+    // a long line from costing four bytes per character.
+    if (n) {
+        esh_puts_flash(ESH_INSTANCE, FSTR(ESC_CSI));
+        esh_putu(ESH_INSTANCE, (n > 0) ? n : -n);
+        esh_putc(ESH_INSTANCE, (n > 0) ? ESCCHAR_RIGHT : ESCCHAR_LEFT);
+    }
+}
+
+
+/**
+ * Bring the terminal cursor to the insertion point after it has moved by n.
+ * This is a plain cursor movement unless the viewport had to scroll, in which
+ * case the line is redrawn.
+ */
+static void term_follow(esh_t * esh, int n)
+{
+    (void) esh;
+
+    if (esh_viewport_adjust(ESH_INSTANCE)) {
+        esh_restore(ESH_INSTANCE);
+    } else {
+        esh_term_cursor_move(ESH_INSTANCE, n);
     }
 }
 
@@ -523,8 +918,8 @@ static void cursor_move(esh_t * esh, int n)
         n = ESH_INSTANCE->cnt - ESH_INSTANCE->ins;
     }
 
-    term_cursor_move(ESH_INSTANCE, n);
     ESH_INSTANCE->ins += n;
+    term_follow(ESH_INSTANCE, n);
 }
 
 
@@ -553,8 +948,9 @@ static void word_move(esh_t * esh, int dir)
         for (; ins < cnt && ESH_INSTANCE->buffer[ins] == ' '; ++ins);
     }
 
-    term_cursor_move(ESH_INSTANCE, ins - ESH_INSTANCE->ins);
+    int const n = ins - ESH_INSTANCE->ins;
     ESH_INSTANCE->ins = ins;
+    term_follow(ESH_INSTANCE, n);
 }
 
 
@@ -581,7 +977,7 @@ static void ins_del(esh_t * esh, char c)
     ESH_INSTANCE->cnt += sgn;
     ESH_INSTANCE->ins += sgn;
 
-    if (move) {
+    if (move || esh_viewport_adjust(ESH_INSTANCE)) {
         esh_restore(ESH_INSTANCE);
     } else if (!c) {
         esh_puts_flash(ESH_INSTANCE, FSTR("\b \b"));
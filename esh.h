@@ -37,6 +37,23 @@
  * 2.1.     Line endings
  * 2.2.     Static callbacks
  * 2.3.     History (optional)
+ * 2.4.     Horizontal scrolling (optional)
+ * 2.5.     Data mode (optional)
+ * 2.6.     File transfer (optional)
+ * 2.7.     Binary RPC (optional)
+ * 2.8.     Multiplexed consoles (optional)
+ * 2.9.     Brace expansion (optional)
+ * 2.10.    Output filters (optional)
+ * 2.11.    Variables (optional)
+ * 2.12.    Macros (optional)
+ * 2.13.    Watch (optional)
+ * 2.14.    Status bar (optional)
+ * 2.15.    Compact layout (optional)
+ * 2.16.    Counters (optional)
+ * 2.17.    Tracing (optional)
+ * 2.18.    Session recording (optional)
+ * 2.19.    POSIX port (optional)
+ * 2.20.    Socket server (optional)
  * 3.   Compiling esh
  * 4.   Code documentation
  * 4.1.     Basic interface: initialization and input
@@ -128,7 +145,512 @@
  *
  * WARNING: static allocation is only valid when using a SINGLE esh instance.
  * Using multiple esh instances with static allocation is undefined and WILL
- * make demons fly out your nose.
+ * make demons fly out your nose, unless the history is shared (below).
+ *
+ * With many instances, the history can instead be shared by all of them:
+ *
+ *     #define ESH_HIST_SHARED
+ *
+ * There is then one ring of ESH_HIST_LEN, set up by the first instance (with
+ * MANUAL allocation, give every instance the same buffer), and commands typed
+ * in any session can be recalled in all of them. Each instance still browses
+ * on its own, and what it has selected stays put while others add commands.
+ * If instances run on more than one thread, also define ESH_HIST_LOCK() and
+ * ESH_HIST_UNLOCK() to take and release a lock; esh holds it only briefly,
+ * and never calls it recursively.
+ *
+ * To keep the history across resets, define:
+ *
+ *     #define ESH_HIST_PERSIST
+ *
+ * and pass a `struct esh_hist_store`, with callbacks to read, write and erase
+ * EEPROM, flash or a file, to `esh_hist_load()`. The store is kept as a log:
+ * each command is appended as a length byte and its characters, and when a
+ * sector fills up, the next is erased and the log carries on there,
+ * overwriting the oldest commands. Each command then costs one small write,
+ * each sector is erased only once per trip around the store, and restoring
+ * at boot reads the log through once, in order. A command cut short by a
+ * reset is skipped. Commands of 255 characters or more are not saved.
+ *
+ * 2.4. Horizontal scrolling (optional)
+ * ------------------------------------
+ *
+ * By default, esh draws the whole edit buffer on one line and lets the
+ * terminal wrap it. Once a line wraps, redraws no longer land in the right
+ * place, and every redraw costs the full length of the line. To have esh draw
+ * only a window of the line around the cursor instead, scrolling it
+ * horizontally with `<` and `>` markers at the edges, define:
+ *
+ *     #define ESH_VIEWPORT                 // Enable horizontal scrolling
+ *     #define ESH_TERM_WIDTH   80          // Terminal width until told
+ *                                          //   otherwise
+ *
+ * The width can be changed at runtime with `esh_set_width()`, or asked of the
+ * terminal itself with `esh_query_width()`.
+ *
+ * 2.5. Data mode (optional)
+ * -------------------------
+ *
+ * Commands that need to receive more than ESH_BUFFER_LEN bytes (calibration
+ * tables, firmware images and the like) can switch esh into data mode, in
+ * which received bytes go straight to a chunk callback with no echo, no line
+ * editing and no buffering. To enable it, define:
+ *
+ *     #define ESH_DATA_MODE
+ *
+ * Then, from a command handler, call either `esh_data_length()` to receive a
+ * fixed number of bytes or `esh_data_until()` to receive until a terminator
+ * line, like a shell heredoc. Data mode works with `esh_rx()`, but is much
+ * more efficient with `esh_rx_buf()`, as chunks are then passed through
+ * directly from your receive buffer.
+ *
+ * The data follows the command that asked for it, so any commands after that
+ * one on the same line are dropped, not run, and nothing is printed to say so,
+ * as it would land in the data. `setup; data 100; report` never runs
+ * `report`, and the status stays that of `data`. The same goes for a command
+ * that starts a file transfer or a watch.
+ *
+ * 2.6. File transfer (optional)
+ * -----------------------------
+ *
+ * esh can receive files over the console link with XMODEM (128-byte or 1K
+ * blocks, CRC-16) or YMODEM batch, as sent by `sx`, `sx -k` or `sb`. Define:
+ *
+ *     #define ESH_XMODEM
+ *
+ * Then, from a command handler, call `esh_xmodem_receive()`. Received blocks
+ * are passed to a sink callback, and the prompt returns when the transfer
+ * ends. While the transfer is waiting for the sender, it needs a clock: call
+ * `esh_xmodem_tick()` about once a second. As with data mode, the rest of the
+ * line after the command that starts a transfer is dropped.
+ *
+ * Binary transfers (this, data mode with `esh_data_length()`, and binary RPC
+ * in 2.7) must not have their input translated as described in 2.1, nor their
+ * output. Check `esh_rx_binary()` before translating.
+ *
+ * 2.7. Binary RPC (optional)
+ * --------------------------
+ *
+ * For automated hosts (test stations and the like), esh can accept commands
+ * as binary frames, dispatched to the same command callback as typed commands
+ * but with no echo, no prompt, no line editing and no tokenizing. Define:
+ *
+ *     #define ESH_RPC
+ *
+ * A frame starts with a NUL byte (which never occurs in typed input) and is
+ * COBS-encoded up to a terminating NUL. Decoded, a request is:
+ *
+ *     tag         1 byte, echoed in the response to match them up
+ *     index       1 byte: command name index (see esh_rpc_set_commands()),
+ *                   or 0xff if the name is given as the first argument
+ *     arguments   each NUL-terminated
+ *     CRC         CRC-16/XMODEM of all of the above, 2 bytes, big-endian
+ *
+ * Everything the command prints through esh_print() or esh_write() while it
+ * runs is captured into the response, which is framed the same way:
+ *
+ *     tag         1 byte
+ *     output      everything the command printed
+ *     status      1 byte, an esh_rpc_status
+ *     exit        1 byte, the value the command callback returned, truncated
+ *                   (zero if status is not ESH_RPC_OK)
+ *     CRC         2 bytes, as above
+ *
+ * Requests are decoded into the command buffer, so they are limited to
+ * ESH_BUFFER_LEN bytes and ESH_ARGC_MAX arguments. Anything typed but not yet
+ * entered when a request arrives is discarded.
+ *
+ * From the lead-in NUL until the response's closing NUL has been printed,
+ * `esh_rx_binary()` returns true: neither the request nor the response may
+ * have line endings translated. A port that takes CR NUL as one newline
+ * swallows a NUL straight after a CR, so a host that ends typed lines with a
+ * bare CR on such a port should start a frame with two NULs. The POSIX port
+ * only does so on telnet sessions, where the NUL is telnet's padding.
+ *
+ * A request that grows past ESH_BUFFER_LEN is read on to its closing NUL and
+ * thrown away, and answered with ESH_RPC_BAD_FRAME; none of it is ever taken
+ * as typed input. A stray NUL from a terminal (Ctrl-@) would leave everything
+ * typed after it being decoded as a request, so call `esh_rpc_tick()` about
+ * once a second: a request with no bytes for a whole tick is dropped, with no
+ * response, and a fresh prompt is printed.
+ *
+ * 2.8. Multiplexed consoles (optional)
+ * ------------------------------------
+ *
+ * Several esh instances can share one link, each on its own channel. Instead
+ * of calling esh_rx() directly, feed received bytes to a multiplexer, which
+ * passes them to the right instance and frames each instance's output with
+ * its channel number. This needs `ESH_ALLOC` to be `MALLOC`. Define:
+ *
+ *     #define ESH_MUX
+ *     #define ESH_MUX_CHANNELS 4           // Number of channels, up to 16
+ *     #define ESH_MUX_TX_LEN   64          // Output buffered per channel
+ *
+ * Set up with:
+ *
+ *     esh_mux_t * mux = esh_mux_init(&write_callback, NULL, true);
+ *     esh_mux_attach(mux, 0, esh_init());
+ *     esh_mux_attach(mux, 1, esh_init());
+ *
+ * and feed it with `esh_mux_rx()`. With static callbacks, your
+ * ESH_PRINT_CALLBACK must forward to `esh_mux_print()`; with ESH_COMPACT, the
+ * print entry of your ops table must be `esh_mux_print`.
+ *
+ * On the link, in both directions, a frame is:
+ *
+ *     DLE (0x10)  channel  length (1-255)  data...
+ *
+ * and a flow control frame, asking the other end to stop or resume sending on
+ * a channel, is:
+ *
+ *     DLE (0x10)  0x80 | channel  XOFF (0x13) or XON (0x11)
+ *
+ * Output for a channel the peer has stopped is held, up to ESH_MUX_TX_LEN
+ * bytes, and dropped beyond that.
+ *
+ * If channel 0 is set to plain text, bytes outside of frames belong to
+ * channel 0, and its output is sent unframed, so a bare terminal can still
+ * talk to it. A literal DLE (Ctrl-P) is then sent as DLE DLE.
+ *
+ * 2.9. Brace expansion (optional)
+ * -------------------------------
+ *
+ * To run one command over a range of values without typing it out each time,
+ * esh can expand brace expressions. Define:
+ *
+ *     #define ESH_BRACE_EXPANSION
+ *
+ * A command containing `{first..last}`, `{first..last..step}` or
+ * `{word,word,...}` then runs once per value, as if the copies were joined by
+ * `&&`:
+ *
+ *     gpio cfg {0..31} out        // gpio cfg 0 out && ... && gpio cfg 31 out
+ *     reg read {0x40..0x4f}       // hex ranges are zero-padded
+ *     led {red,green} {on,off}    // the last brace varies fastest
+ *
+ * An operator before the command decides for all of its expansions, so
+ * `check || gpio cfg {0..31} out` runs none of them if `check` succeeds.
+ *
+ * Unlike in sh, each expansion is a separate command, not a separate
+ * argument. Expansions are produced one at a time as they run, so a range of
+ * any size costs no more memory than one command, but this does take a
+ * second buffer of ESH_BUFFER_LEN bytes. A brace that doesn't form one of
+ * these expressions, or is quoted, is an ordinary character.
+ *
+ * 2.10. Output filters (optional)
+ * -------------------------------
+ *
+ * To cut down long output before it goes over a slow link, a command can be
+ * piped through built-in filters, which work on the device a line at a time.
+ * Define:
+ *
+ *     #define ESH_PIPE
+ *     #define ESH_PIPE_STAGES      4       // Most filters on one command
+ *     #define ESH_PIPE_LINE_LEN    80      // Longest line filtered whole
+ *     #define ESH_PIPE_TAIL_LEN    512     // Output kept back for tail
+ *
+ * The filters are:
+ *
+ *     grep [-v] TEXT      lines containing TEXT (or with -v, not containing)
+ *     head [N]            the first N lines (default 10)
+ *     tail [N]            the last N lines that fit in ESH_PIPE_TAIL_LEN
+ *     count               the number of lines
+ *     hex                 only the words of each line that are hex numbers
+ *
+ * for example `reg dump | grep CTRL | hex`. Only output printed through
+ * esh_print() or esh_write() is filtered, so commands that print some other
+ * way must be changed to use them. Lines longer than ESH_PIPE_LINE_LEN are
+ * filtered in pieces. Only one tail is allowed per command.
+ *
+ * With this enabled, an unquoted `|` that isn't part of `||` always starts a
+ * filter.
+ *
+ * 2.11. Variables (optional)
+ * --------------------------
+ *
+ * To save retyping addresses and the like, esh can keep variables. Define:
+ *
+ *     #define ESH_VARS
+ *     #define ESH_VARS_LEN     256         // Bytes for names and values
+ *     #define ESH_VARS_SLOTS   16          // Hash slots, a power of two;
+ *                                          //   one less variable than this
+ *                                          //   can be set
+ *
+ * esh then handles the `set NAME value` and `unset NAME` commands itself
+ * (`set` alone lists the variables), and before running each command,
+ * replaces `$NAME` or `${NAME}` with its value, or nothing if it isn't set,
+ * and `$?` with the last exit status. Nothing is expanded inside single
+ * quotes. A value is substituted before the command is split into words, so
+ * unquoted it can hold several words, but everything else in it is taken
+ * literally: `;`, `&&`, `|`, quotes and braces in a value never act as
+ * operators, quoting or brace expansion. esh quotes them as it substitutes,
+ * and that quoting counts toward ESH_BUFFER_LEN. If the expanded command
+ * doesn't fit, the overflow callback is called and the line stops.
+ *
+ * Variables can also be set from code with esh_set_var().
+ *
+ * 2.12. Macros (optional)
+ * -----------------------
+ *
+ * Sequences of commands that get typed over and over can be saved as macros.
+ * Define:
+ *
+ *     #define ESH_MACROS
+ *     #define ESH_MACRO_LEN    256         // Bytes for macros defined at
+ *                                          //   the prompt
+ *
+ * A line starting with `macro` then defines one, for example:
+ *
+ *     macro boot  gpio set 4 && delay 10 && gpio clear 4 ; status
+ *
+ * after which the command `boot` runs those commands, with `;`, `&&` and `||`
+ * working as on a line. `macro NAME` alone deletes a macro, and `macro` alone
+ * lists them. A macro is split into words, and has its variables and braces
+ * expanded, when it is defined, not when it runs, so running one costs no
+ * parsing; this also means it takes no arguments. Macros can't use output
+ * filters or run other macros.
+ *
+ * Macros can also be built in, kept in flash on AVR, by defining
+ * ESH_MACROS_BUILTIN with the ESH_MACRO() helpers:
+ *
+ *     #define ESH_MACROS_BUILTIN \
+ *         ESH_MACRO("boot", \
+ *             ESH_MACRO_SEQ ESH_MACRO_ARG("gpio") ESH_MACRO_ARG("set") \
+ *                 ESH_MACRO_ARG("4") \
+ *             ESH_MACRO_AND ESH_MACRO_ARG("status"))
+ *
+ * A macro defined at the prompt with the same name as a built-in one takes
+ * its place.
+ *
+ * 2.13. Watch (optional)
+ * ----------------------
+ *
+ * To keep an eye on a changing value without flooding the link, esh can rerun
+ * a command periodically and redraw only what changed. Define:
+ *
+ *     #define ESH_WATCH
+ *     #define ESH_WATCH_ROWS   20          // Rows of output shown
+ *     #define ESH_WATCH_COLS   79          // Columns of output shown
+ *
+ * and call `esh_watch_tick()` at a steady rate, for example ten times a
+ * second. `watch N command...` then clears the screen and runs the command
+ * every N ticks. Its output is kept in a screen buffer of ESH_WATCH_ROWS by
+ * ESH_WATCH_COLS characters (output past those edges isn't shown), and only
+ * the characters that differ from the last run are sent, with cursor
+ * addressing. ^C stops watching. Watching holds the console, so, as with data
+ * mode, anything after the `watch` command on the same line is dropped.
+ *
+ * ESH_WATCH_COLS should be less than the terminal width, so the terminal
+ * never wraps a line, and ESH_WATCH_ROWS less than its height. As with output
+ * filters, only output printed through esh_print() or esh_write() is seen.
+ * Control characters in the output, other than newlines and tabs, are
+ * dropped.
+ *
+ * 2.14. Status bar (optional)
+ * ---------------------------
+ *
+ * A few lines at the bottom of the terminal can be kept for live status, such
+ * as uptime or error counters, while the shell scrolls above them. Define:
+ *
+ *     #define ESH_STATUSBAR
+ *     #define ESH_STATUSBAR_LINES  1       // Lines in the bar
+ *     #define ESH_STATUSBAR_COLS   79      // Width of the bar
+ *     #define ESH_STATUSBAR_TICKS  5       // Least ticks between updates
+ *
+ * Call `esh_statusbar_setup()` with the terminal height to set a scrolling
+ * region above the bar, then `esh_statusbar_set()` whenever a line should
+ * change, as often as you like, and `esh_statusbar_tick()` at a steady rate.
+ * Changes are sent on a tick, at most once every ESH_STATUSBAR_TICKS ticks,
+ * and only the characters that changed are sent, between cursor save and
+ * restore sequences, so the line being typed is never disturbed. Updates
+ * wait while binary data is being received.
+ *
+ * Anything that clears the whole screen, such as watch, clears the bar too;
+ * call `esh_statusbar_redraw()` afterwards. ESH_WATCH_ROWS should leave room
+ * for the bar.
+ *
+ * 2.15. Compact layout (optional)
+ * -------------------------------
+ *
+ * When RAM is tight, or there are a great many instances, esh_t can be made
+ * smaller by defining:
+ *
+ *     #define ESH_COMPACT
+ *
+ * Positions in the line buffer and the history ring are then stored in the
+ * smallest type that will hold them. Single bytes are used when
+ * ESH_BUFFER_LEN is under 255 (one count is kept for an overflowed line) and
+ * ESH_HIST_LEN is under 256. The argv array for a command is built on the
+ * stack while it runs rather than kept in every instance, so allow for
+ * ESH_ARGC_MAX pointers of stack. Unless you're using static callbacks, they
+ * are registered as one shared table with `esh_register_ops()`, in place of
+ * the esh_register_* functions:
+ *
+ *     static const struct esh_ops ops = {
+ *         &command_callback, &print_callback, NULL };
+ *
+ *     esh_register_ops(esh, &ops);
+ *
+ * ESH_COMPACT is not available from Rust.
+ *
+ * To check the size of esh_t as configured, with or without ESH_COMPACT,
+ * define a limit in bytes:
+ *
+ *     #define ESH_SIZE_LIMIT   256
+ *
+ * If esh_t is larger, compiling esh.c fails with an error about conflicting
+ * types for `esh_t_size`, giving the actual size as its array length.
+ *
+ * 2.16. Counters (optional)
+ * -------------------------
+ *
+ * To find out what the console costs in the field, each instance can count
+ * bytes received and printed, full line redraws, escape sequences, history
+ * evictions, overflows and commands run. Define:
+ *
+ *     #define ESH_STATS
+ *
+ * Read them with `esh_stats()` and clear them with `esh_stats_reset()`, or
+ * from the console with the built-in commands `esh-stats` and
+ * `esh-stats reset`. Without ESH_STATS, none of the counting is compiled in.
+ *
+ * 2.17. Tracing (optional)
+ * ------------------------
+ *
+ * To find which commands hold up the rest of the system, esh can timestamp
+ * the start and end of each command, line redraw, history operation and input
+ * byte, keeping the latest in a ring, and keep a latency histogram for each
+ * command. Define:
+ *
+ *     #define ESH_TRACE
+ *     #define ESH_TRACE_LEN    128         // Events kept in the ring
+ *     #define ESH_TRACE_CMDS   8           // Commands with their own histogram
+ *     #define ESH_TRACE_CLOCK  read_cycles // uint32_t read_cycles(void)
+ *
+ * ESH_TRACE_CLOCK names a function giving the time from any counter that
+ * counts up and wraps at 2^32, such as a CPU cycle counter. Each event takes
+ * eight bytes, and each command slot about ninety. Commands past the first
+ * ESH_TRACE_CMDS - 1 share the last slot, shown as `*`, and command names are
+ * only compared up to eleven characters.
+ *
+ * From the console, `esh-trace` prints the count, minimum, median, 99th
+ * percentile and maximum run time of each command, in clock ticks. The
+ * percentiles come from power-of-two buckets and are rounded up to the top of
+ * theirs. `esh-trace dump` prints the ring, oldest first, one event per line:
+ *
+ *     <time> <B|E> <event>
+ *
+ * where the event is `command NAME`, `input BYTE`, `redraw`, `hist-add`,
+ * `hist-find` or `hist-print`, and `esh-trace reset` clears everything.
+ * `tools/trace_json` turns a captured dump into Chrome trace JSON, for
+ * chrome://tracing or Perfetto. The latency table can also be read from code
+ * with `esh_trace_latency()`.
+ *
+ * 2.18. Session recording (optional)
+ * ----------------------------------
+ *
+ * So that a report of what went wrong on a live console can be replayed
+ * exactly, esh can keep the latest bytes it received, with the time each one
+ * arrived. Define:
+ *
+ *     #define ESH_RECORD
+ *     #define ESH_RECORD_LEN   1024        // Bytes of recording kept
+ *     #define ESH_RECORD_CLOCK read_ticks  // uint32_t read_ticks(void)
+ *
+ * ESH_RECORD_CLOCK names a function giving the time from any counter that
+ * counts up and wraps at 2^32; it can be the same one as ESH_TRACE_CLOCK.
+ * Every byte given to `esh_rx()` or `esh_rx_buf()` is recorded, including
+ * data mode, file transfers and RPC, as the ticks since the byte before it,
+ * in seven-bit groups least significant first with the top bit set on all
+ * but the last, followed by the byte itself. Typing usually takes two or
+ * three bytes per key. The oldest records are dropped to make room.
+ *
+ * `esh-record` prints the recording, oldest first, as
+ *
+ *     esh-record <length in bytes>
+ *     <the records in hex, 32 bytes to a line>
+ *     esh-record end
+ *
+ * and `esh-record reset` clears it. The same can be done from code, for
+ * example from a watchdog handler once the console has stopped responding,
+ * with `esh_record_dump()` and `esh_record_reset()`. `bench/replay_CONFIG`
+ * replays a captured recording through `esh_rx()`, and can save it as a
+ * benchmark trace.
+ *
+ * 2.19. POSIX port (optional)
+ * ---------------------------
+ *
+ * On Linux and other POSIX hosts - gateways, simulators, the demo - esh can
+ * drive a terminal, serial device, PTY, pipe or socket itself. Define:
+ *
+ *     #define ESH_POSIX
+ *     #define ESH_POSIX_BUF_LEN 1024       // Bytes per read() and write()
+ *
+ * and open a port on an instance:
+ *
+ *     esh_posix_t * port = esh_posix_open(esh, STDIN_FILENO, STDOUT_FILENO);
+ *
+ *     while (esh_posix_poll(port, 100) >= 0) {
+ *         // Timers and ticks here
+ *     }
+ *     esh_posix_close(port);
+ *
+ * Terminals and serial devices are put in raw mode, and restored on close.
+ * Input is read a block at a time and passed to `esh_rx_buf()`, with CR
+ * given to esh as a newline and CR LF counting as one, except during binary
+ * transfers and RPC frames, which pass through as they are. Output is
+ * buffered, with newlines sent as CR LF outside of binary, and written out in
+ * one `write()` once the input has been handled, or when the buffer fills.
+ * When the process gets SIGWINCH, and it has no handler of its own for it,
+ * the new terminal width is passed to `esh_set_width()`.
+ *
+ * The port takes over the instance's print callback and print argument. With
+ * static callbacks, your ESH_PRINT_CALLBACK must forward to
+ * `esh_posix_print()`; with ESH_COMPACT, the print entry of your ops table
+ * must be `esh_posix_print`.
+ *
+ * 2.20. Socket server (optional)
+ * -------------------------------
+ *
+ * On Linux, one process can serve many shell sessions at once, one esh
+ * instance per connection, over a Unix socket or TCP on the loopback address.
+ * This needs ESH_POSIX, and `ESH_ALLOC` to be `MALLOC`. Define:
+ *
+ *     #define ESH_SERVER
+ *     #define ESH_SERVER_SESSIONS 4096     // More connections are turned away
+ *
+ * and run:
+ *
+ *     esh_server_t * server = esh_server_init(&session_callback, NULL);
+ *     esh_server_listen_unix(server, "/run/myapp/console");
+ *     esh_server_listen_tcp(server, 2323, true);
+ *
+ *     while (esh_server_run(server, 100) >= 0) {
+ *         // Timers and ticks here
+ *     }
+ *
+ * The session callback is called with `open` true for each new connection,
+ * before it is shown the prompt; register the command callback and anything
+ * else the instance needs there. The print callback is already set, as for
+ * a POSIX port. It is called again with `open` false when the session ends,
+ * just before the instance is freed. A command can end its own session with
+ * `esh_server_hangup()`.
+ *
+ * One epoll instance watches every socket. Each wakeup reads what each ready
+ * session has sent, a few blocks at most, passes it to esh, and writes out
+ * the replies in one go. A client that stops reading can hold up to
+ * ESH_POSIX_BUF_LEN bytes of output; past that, it is disconnected. Closed
+ * connections are noticed at the next wakeup, and their instances freed.
+ *
+ * A TCP listener can speak telnet: the client is asked for character mode,
+ * with the server echoing, and for its window size, which goes to
+ * `esh_set_width()`. Other options are refused, and telnet commands are taken
+ * out of the input. Binary transfers and RPC frames keep to telnet's rules:
+ * 0xff is sent as IAC IAC, a CR as CR NUL, and the NUL after a received CR is
+ * dropped. There is no authentication, which is why TCP only listens on
+ * 127.0.0.1; SSH port forwarding can reach it from elsewhere.
+ *
+ * The server ignores SIGPIPE, unless you have a handler for it.
  *
  * 3. Compiling esh
  * ================
@@ -190,6 +712,13 @@ struct esh;
  */
 esh_t * esh_init(void);
 
+/**
+ * Free an instance, and its history buffer if it has its own from malloc. With
+ * static allocation, esh_init() can then be called again. A history buffer
+ * given with esh_set_histbuf() is left to the caller.
+ */
+void esh_free(esh_t * esh);
+
 /**
  * Pass in a character that was received.
  */
@@ -197,6 +726,99 @@ void esh_rx(
         esh_t * esh,
         char    c);
 
+/**
+ * Pass in a block of characters that were received. This is equivalent to
+ * calling esh_rx() for each one, but lets data mode hand the bytes on
+ * without copying.
+ */
+void esh_rx_buf(
+        esh_t *         esh,
+        char const *    buf,
+        size_t          len);
+
+/**
+ * Print a string through esh. Command handlers should print this way rather
+ * than writing to the terminal directly, so that esh can redirect their output
+ * where needed (for example, into binary RPC responses).
+ */
+void esh_print(
+        esh_t *         esh,
+        char const *    s);
+
+/**
+ * Print a block of characters through esh. See esh_print().
+ */
+void esh_write(
+        esh_t *         esh,
+        char const *    buf,
+        size_t          len);
+
+/**
+ * Return whether esh is currently receiving binary data, during which input
+ * must be passed in exactly as received (no `\r` to `\n` translation), and
+ * output sent exactly as printed (no `\r` before `\n`). This covers data mode
+ * with a byte count, file transfers, and binary RPC requests and responses.
+ */
+bool esh_rx_binary(esh_t * esh);
+
+/**
+ * Exit status esh reports when a command had too many arguments to run.
+ */
+#define ESH_STATUS_OVERFLOW (-1)
+
+/**
+ * Exit status esh reports when a command was piped to an invalid filter.
+ */
+#define ESH_STATUS_BAD_FILTER (-2)
+
+/**
+ * Return the exit status of the last command run: the value the command
+ * callback returned, or one of the ESH_STATUS_ values above. Commands on one
+ * line can be joined with `;` (always run the next), `&&` (run the next only
+ * if this one returned zero) or `||` (run the next only if this one returned
+ * nonzero); a command that is skipped leaves the status alone, as in sh.
+ *
+ * A command that enters data mode, starts a file transfer or starts watching
+ * ends its line there: the commands after it are dropped without a word, and
+ * leave the status alone too.
+ */
+int esh_last_status(esh_t * esh);
+
+/**
+ * Flags for esh_exec_buf().
+ */
+#define ESH_EXEC_ECHO       0x01    ///< Print each line after the prompt
+#define ESH_EXEC_HISTORY    0x02    ///< Add each line to the history
+#define ESH_EXEC_STOP       0x04    ///< Stop at the first line that fails
+#define ESH_EXEC_REPORT     0x08    ///< Print the number and status of each
+                                    ///<   line that fails
+
+/**
+ * Run a script: lines of commands, as they would be typed at the prompt. The
+ * lines go straight to the parser, without passing through the line editor,
+ * so by default nothing is printed but the commands' own output. Lines may end
+ * in `\n` or `\r\n`, tabs count as spaces, and blank lines and lines whose
+ * first word starts with `#` are skipped. A line too long for ESH_BUFFER_LEN
+ * goes to the overflow callback, and counts as failing with
+ * ESH_STATUS_OVERFLOW.
+ *
+ * If a command enters data mode, starts a file transfer or starts watching,
+ * the script ends there and esh carries on as it would at the prompt. Any
+ * line being edited at the prompt is discarded. Don't call this from the
+ * command callback, as the line that called it is still in the buffer being
+ * run.
+ *
+ * @param script - the script; need not be NUL-terminated
+ * @param len - length of the script
+ * @param flags - any of the ESH_EXEC_ flags
+ * @return the status of the last line run, or zero if none was
+ */
+int esh_exec_buf(
+        esh_t *         esh,
+        char const *    script,
+        size_t          len,
+        unsigned        flags);
+
 
 
 #ifndef ESH_STATIC_CALLBACKS
@@ -204,7 +826,8 @@ void esh_rx(
  * -----------------------------------------------------------------------------
  * 4.2. Callback types and registration functions
  *
- * These only exist if ESH_STATIC_CALLBACKS is not defined.
+ * These only exist if ESH_STATIC_CALLBACKS is not defined. With ESH_COMPACT,
+ * the callbacks are registered together as a table instead of one by one.
  */
 
 /**
@@ -212,8 +835,10 @@ void esh_rx(
  * @param argc - number of arguments, including the command name
  * @param argv - arguments
  * @param arg - arbitrary argument passed to esh_set_command_arg()
+ * @return exit status: zero for success, positive for failure. Negative
+ *  values are reserved for esh.
  */
-typedef void (*esh_cb_command)(
+typedef int (*esh_cb_command)(
         esh_t * esh,
         int     argc,
         char ** argv,
@@ -241,6 +866,25 @@ typedef void (*esh_cb_overflow)(
         char const *    buffer,
         void *          arg);
 
+#ifdef ESH_COMPACT
+/**
+ * Callbacks for ESH_COMPACT. One table can be shared by any number of
+ * instances.
+ */
+struct esh_ops {
+    esh_cb_command  command;    ///< Execute a command
+    esh_cb_print    print;      ///< Print a character
+    esh_cb_overflow overflow;   ///< Notify about overflow, or NULL for esh's
+};
+
+/**
+ * Register the callbacks. The table is not copied, so it must outlive the
+ * instance; normally it's a static const.
+ */
+void esh_register_ops(
+        esh_t *                 esh,
+        struct esh_ops const *  ops);
+#else
 /**
  * Register a callback to execute a command.
  */
@@ -262,6 +906,7 @@ void esh_register_print(
 void esh_register_overflow(
         esh_t * esh,
         esh_cb_overflow overflow);
+#endif // ESH_COMPACT
 #endif
 
 /**
@@ -278,6 +923,622 @@ void esh_set_histbuf(
         esh_t * esh,
         char *  buffer);
 
+#if defined(ESH_HIST_ALLOC) && defined(ESH_HIST_PERSIST)
+/**
+ * Callback to read from the history store.
+ * @param addr - byte address in the store
+ * @param buf - where to put what was read
+ * @param len - number of bytes to read
+ * @param arg - the store's arg
+ * @return false on error
+ */
+typedef bool (*esh_hist_read)(
+        size_t          addr,
+        char *          buf,
+        size_t          len,
+        void *          arg);
+
+/**
+ * Callback to write to the history store. esh only ever writes to bytes that
+ * have been erased and not written since.
+ * @param addr - byte address in the store
+ * @param buf - bytes to write
+ * @param len - number of bytes in buf
+ * @param arg - the store's arg
+ * @return false on error
+ */
+typedef bool (*esh_hist_write)(
+        size_t          addr,
+        char const *    buf,
+        size_t          len,
+        void *          arg);
+
+/**
+ * Callback to erase a sector of the history store, setting every byte in it
+ * to 0xff.
+ * @param sector - sector number, from zero
+ * @param arg - the store's arg
+ * @return false on error
+ */
+typedef bool (*esh_hist_erase)(
+        size_t          sector,
+        void *          arg);
+
+/**
+ * Backing store for persistent history: EEPROM, flash, a file, or anything
+ * else that can be read and written by address. It is divided into sectors,
+ * which are erased one at a time.
+ */
+struct esh_hist_store {
+    esh_hist_read   read;
+    esh_hist_write  write;
+    esh_hist_erase  erase;
+    void *          arg;
+    size_t          sector_len;     ///< Bytes per sector
+    size_t          sectors;        ///< Number of sectors, at least two
+};
+
+/**
+ * Restore the history from a store, and save every command added from now
+ * on to it. Call this once, after esh_init() (and esh_set_histbuf(), if
+ * using MANUAL allocation). The store must remain valid.
+ * @return false if the store couldn't be read; the history then stays in RAM
+ *      only
+ */
+bool esh_hist_load(
+        esh_t *                         esh,
+        struct esh_hist_store const *   store);
+#endif // ESH_HIST_ALLOC && ESH_HIST_PERSIST
+
+/**
+ * Set the terminal width in columns, if ESH_VIEWPORT is defined. This takes
+ * effect on the next redraw. If ESH_VIEWPORT is not defined, this is a no-op.
+ */
+void esh_set_width(
+        esh_t * esh,
+        size_t  width);
+
+/**
+ * Ask the terminal for its width, if ESH_VIEWPORT is defined. This sends a
+ * cursor position report request (CSI 6n); the width is updated and the line
+ * redrawn when the reply arrives through esh_rx(). If ESH_VIEWPORT is not
+ * defined, this is a no-op.
+ */
+void esh_query_width(esh_t * esh);
+
+#ifdef ESH_DATA_MODE
+/**
+ * Callback to receive data in data mode.
+ * @param esh - the esh instance calling
+ * @param data - a chunk of received data, or NULL when the data has ended
+ * @param len - number of bytes in data, or 0 when the data has ended
+ * @param arg - arbitrary argument passed to esh_data_length() or
+ *      esh_data_until()
+ *
+ * The chunk may point directly into the buffer given to esh_rx_buf(), so it
+ * is only valid until the callback returns.
+ */
+typedef void (*esh_cb_data)(
+        esh_t *         esh,
+        char const *    data,
+        size_t          len,
+        void *          arg);
+
+/**
+ * Enter data mode to receive exactly `length` bytes. Call this from a command
+ * handler. Once all bytes have arrived, the callback is called one last time
+ * with a NULL chunk, and the prompt is printed.
+ */
+void esh_data_length(
+        esh_t *         esh,
+        size_t          length,
+        esh_cb_data     cb,
+        void *          arg);
+
+/**
+ * Enter data mode to receive until a line consisting only of `term` (which
+ * must not contain a newline). Call this from a command handler. The
+ * terminator line itself is not delivered; the newline before it is. Once it
+ * arrives, the callback is called one last time with a NULL chunk, and the
+ * prompt is printed.
+ *
+ * `term` is not copied and must remain valid until data mode ends; a string
+ * literal is ideal.
+ */
+void esh_data_until(
+        esh_t *         esh,
+        char const *    term,
+        esh_cb_data     cb,
+        void *          arg);
+
+/**
+ * Leave data mode early, for example on a timeout. The callback is called
+ * with a NULL chunk as usual. This must not be called from within the data
+ * callback itself.
+ */
+void esh_data_end(esh_t * esh);
+#endif // ESH_DATA_MODE
+
+#ifdef ESH_XMODEM
+/**
+ * Length of the work buffer needed by esh_xmodem_receive(): one full 1K
+ * packet including framing.
+ */
+#define ESH_XMODEM_WORK_LEN 1029
+
+/**
+ * Events passed to the file transfer sink.
+ */
+enum esh_xmodem_event {
+    ESH_XMODEM_FILE,        ///< YMODEM header: file name, NUL, size, ...
+    ESH_XMODEM_DATA,        ///< File data
+    ESH_XMODEM_DONE,        ///< Transfer completed (data is NULL)
+    ESH_XMODEM_FAILED,      ///< Transfer cancelled or failed (data is NULL)
+};
+
+/**
+ * Callback to receive a file.
+ * @param esh - the esh instance calling
+ * @param ev - what is being delivered
+ * @param data - block contents. When the whole packet arrived in a single
+ *      esh_rx_buf() call, this points directly into that buffer; otherwise
+ *      into the work buffer. Either way, it is only valid until the callback
+ *      returns.
+ * @param len - number of bytes in data. For YMODEM, padding after the end of
+ *      the file is already removed.
+ * @param arg - arbitrary argument passed to esh_xmodem_receive()
+ * @return true to continue, false to cancel the transfer (ignored for DONE and
+ *      FAILED)
+ */
+typedef bool (*esh_cb_xmodem)(
+        esh_t *                 esh,
+        enum esh_xmodem_event   ev,
+        char const *            data,
+        size_t                  len,
+        void *                  arg);
+
+/**
+ * Start receiving a file. Call this from a command handler.
+ * @param work - buffer of ESH_XMODEM_WORK_LEN bytes, used to assemble packets
+ *      that arrive in pieces. It must remain valid until the transfer ends.
+ */
+void esh_xmodem_receive(
+        esh_t *         esh,
+        char *          work,
+        esh_cb_xmodem   sink,
+        void *          arg);
+
+/**
+ * Drive transfer timeouts. Call this about once a second; it does nothing
+ * when no transfer is in progress.
+ */
+void esh_xmodem_tick(esh_t * esh);
+
+/**
+ * Cancel the transfer in progress, if any.
+ */
+void esh_xmodem_cancel(esh_t * esh);
+#endif // ESH_XMODEM
+
+#ifdef ESH_RPC
+/**
+ * Status byte of a binary RPC response.
+ */
+enum esh_rpc_status {
+    ESH_RPC_OK = 0,             ///< Command was dispatched
+    ESH_RPC_BAD_FRAME = 1,      ///< Bad CRC or malformed request
+    ESH_RPC_BAD_COMMAND = 2,    ///< Index out of range, or no command name
+    ESH_RPC_OVERFLOW = 3,       ///< Too many arguments
+};
+
+/**
+ * Set the table of command names that binary requests may refer to by index,
+ * so the name itself need not be sent. Typically this is the same table the
+ * command callback matches typed commands against. The table is not copied.
+ */
+void esh_rpc_set_commands(
+        esh_t *                 esh,
+        char const * const *    names,
+        size_t                  count);
+
+/**
+ * Drop a request that has stopped arriving. Call this about once a second;
+ * it does nothing when no request is being received.
+ */
+void esh_rpc_tick(esh_t * esh);
+#endif // ESH_RPC
+
+#ifdef ESH_MUX
+struct esh_mux;
+typedef struct esh_mux esh_mux_t;
+
+/**
+ * Callback to write bytes to the physical link.
+ * @param buf - bytes to write
+ * @param len - number of bytes in buf
+ * @param arg - arbitrary argument passed to esh_mux_init()
+ */
+typedef void (*esh_mux_write)(
+        char const *    buf,
+        size_t          len,
+        void *          arg);
+
+/**
+ * Create a multiplexer.
+ * @param write - callback to write to the link
+ * @param arg - argument for write
+ * @param plain0 - whether channel 0 is plain text rather than framed
+ * @return multiplexer, or NULL if malloc failed
+ */
+esh_mux_t * esh_mux_init(
+        esh_mux_write   write,
+        void *          arg,
+        bool            plain0);
+
+/**
+ * Attach an esh instance to a channel. This takes over the instance's print
+ * callback and print argument.
+ */
+void esh_mux_attach(
+        esh_mux_t *     mux,
+        unsigned        channel,
+        esh_t *         esh);
+
+/**
+ * Pass in a block of bytes received from the link. Output produced by the
+ * instances while handling it is written out at the end, in as few frames as
+ * possible.
+ */
+void esh_mux_rx(
+        esh_mux_t *     mux,
+        char const *    buf,
+        size_t          len);
+
+/**
+ * Write out all buffered output. Call this after printing through an instance
+ * from outside of esh_mux_rx(), for example from a timer.
+ */
+void esh_mux_flush(esh_mux_t * mux);
+
+/**
+ * Ask the peer to stop (or resume) sending on a channel.
+ */
+void esh_mux_throttle(
+        esh_mux_t *     mux,
+        unsigned        channel,
+        bool            stop);
+
+/**
+ * Return the number of output bytes dropped on a channel because the peer had
+ * stopped it and its buffer was full.
+ */
+size_t esh_mux_dropped(
+        esh_mux_t *     mux,
+        unsigned        channel);
+
+/**
+ * Print callback used by attached instances. Only call this yourself to
+ * forward to it from a static print callback.
+ */
+void esh_mux_print(
+        esh_t *         esh,
+        char            c,
+        void *          arg);
+#endif // ESH_MUX
+
+#ifdef ESH_VARS
+/**
+ * Set a variable, as with `set NAME value`.
+ * @param name - variable name: letters, digits and underscores, not starting
+ *      with a digit
+ * @param value - new value, or NULL to unset the variable
+ * @return false if the name is invalid or there isn't room; the variable is
+ *      then unchanged
+ */
+bool esh_set_var(
+        esh_t *         esh,
+        char const *    name,
+        char const *    value);
+
+/**
+ * Return the value of a variable, or NULL if it isn't set. The pointer is
+ * only valid until variables are next changed.
+ */
+char const * esh_get_var(
+        esh_t *         esh,
+        char const *    name);
+#endif // ESH_VARS
+
+#ifdef ESH_MACROS
+/**
+ * Helpers for ESH_MACROS_BUILTIN. A macro is its name and then its commands,
+ * each being ESH_MACRO_SEQ, ESH_MACRO_AND or ESH_MACRO_OR (how it is joined to
+ * the one before; the first is always run) followed by its arguments. This is
+ * the form macros defined at the prompt are stored in.
+ */
+#define ESH_MACRO(name, cmds)   name "\0" cmds "\370"
+#define ESH_MACRO_SEQ           "\371"
+#define ESH_MACRO_AND           "\372"
+#define ESH_MACRO_OR            "\373"
+#define ESH_MACRO_ARG(s)        s "\0"
+#endif // ESH_MACROS
+
+#ifdef ESH_WATCH
+/**
+ * Drive watch mode: rerun the watched command once enough ticks have passed.
+ * Call this at a steady rate; it does nothing when nothing is being watched.
+ */
+void esh_watch_tick(esh_t * esh);
+#endif // ESH_WATCH
+
+#ifdef ESH_STATUSBAR
+/**
+ * Set up the status bar, or remove it.
+ * @param rows - terminal height. The bar takes the bottom
+ *      ESH_STATUSBAR_LINES rows and the shell scrolls in the rest. Zero (or
+ *      too few rows to leave any) removes the bar and gives the whole screen
+ *      back to the shell.
+ */
+void esh_statusbar_setup(
+        esh_t *         esh,
+        size_t          rows);
+
+/**
+ * Set the text of a line of the status bar. It is shown on a later tick.
+ * @param line - line of the bar, from zero at the top
+ * @param text - new text; only the first ESH_STATUSBAR_COLS characters are
+ *      kept, and control characters are shown as spaces
+ */
+void esh_statusbar_set(
+        esh_t *         esh,
+        size_t          line,
+        char const *    text);
+
+/**
+ * Send changes to the status bar, if there are any and it is time. Call this
+ * at a steady rate.
+ */
+void esh_statusbar_tick(esh_t * esh);
+
+/**
+ * Redraw the whole status bar on the next update, after something has cleared
+ * the screen.
+ */
+void esh_statusbar_redraw(esh_t * esh);
+#endif // ESH_STATUSBAR
+
+#ifdef ESH_STATS
+/**
+ * Counters kept by each instance. They wrap around rather than saturate.
+ */
+struct esh_stats {
+    unsigned long rx;           ///< Bytes received
+    unsigned long tx;           ///< Bytes given to the print callback
+    unsigned long redraws;      ///< Times the whole line was redrawn
+    unsigned long escapes;      ///< Escape sequences received
+    unsigned long evictions;    ///< History entries overwritten by new ones
+    unsigned long overflows;    ///< Commands too long or with too many args
+    unsigned long commands;     ///< Commands run, including built-in ones
+};
+
+/**
+ * Return the counters. They keep counting; copy them to get a snapshot.
+ */
+struct esh_stats const * esh_stats(esh_t * esh);
+
+/**
+ * Set all of the counters to zero.
+ */
+void esh_stats_reset(esh_t * esh);
+#endif // ESH_STATS
+
+#ifdef ESH_TRACE
+/**
+ * Run times of one command, in ticks of ESH_TRACE_CLOCK.
+ */
+struct esh_latency {
+    char const * name;      ///< Command, cut to 11 characters; `*` for others
+    unsigned long count;    ///< Times it has run
+    uint32_t min;           ///< Fastest run
+    uint32_t p50;           ///< Median, rounded up to a power of two less one
+    uint32_t p99;           ///< 99th percentile, rounded the same way
+    uint32_t max;           ///< Slowest run
+};
+
+/**
+ * Read the latency of one command. Commands are numbered from zero in the
+ * order they were first run.
+ * @param esh - esh instance
+ * @param i - which command
+ * @param lat - on return, its latency
+ * @return false if there are not that many commands
+ */
+bool esh_trace_latency(esh_t * esh, size_t i, struct esh_latency * lat);
+
+/**
+ * Clear the trace ring and all latency histograms.
+ */
+void esh_trace_reset(esh_t * esh);
+#endif // ESH_TRACE
+
+#ifdef ESH_RECORD
+/**
+ * Print the session recording, as the esh-record command does.
+ */
+void esh_record_dump(esh_t * esh);
+
+/**
+ * Clear the session recording.
+ */
+void esh_record_reset(esh_t * esh);
+#endif // ESH_RECORD
+
+#ifdef ESH_POSIX
+struct esh_posix;
+typedef struct esh_posix esh_posix_t;
+
+/**
+ * Open a port on file descriptors that are already open, such as
+ * STDIN_FILENO and STDOUT_FILENO, or a socket twice. If the input is a
+ * terminal, it is put in raw mode. The descriptors are not closed with the
+ * port.
+ * @return port, or NULL with errno set
+ */
+esh_posix_t * esh_posix_open(
+        esh_t *         esh,
+        int             in_fd,
+        int             out_fd);
+
+/**
+ * Open a port on a serial device or other terminal by path, and put it in raw
+ * mode, 8N1, ignoring modem control lines.
+ * @param baud - line rate, or 0 to leave it as it is
+ * @return port, or NULL with errno set (EINVAL for an unsupported rate)
+ */
+esh_posix_t * esh_posix_open_path(
+        esh_t *         esh,
+        char const *    path,
+        unsigned long   baud);
+
+/**
+ * Create a PTY and open a port on it. Connect to the path returned in name
+ * with any terminal program; clients may come and go.
+ * @param name - on return, the path of the PTY
+ * @param len - size of name
+ * @return port, or NULL with errno set (ERANGE if name is too small)
+ */
+esh_posix_t * esh_posix_open_pty(
+        esh_t *         esh,
+        char *          name,
+        size_t          len);
+
+/**
+ * Wait up to timeout milliseconds for input, and handle what arrives.
+ * @return number of bytes read; 0 if none came, or the wait was interrupted;
+ *         -1 at end of file or on error, with errno set
+ */
+int esh_posix_poll(
+        esh_posix_t *   port,
+        int             timeout);
+
+/**
+ * Read and handle whatever input is waiting, without waiting for more. Use
+ * this with your own poll() or epoll loop, on esh_posix_fd().
+ * @return as for esh_posix_poll()
+ */
+int esh_posix_read(esh_posix_t * port);
+
+/**
+ * Write out all buffered output. Call this after printing through the
+ * instance from outside of esh_posix_poll() or esh_posix_read(), for example
+ * from a timer.
+ */
+void esh_posix_flush(esh_posix_t * port);
+
+/**
+ * Return the file descriptor input is read from.
+ */
+int esh_posix_fd(esh_posix_t * port);
+
+/**
+ * Flush, restore terminal settings, close what the port opened, and free it.
+ * The esh instance is left alone, but must not print until it has another
+ * print callback.
+ */
+void esh_posix_close(esh_posix_t * port);
+
+/**
+ * Print callback used by ports. Only call this yourself to forward to it from
+ * a static print callback.
+ */
+void esh_posix_print(
+        esh_t *         esh,
+        char            c,
+        void *          arg);
+#endif // ESH_POSIX
+
+#ifdef ESH_SERVER
+struct esh_server;
+typedef struct esh_server esh_server_t;
+
+/**
+ * Callback for sessions opening and closing.
+ * @param esh - the session's instance
+ * @param open - true for a new session, false for one about to be freed
+ * @param arg - as given to esh_server_init()
+ */
+typedef void (*esh_server_session)(esh_t * esh, bool open, void * arg);
+
+/**
+ * Create a server, not yet listening.
+ * @return server, or NULL with errno set
+ */
+esh_server_t * esh_server_init(
+        esh_server_session  cb,
+        void *              arg);
+
+/**
+ * Listen on a Unix socket. A socket already at the path, left from an earlier
+ * run, is removed first; the socket is removed again on close.
+ * @return 0, or -1 with errno set
+ */
+int esh_server_listen_unix(
+        esh_server_t *      server,
+        char const *        path);
+
+/**
+ * Listen on a TCP port on 127.0.0.1.
+ * @param port - port number, or 0 for any free port
+ * @param telnet - negotiate character mode and take out telnet commands
+ * @return port number listened on, or -1 with errno set
+ */
+int esh_server_listen_tcp(
+        esh_server_t *      server,
+        unsigned            port,
+        bool                telnet);
+
+/**
+ * Wait up to timeout milliseconds for activity, and handle all of it:
+ * accept new connections, feed input to sessions, write out their replies,
+ * and close those that have ended.
+ * @return number of sockets handled, or -1 on error with errno set
+ */
+int esh_server_run(
+        esh_server_t *      server,
+        int                 timeout);
+
+/**
+ * Call a function on every session, for example to tick its timers, and write
+ * out what it printed.
+ */
+void esh_server_foreach(
+        esh_server_t *      server,
+        void (*fn)(esh_t * esh, void * arg),
+        void *              arg);
+
+/**
+ * End a session, once its output so far has been written, if it can be
+ * without waiting.
+ */
+void esh_server_hangup(esh_t * esh);
+
+/**
+ * Return the epoll file descriptor, which becomes readable when
+ * esh_server_run() has something to do, to nest it in another event loop.
+ */
+int esh_server_fd(esh_server_t * server);
+
+/**
+ * Return the number of open sessions.
+ */
+size_t esh_server_sessions(esh_server_t * server);
+
+/**
+ * Close all sessions and listening sockets, and free the server.
+ */
+void esh_server_close(esh_server_t * server);
+#endif // ESH_SERVER
+
 /**
  * Set an argument to be given to the command callback. Default is NULL.
  */
@@ -18,6 +18,8 @@
  */
 
 #include <ctype.h>
+#include <limits.h>
+#include <string.h>
 
 #define ESH_INTERNAL
 #include <esh.h>
@@ -25,7 +27,13 @@
 #include <esh_argparser.h>
 #include <esh_internal.h>
 
+#ifdef ESH_BRACE_EXPANSION
+// Arguments are built in a separate buffer, so the command is left intact to
+// be expanded again.
+#define DEST(esh) ((esh)->expand)
+#else
 #define DEST(esh) ((esh)->buffer)
+#endif
 
 
 /**
@@ -56,35 +64,609 @@ static void consume_quoted(esh_t * esh, size_t *src_i, size_t *dest_i)
 }
 
 
-int esh_parse_args(esh_t * esh)
+/**
+ * If an operator joining two commands starts at src_i, return it and skip
+ * over it.
+ */
+static enum esh_chain consume_operator(esh_t * esh, size_t *src_i)
+{
+    (void) esh;
+    char const c = ESH_INSTANCE->buffer[*src_i];
+    bool const doubled = *src_i + 1 < ESH_INSTANCE->cnt
+        && ESH_INSTANCE->buffer[*src_i + 1] == c;
+
+    if (c == ';') {
+        ++*src_i;
+        return ESH_CHAIN_SEQ;
+    } else if (c == '&' && doubled) {
+        *src_i += 2;
+        return ESH_CHAIN_AND;
+    } else if (c == '|' && doubled) {
+        *src_i += 2;
+        return ESH_CHAIN_OR;
+#ifdef ESH_PIPE
+    } else if (c == '|') {
+        ++*src_i;
+        return ESH_CHAIN_PIPE;
+#endif
+    } else {
+        return ESH_CHAIN_END;
+    }
+}
+
+
+#ifdef ESH_VARS
+
+/**
+ * Characters that mean something to the parser outside of quotes, the comma
+ * inside braces. Spaces aren't among them: a value still splits into words,
+ * as in sh.
+ */
+#define SPECIAL ";&|{},'\""
+
+/**
+ * Write one character of a value so that the parser reads it back as itself,
+ * and not as an operator, quote or brace.
+ * @param in_dq - the reference is inside double quotes, where only a double
+ *                quote means anything
+ * @param out - room for 5 characters
+ * @return number of characters written
+ */
+static size_t literal(char c, bool in_dq, char * out)
+{
+    if (in_dq ? c != '"' : !strchr(SPECIAL, c)) {
+        out[0] = c;
+        return 1;
+    } else if (in_dq) {
+        // Close the quotes, quote the quote, and open them again.
+        memcpy(out, "\"'\"'\"", 5);
+        return 5;
+    } else {
+        out[0] = out[2] = (c == '"') ? '\'' : '"';
+        out[1] = c;
+        return 3;
+    }
+}
+
+
+/**
+ * Replace len characters at src_i with a value, quoted where needed, moving
+ * the rest of the buffer to fit.
+ * @return length of the quoted value, or SIZE_MAX if the result doesn't fit
+ *         in the buffer
+ */
+static size_t substitute(esh_t * esh, size_t src_i, size_t len,
+        char const * value, size_t value_len, bool in_dq)
+{
+    (void) esh;
+    char quoted[5];
+    size_t n = 0;
+
+    for (size_t i = 0; i < value_len; ++i) {
+        n += literal(value[i], in_dq, quoted);
+    }
+
+    size_t const cnt = ESH_INSTANCE->cnt - len + n;
+
+    if (cnt > ESH_BUFFER_LEN) {
+        return SIZE_MAX;
+    }
+
+    memmove(&ESH_INSTANCE->buffer[src_i + n],
+            &ESH_INSTANCE->buffer[src_i + len],
+            ESH_INSTANCE->cnt - (src_i + len));
+    for (size_t i = 0, dest = src_i; i < value_len; ++i) {
+        size_t const k = literal(value[i], in_dq, quoted);
+        memcpy(&ESH_INSTANCE->buffer[dest], quoted, k);
+        dest += k;
+    }
+    ESH_INSTANCE->cnt = cnt;
+    ESH_INSTANCE->buffer[cnt] = 0;
+    return n;
+}
+
+
+/**
+ * Expand the variable reference at *src_i ($NAME, ${NAME} or $?), and skip
+ * past the value. A $ that doesn't start a reference is just skipped.
+ * @param in_dq - the reference is inside double quotes
+ * @return false if the result doesn't fit in the buffer
+ */
+static bool expand_var(esh_t * esh, size_t *src_i, bool in_dq)
+{
+    (void) esh;
+    char const * buf = ESH_INSTANCE->buffer;
+    size_t const i = *src_i;
+    bool const braced = buf[i + 1] == '{';
+    size_t const name = i + 1 + braced;
+    size_t end = name;
+    char status[3 * sizeof(int) + 1];
+    char const * value;
+    size_t value_len;
+
+    if (buf[name] == '?') {
+        // Last exit status
+        int n = esh_last_status(ESH_INSTANCE);
+        unsigned mag = (n < 0) ? -(unsigned) n : (unsigned) n;
+        size_t k = sizeof status;
+        do {
+            status[--k] = '0' + mag % 10;
+            mag /= 10;
+        } while (mag);
+        if (n < 0) {
+            status[--k] = '-';
+        }
+        value = &status[k];
+        value_len = sizeof status - k;
+        ++end;
+    } else {
+        if (!isalpha((unsigned char) buf[end]) && buf[end] != '_') {
+            ++*src_i;
+            return true;
+        }
+        while (isalnum((unsigned char) buf[end]) || buf[end] == '_') {
+            ++end;
+        }
+        value = esh_vars_get(ESH_INSTANCE, &buf[name], end - name);
+        if (!value) {
+            value = "";
+        }
+        value_len = strlen(value);
+    }
+
+    if (braced) {
+        if (buf[end] != '}') {
+            ++*src_i;
+            return true;
+        }
+        ++end;
+    }
+
+    size_t const n = substitute(ESH_INSTANCE, i, end - i, value, value_len,
+            in_dq);
+    if (n == SIZE_MAX) {
+        return false;
+    }
+    // The value is not expanded again, and its quoting leaves the quotes
+    // around it as they were.
+    *src_i = i + n;
+    return true;
+}
+
+
+/**
+ * Expand variables in the command at src_i, except inside single quotes.
+ * @return false if the result doesn't fit in the buffer
+ */
+static bool expand_vars(esh_t * esh, size_t src_i)
+{
+    (void) esh;
+    char quote = 0;
+    size_t i = src_i;
+
+    while (i < ESH_INSTANCE->cnt) {
+        char const c = ESH_INSTANCE->buffer[i];
+        size_t op_i = i;
+        enum esh_chain op;
+
+        if (c == '$' && quote != '\'') {
+            if (!expand_var(ESH_INSTANCE, &i, quote == '"')) {
+                return false;
+            }
+            continue;
+        } else if (quote) {
+            quote = (c == quote) ? 0 : quote;
+        } else if (c == '\'' || c == '\"') {
+            quote = c;
+        } else if ((op = consume_operator(ESH_INSTANCE, &op_i)) != ESH_CHAIN_END
+                && op != ESH_CHAIN_PIPE) {
+            break;
+        }
+        ++i;
+    }
+    return true;
+}
+
+#endif // ESH_VARS
+
+
+#ifdef ESH_BRACE_EXPANSION
+
+/**
+ * A brace expression: either a range of numbers, or a list of words.
+ */
+struct brace {
+    size_t start;           ///< Index of the opening brace
+    size_t end;             ///< Index just past the closing brace
+    unsigned long count;    ///< Number of values
+    long first;             ///< Range: first value
+    long step;              ///< Range: signed step; 0 for a list
+    uint8_t width;          ///< Range: digits to zero-pad to
+    bool hex;               ///< Range: print in hex with 0x
+};
+
+
+/**
+ * Parse a number at *src_i for a range, skipping over it. Accepts a leading
+ * minus sign, and hex with 0x. The width is the number of digits if it should
+ * be zero-padded to that (hex, or written with a leading zero), else 1.
+ * @return false if there is no number there, or it doesn't fit in a long
+ */
+static bool parse_number(esh_t * esh, size_t *src_i,
+        long *value, uint8_t *width, bool *hex)
+{
+    (void) esh;
+    size_t i = *src_i;
+    bool const neg = ESH_INSTANCE->buffer[i] == '-';
+    unsigned radix = 10;
+    unsigned long mag = 0;
+    size_t digits = 0;
+
+    if (neg) {
+        ++i;
+    }
+
+    *hex = ESH_INSTANCE->buffer[i] == '0'
+        && (ESH_INSTANCE->buffer[i + 1] == 'x'
+            || ESH_INSTANCE->buffer[i + 1] == 'X');
+    if (*hex) {
+        radix = 16;
+        i += 2;
+    }
+
+    for (; i < ESH_INSTANCE->cnt; ++i, ++digits) {
+        char const c = ESH_INSTANCE->buffer[i];
+        unsigned d;
+
+        if (isdigit((unsigned char) c)) {
+            d = c - '0';
+        } else if (*hex && isxdigit((unsigned char) c)) {
+            d = (tolower((unsigned char) c) - 'a') + 10;
+        } else {
+            break;
+        }
+
+        if (mag > ((unsigned long) LONG_MAX - d) / radix) {
+            return false;
+        }
+        mag = mag * radix + d;
+    }
+
+    if (!digits || digits > UINT8_MAX) {
+        return false;
+    }
+
+    *value = neg ? -(long) mag : (long) mag;
+    *width = (*hex || (digits > 1 && ESH_INSTANCE->buffer[i - digits] == '0'))
+        ? digits : 1;
+    *src_i = i;
+    return true;
+}
+
+
+/**
+ * Skip over ".." at *src_i.
+ * @return false if it isn't there
+ */
+static bool consume_dots(esh_t * esh, size_t *src_i)
+{
+    (void) esh;
+    if (ESH_INSTANCE->buffer[*src_i] == '.'
+            && ESH_INSTANCE->buffer[*src_i + 1] == '.') {
+        *src_i += 2;
+        return true;
+    } else {
+        return false;
+    }
+}
+
+
+/**
+ * Parse {first..last} or {first..last..step} at src_i.
+ */
+static bool parse_range(esh_t * esh, size_t src_i, struct brace *brace)
+{
+    (void) esh;
+    size_t i = src_i + 1;
+    long last, step = 1;
+    uint8_t width;
+    bool hex;
+
+    if (!parse_number(ESH_INSTANCE, &i, &brace->first, &brace->width,
+                &brace->hex)
+            || !consume_dots(ESH_INSTANCE, &i)
+            || !parse_number(ESH_INSTANCE, &i, &last, &width, &hex)) {
+        return false;
+    }
+
+    brace->hex = brace->hex || hex;
+    if (width > brace->width) {
+        brace->width = width;
+    }
+
+    if (consume_dots(ESH_INSTANCE, &i)) {
+        if (!parse_number(ESH_INSTANCE, &i, &step, &width, &hex) || !step) {
+            return false;
+        }
+    }
+
+    if (ESH_INSTANCE->buffer[i] != '}') {
+        return false;
+    }
+
+    // The step's sign is ignored; the range runs from first toward last.
+    unsigned long const mag = (step < 0)
+        ? -(unsigned long) step : (unsigned long) step;
+    unsigned long const span = (last >= brace->first)
+        ? (unsigned long) last - brace->first
+        : (unsigned long) brace->first - last;
+
+    brace->start = src_i;
+    brace->end = i + 1;
+    brace->count = span / mag + 1;
+    brace->step = (last >= brace->first) ? (long) mag : -(long) mag;
+    return true;
+}
+
+
+/**
+ * Parse {word,word...} at src_i. The words may be empty, but may not contain
+ * anything that would end an argument or a command.
+ */
+static bool parse_list(esh_t * esh, size_t src_i, struct brace *brace)
+{
+    (void) esh;
+    unsigned long count = 1;
+
+    for (size_t i = src_i + 1; i < ESH_INSTANCE->cnt; ++i) {
+        char const c = ESH_INSTANCE->buffer[i];
+        size_t op_i = i;
+
+        if (c == '}') {
+            brace->start = src_i;
+            brace->end = i + 1;
+            brace->count = count;
+            brace->step = 0;
+            return count > 1;
+        } else if (c == ',') {
+            ++count;
+        } else if (c == ' ' || c == '\'' || c == '\"' || c == '{'
+                || consume_operator(ESH_INSTANCE, &op_i) != ESH_CHAIN_END) {
+            return false;
+        }
+    }
+    return false;
+}
+
+
+/**
+ * Parse a brace expression at src_i, which must be an opening brace.
+ * @return false if it isn't a valid expression, in which case the brace is
+ *  just a character
+ */
+static bool parse_brace(esh_t * esh, size_t src_i, struct brace *brace)
+{
+    (void) esh;
+    return parse_range(ESH_INSTANCE, src_i, brace)
+        || parse_list(ESH_INSTANCE, src_i, brace);
+}
+
+
+/**
+ * Write one value of a brace expression to the destination. This is never
+ * longer than the expression itself, so it can't overrun the source.
+ */
+static void emit_brace(esh_t * esh, struct brace const *brace,
+        unsigned long idx, size_t *dest_i)
+{
+    (void) esh;
+    if (!brace->step) {
+        size_t i = brace->start + 1;
+
+        for (; idx; ++i) {
+            if (ESH_INSTANCE->buffer[i] == ',') {
+                --idx;
+            }
+        }
+        for (; ESH_INSTANCE->buffer[i] != ',' && ESH_INSTANCE->buffer[i] != '}';
+                ++i) {
+            DEST(ESH_INSTANCE)[(*dest_i)++] = ESH_INSTANCE->buffer[i];
+        }
+        return;
+    }
+
+    // Unsigned, so a range spanning all of long can't overflow on the way.
+    long const value = (long) ((unsigned long) brace->first
+            + idx * (unsigned long) brace->step);
+    unsigned long mag = (value < 0)
+        ? -(unsigned long) value : (unsigned long) value;
+    unsigned const radix = brace->hex ? 16 : 10;
+    char digits[sizeof(unsigned long) * 3];
+    size_t n = 0;
+
+    do {
+        digits[n++] = "0123456789abcdef"[mag % radix];
+        mag /= radix;
+    } while (mag);
+
+    if (value < 0) {
+        DEST(ESH_INSTANCE)[(*dest_i)++] = '-';
+    }
+    if (brace->hex) {
+        DEST(ESH_INSTANCE)[(*dest_i)++] = '0';
+        DEST(ESH_INSTANCE)[(*dest_i)++] = 'x';
+    }
+    for (size_t i = n; i < brace->width; ++i) {
+        DEST(ESH_INSTANCE)[(*dest_i)++] = '0';
+    }
+    while (n) {
+        DEST(ESH_INSTANCE)[(*dest_i)++] = digits[--n];
+    }
+}
+
+
+/**
+ * Return how many commands the command at src_i expands to, or 0 if that
+ * doesn't fit in an unsigned long.
+ */
+static unsigned long count_expansions(esh_t * esh, size_t src_i)
+{
+    (void) esh;
+    unsigned long total = 1;
+    struct brace brace;
+
+    for (size_t i = src_i; i < ESH_INSTANCE->cnt; ++i) {
+        char const c = ESH_INSTANCE->buffer[i];
+
+        if (consume_operator(ESH_INSTANCE, &i) != ESH_CHAIN_END) {
+            break;
+        } else if (c == '\'' || c == '\"') {
+            for (++i; i < ESH_INSTANCE->cnt && ESH_INSTANCE->buffer[i] != c;
+                    ++i) {
+            }
+        } else if (c == '{' && parse_brace(ESH_INSTANCE, i, &brace)) {
+            if (total > ULONG_MAX / brace.count) {
+                return 0;
+            }
+            total *= brace.count;
+            i = brace.end - 1;
+        }
+    }
+    return total;
+}
+
+#endif // ESH_BRACE_EXPANSION
+
+
+/**
+ * Map words to argv, from *src_i up to the end of the buffer or an operator,
+ * and return how many there were. On return, *op is the operator and *src_i
+ * and *dest_i are past it. Braces are expanded if rest is not NULL; n is the
+ * expansion to produce, and rest the number of expansions covered by each
+ * value of the next brace.
+ */
+static int parse_words(esh_t * esh, size_t *src_i, size_t *dest_i,
+        enum esh_chain *op, char ** argv, int argc_max,
+        unsigned long n, unsigned long *rest)
 {
     (void) esh;
     int argc = 0;
     bool last_was_space = true;
-    size_t dest = 0;
+    size_t i = *src_i;
+    size_t dest = *dest_i;
+
+#ifdef ESH_BRACE_EXPANSION
+    struct brace brace;
+#else
+    (void) n;
+    (void) rest;
+#endif
 
-    for (size_t i = 0; i < ESH_INSTANCE->cnt; ++i) {
-        if (ESH_INSTANCE->buffer[i] == ' ') {
+    *op = ESH_CHAIN_END;
+
+    for (; i < ESH_INSTANCE->cnt; ++i) {
+        if ((*op = consume_operator(ESH_INSTANCE, &i)) != ESH_CHAIN_END) {
+            break;
+        } else if (ESH_INSTANCE->buffer[i] == ' ') {
             last_was_space = true;
-            ESH_INSTANCE->buffer[dest] = 0;
+            DEST(ESH_INSTANCE)[dest] = 0;
             ++dest;
         } else {
             if (last_was_space) {
-                if (argc < ESH_ARGC_MAX) {
-                    ESH_INSTANCE->argv[argc] = &ESH_INSTANCE->buffer[dest];
+                if (argc < argc_max) {
+                    argv[argc] = &DEST(ESH_INSTANCE)[dest];
                 }
                 ++argc;
             }
             if (ESH_INSTANCE->buffer[i] == '\'' || ESH_INSTANCE->buffer[i] == '\"') {
                 consume_quoted(ESH_INSTANCE, &i, &dest);
+#ifdef ESH_BRACE_EXPANSION
+            } else if (rest && ESH_INSTANCE->buffer[i] == '{'
+                    && parse_brace(ESH_INSTANCE, i, &brace)) {
+                // The last brace varies fastest, as in sh.
+                *rest /= brace.count;
+                emit_brace(ESH_INSTANCE, &brace,
+                        (n / *rest) % brace.count, &dest);
+                i = brace.end - 1;
+#endif
             } else {
-                ESH_INSTANCE->buffer[dest] = ESH_INSTANCE->buffer[i];
+                DEST(ESH_INSTANCE)[dest] = ESH_INSTANCE->buffer[i];
                 ++dest;
             }
             last_was_space = false;
         }
     }
-    ESH_INSTANCE->buffer[dest] = 0;
-    ESH_INSTANCE->buffer[ESH_BUFFER_LEN] = 0;
+    // The terminator can always go where the operator or the end was, as the
+    // words only ever contract.
+    DEST(ESH_INSTANCE)[dest] = 0;
+    *src_i = i;
+    *dest_i = dest + 1;
+    return argc;
+}
+
+
+int esh_parse_args(esh_t * esh, struct esh_parse_pos * pos,
+        enum esh_chain * op, char ** argv)
+{
+    (void) esh;
+    size_t i = pos->i;
+    size_t dest = pos->i;
+    unsigned long rest = 1;
+    int argc;
+
+#ifdef ESH_VARS
+    // Variables are expanded when the command is reached, so it sees what
+    // the commands before it set.
+    if (!pos->n && !expand_vars(ESH_INSTANCE, pos->i)) {
+        *op = ESH_CHAIN_END;
+        return ESH_ARGC_MAX + 1;
+    }
+#endif
+
+#ifdef ESH_BRACE_EXPANSION
+    unsigned long const total = count_expansions(ESH_INSTANCE, pos->i);
+
+    if (!total) {
+        *op = ESH_CHAIN_END;
+        return ESH_ARGC_MAX + 1;
+    }
+    rest = total;
+#endif
+
+    argc = parse_words(ESH_INSTANCE, &i, &dest, op,
+            argv, ESH_ARGC_MAX, pos->n, &rest);
+
+#ifdef ESH_PIPE
+    bool filters_ok = true;
+
+    esh_pipe_clear(ESH_INSTANCE);
+    while (*op == ESH_CHAIN_PIPE) {
+        char * filter_argv[ESH_PIPE_ARGC];
+        int const filter_argc = parse_words(ESH_INSTANCE, &i, &dest, op,
+                filter_argv, ESH_PIPE_ARGC, 0, NULL);
+
+        // Only report the first bad filter.
+        filters_ok = filters_ok
+            && esh_pipe_add(ESH_INSTANCE, filter_argc, filter_argv);
+    }
+
+    if (!filters_ok) {
+        argc = -1;
+    }
+#endif
+
+    DEST(ESH_INSTANCE)[ESH_BUFFER_LEN] = 0;
+
+#ifdef ESH_BRACE_EXPANSION
+    if (++pos->n < total) {
+        // Come back to this command for its next expansion, which only runs
+        // if this one ran and succeeded.
+        *op = ESH_CHAIN_NEXT;
+        return argc;
+    }
+    pos->n = 0;
+#endif
+
+    pos->i = i;
     return argc;
 }
@@ -24,14 +24,62 @@
 #ifndef ESH_ARGPARSER_H
 #define ESH_ARGPARSER_H
 
+#include <stdbool.h>
+#include <stddef.h>
+
 /**
- * Map the buffer to the argv array, and return argc. If argc exceeds the
- * maximum, the full buffer will still be processed; argument pointers will
- * just not be stored beyond the maximum. The number that would have been
- * stored is returned.
+ * Operators that can join commands on one line.
+ */
+enum esh_chain {
+    ESH_CHAIN_END,      ///< End of the line
+    ESH_CHAIN_SEQ,      ///< ; - run the next command regardless
+    ESH_CHAIN_AND,      ///< && - run the next command if this one succeeded
+    ESH_CHAIN_OR,       ///< || - run the next command if this one failed
+    ESH_CHAIN_PIPE,     ///< | - filter the output (only with ESH_PIPE; the
+                        ///<   filters are taken as part of the command)
+    ESH_CHAIN_NEXT,     ///< Next brace expansion of the same command - run it
+                        ///<   if this one ran and succeeded
+};
+
+struct esh;
+
+/**
+ * Return whether a command joined to the previous one by op should run, given
+ * the status of the last command and whether the previous one ran.
+ */
+bool esh_chain_continues(struct esh * esh, enum esh_chain op, bool ran);
+
+/**
+ * Position of the parser in the buffer. Start at zero.
+ */
+struct esh_parse_pos {
+    size_t i;           ///< Where the next command starts
+    unsigned long n;    ///< Which expansion of it comes next
+};
+
+/**
+ * Map one command of the buffer to the argv array, and return argc. If argc
+ * exceeds the maximum, the full command will still be processed; argument
+ * pointers will just not be stored beyond the maximum. The number that would
+ * have been stored is returned.
+ *
+ * Handles whitespace and quotes. A command ends at the end of the buffer or
+ * at an unquoted ;, && or ||. It is processed in place, with any changes
+ * leaving the length equal or shorter, so commands later in the buffer are
+ * untouched until they are parsed.
+ *
+ * With ESH_BRACE_EXPANSION, a command containing brace expressions expands
+ * to several commands, one per combination of their values, and they are
+ * produced one per call. Until the last, pos is left on the same command and
+ * op is returned as ESH_CHAIN_NEXT. The arguments are then built in a separate
+ * buffer rather than in place, so the command stays intact to expand again.
+ * If there are too many expansions to count, ESH_ARGC_MAX + 1 is returned.
  *
- * Handles whitespace and quotes. The entire buffer is processed in place,
- * with any changes leaveing the length equal or shorter.
+ * @param esh - esh instance
+ * @param pos - where in the buffer to start; on return, where the next
+ *      command starts
+ * @param op - on return, the operator that ended the command
+ * @param argv - array of ESH_ARGC_MAX to map the arguments to
  *
  * Following is an example buffer before and after processing (# for NUL),
  * with pointers stored in argv[] marked with ^
@@ -48,6 +96,7 @@
  * argv:   ^
  *
  */
-int esh_parse_args(esh_t * esh);
+int esh_parse_args(esh_t * esh, struct esh_parse_pos * pos,
+        enum esh_chain * op, char ** argv);
 
 #endif // ESH_ARGPARSER_H
@@ -0,0 +1,48 @@
+/*
+ * esh - embedded shell
+ * Copyright (C) 2017 Chris Pavlina
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef ESH_INTERNAL_INCLUDE
+#error "esh_crc.h is an internal header and should not be included by the user."
+#endif // ESH_INTERNAL_INCLUDE
+
+#ifndef ESH_CRC_H
+#define ESH_CRC_H
+
+#include <stddef.h>
+#include <inttypes.h>
+
+/*
+ * CRC-16/XMODEM (polynomial 0x1021, initial value 0), shared by the features
+ * that frame binary data. It is only compiled in when one of them is enabled.
+ */
+
+#if defined(ESH_XMODEM) || defined(ESH_RPC)
+
+/**
+ * Update a CRC with more data. Start with a CRC of 0.
+ * @param crc - CRC of the data so far
+ * @param data - more data
+ * @param len - number of bytes in data
+ * @return CRC including the new data
+ */
+uint16_t esh_crc16(uint16_t crc, char const * data, size_t len);
+
+#endif // ESH_XMODEM || ESH_RPC
+
+#endif // ESH_CRC_H
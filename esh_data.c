@@ -0,0 +1,176 @@
+/*
+ * esh - embedded shell
+ * Copyright (C) 2017 Chris Pavlina
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <esh.h>
+#define ESH_INTERNAL_INCLUDE
+#include <esh_internal.h>
+
+#ifdef ESH_DATA_MODE
+// Begin actual data mode implementation
+
+/**
+ * Give a chunk to the data callback. Empty chunks are dropped; an empty chunk
+ * is reserved for signalling the end of the data.
+ */
+static void deliver(esh_t * esh, char const * buf, size_t len)
+{
+    (void) esh;
+    if (len) {
+        ESH_INSTANCE->data.cb(ESH_INSTANCE, buf, len, ESH_INSTANCE->data.arg);
+    }
+}
+
+
+/**
+ * Consume bytes in length mode.
+ */
+static size_t rx_length(esh_t * esh, char const * buf, size_t len)
+{
+    (void) esh;
+    if (len > ESH_INSTANCE->data.remaining) {
+        len = ESH_INSTANCE->data.remaining;
+    }
+
+    ESH_INSTANCE->data.remaining -= len;
+    deliver(ESH_INSTANCE, buf, len);
+
+    if (!ESH_INSTANCE->data.remaining) {
+        esh_data_end(ESH_INSTANCE);
+    }
+    return len;
+}
+
+
+/**
+ * Consume bytes in terminator mode, watching for a line consisting of only the
+ * terminator. Characters that might be part of the terminator are held back
+ * until they either complete it or fail to; since they can only be a prefix
+ * of the terminator, they are re-delivered from the terminator string itself,
+ * and nothing ever needs to be copied.
+ */
+static size_t rx_term(esh_t * esh, char const * buf, size_t len)
+{
+    (void) esh;
+    char const * term = ESH_INSTANCE->data.term;
+    size_t matched = ESH_INSTANCE->data.matched;
+    size_t run = 0;     // buf[run..i) is plain data not yet delivered
+
+    for (size_t i = 0; i < len; ++i) {
+        char c = buf[i];
+        // The terminator is followed by a newline, which is not stored.
+        char expect = term[matched] ? term[matched] : '\n';
+
+        if (matched && c != expect) {
+            deliver(ESH_INSTANCE, term, matched);
+            matched = 0;
+            run = i;
+            ESH_INSTANCE->data.bol = false;
+            expect = term[0] ? term[0] : '\n';
+        }
+
+        if (c == expect && (matched || ESH_INSTANCE->data.bol)) {
+            if (!matched) {
+                deliver(ESH_INSTANCE, &buf[run], i - run);
+            }
+            run = i + 1;
+
+            if (!term[matched]) {
+                esh_data_end(ESH_INSTANCE);
+                return i + 1;
+            }
+            ++matched;
+        } else {
+            ESH_INSTANCE->data.bol = (c == '\n');
+        }
+    }
+
+    deliver(ESH_INSTANCE, &buf[run], len - run);
+    ESH_INSTANCE->data.matched = matched;
+    return len;
+}
+
+
+bool esh_data_active(esh_t * esh)
+{
+    (void) esh;
+    return ESH_INSTANCE->data.cb != NULL;
+}
+
+
+bool esh_data_binary(esh_t * esh)
+{
+    (void) esh;
+    return esh_data_active(ESH_INSTANCE) && !ESH_INSTANCE->data.term;
+}
+
+
+size_t esh_data_rx(esh_t * esh, char const * buf, size_t len)
+{
+    (void) esh;
+    if (ESH_INSTANCE->data.term) {
+        return rx_term(ESH_INSTANCE, buf, len);
+    } else {
+        return rx_length(ESH_INSTANCE, buf, len);
+    }
+}
+
+
+void esh_data_length(esh_t * esh, size_t length, esh_cb_data cb, void * arg)
+{
+    (void) esh;
+    if (!length) {
+        // Nothing to wait for; don't leave the shell at all.
+        cb(ESH_INSTANCE, NULL, 0, arg);
+        return;
+    }
+
+    ESH_INSTANCE->data.cb = cb;
+    ESH_INSTANCE->data.arg = arg;
+    ESH_INSTANCE->data.term = NULL;
+    ESH_INSTANCE->data.remaining = length;
+}
+
+
+void esh_data_until(esh_t * esh, char const * term, esh_cb_data cb, void * arg)
+{
+    (void) esh;
+    ESH_INSTANCE->data.cb = cb;
+    ESH_INSTANCE->data.arg = arg;
+    ESH_INSTANCE->data.term = term;
+    ESH_INSTANCE->data.matched = 0;
+    ESH_INSTANCE->data.bol = true;
+}
+
+
+void esh_data_end(esh_t * esh)
+{
+    (void) esh;
+    esh_cb_data cb = ESH_INSTANCE->data.cb;
+
+    if (cb) {
+        // Leave data mode first, so the callback may start another transfer.
+        ESH_INSTANCE->data.cb = NULL;
+        cb(ESH_INSTANCE, NULL, 0, ESH_INSTANCE->data.arg);
+        if (!ESH_INSTANCE->data.cb) {
+            esh_print_prompt(ESH_INSTANCE);
+        }
+    }
+}
+
+#endif // ESH_DATA_MODE
@@ -0,0 +1,103 @@
+/*
+ * esh - embedded shell
+ * Copyright (C) 2017 Chris Pavlina
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef ESH_INTERNAL_INCLUDE
+#error "esh_data.h is an internal header and should not be included by the user."
+#endif // ESH_INTERNAL_INCLUDE
+
+#ifndef ESH_DATA_H
+#define ESH_DATA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * esh data mode support. While data mode is active, received bytes bypass the
+ * line editor entirely and are handed to a chunk callback. When data mode is
+ * not enabled in configuration, a placeholder implementation is provided so
+ * the main esh code need not be conditionally compiled.
+ */
+
+struct esh;
+typedef struct esh esh_t;
+
+#ifdef ESH_DATA_MODE
+// Begin actual data mode implementation
+
+struct esh_data {
+    esh_cb_data cb;         ///< Chunk callback, or NULL when not in data mode
+    void * arg;             ///< Argument for cb
+    char const * term;      ///< Terminator line, or NULL for length mode
+    size_t remaining;       ///< Bytes left to receive in length mode
+    size_t matched;         ///< Characters of "term\n" held back so far
+    bool bol;               ///< Last character seen was a newline
+};
+
+/**
+ * Return whether data mode is active.
+ * @param esh - esh instance
+ */
+bool esh_data_active(esh_t * esh);
+
+/**
+ * Pass received bytes to the data mode handler. Data mode must be active.
+ * @param esh - esh instance
+ * @param buf - received bytes
+ * @param len - number of bytes in buf
+ * @return number of bytes consumed. If less than len, data mode has ended
+ *  and the rest belongs to the shell.
+ */
+size_t esh_data_rx(esh_t * esh, char const * buf, size_t len);
+
+/**
+ * Return whether data mode is active and receiving a fixed length of binary
+ * data (as opposed to text up to a terminator line).
+ * @param esh - esh instance
+ */
+bool esh_data_binary(esh_t * esh);
+
+#else // ESH_DATA_MODE
+// Begin placeholder implementation
+
+#define INL static inline __attribute__((always_inline))
+
+INL bool esh_data_active(esh_t * esh)
+{
+    (void) esh;
+    return false;
+}
+
+INL size_t esh_data_rx(esh_t * esh, char const * buf, size_t len)
+{
+    (void) esh;
+    (void) buf;
+    return len;
+}
+
+INL bool esh_data_binary(esh_t * esh)
+{
+    (void) esh;
+    return false;
+}
+
+#undef INL
+
+#endif // ESH_DATA_MODE
+
+#endif // ESH_DATA_H
@@ -31,6 +31,22 @@
 #ifdef ESH_HIST_ALLOC
 // Begin actual history implementation
 
+#ifdef ESH_HIST_SHARED
+static struct esh_hist_ring shared_ring;
+#   define RING (&shared_ring)
+#else
+#   define RING (&ESH_INSTANCE->hist.ring)
+#endif
+
+/**
+ * With ESH_HIST_SHARED, instances that run on different threads must define
+ * these to take and release a lock around access to the ring.
+ */
+#ifndef ESH_HIST_LOCK
+#   define ESH_HIST_LOCK()
+#   define ESH_HIST_UNLOCK()
+#endif
+
 /**
  * Initialize the history buffer.
  *
@@ -45,13 +61,45 @@ static void init_buffer(char * buffer)
 }
 
 /**
- * True signed modulo, for wraparound signed arithmetic. This is mathematically
- * equivalent to "0 + a   mod b".
+ * Ring buffer stepping. None of these divide: a power-of-two ESH_HIST_LEN
+ * wraps with a mask, and any other length compares and wraps, as division is
+ * a library call per step on small parts.
+ */
+#if (ESH_HIST_LEN & (ESH_HIST_LEN - 1)) == 0
+#   define HIST_POW2
+#endif
+
+/**
+ * Return the offset n places after i, where n <= ESH_HIST_LEN.
+ */
+static int forward(int i, size_t n)
+{
+#ifdef HIST_POW2
+    return (int) ((i + n) & (ESH_HIST_LEN - 1));
+#else
+    size_t const j = i + n;
+    return (int) ((j >= ESH_HIST_LEN) ? j - ESH_HIST_LEN : j);
+#endif
+}
+
+/**
+ * Return the offset after i.
+ */
+static int next(int i)
+{
+    return forward(i, 1);
+}
+
+/**
+ * Return the offset before i.
  */
-static int modulo(int n, int modulus)
+static int prev(int i)
 {
-    int rem = n % modulus;
-    return (rem >= 0) ? rem : rem + modulus;
+#ifdef HIST_POW2
+    return (i - 1) & (ESH_HIST_LEN - 1);
+#else
+    return i ? i - 1 : ESH_HIST_LEN - 1;
+#endif
 }
 
 /**
@@ -73,20 +121,37 @@ static void for_each_char(esh_t * esh, int offset,
         bool (*callback)(esh_t * esh, char c))
 {
     (void) esh;
-    for (int i = offset; ESH_INSTANCE->hist.hist[i]; i = (i + 1) % ESH_HIST_LEN) {
-        if (i == modulo(offset - 1, ESH_HIST_LEN)) {
+    int const last = prev(offset);
+
+    for (int i = offset; RING->hist[i]; i = next(i)) {
+        if (i == last) {
             // Wrapped around and didn't encounter NUL. Stop here to prevent
             // an infinite loop.
             return;
         }
 
-        if (callback(ESH_INSTANCE, ESH_INSTANCE->hist.hist[i])) {
+        if (callback(ESH_INSTANCE, RING->hist[i])) {
             return;
         }
     }
 }
 
 
+/**
+ * Return the length of the string starting at an offset in the ring buffer.
+ */
+static size_t entry_len(esh_t * esh, int offset)
+{
+    (void) esh;
+    size_t len = 0;
+
+    for (int i = offset; RING->hist[i] && len < ESH_HIST_LEN; i = next(i)) {
+        ++len;
+    }
+    return len;
+}
+
+
 /**
  * Internal callback passed to for_each_char by clobber_buffer
  */
@@ -122,37 +187,59 @@ static void clobber_buffer(esh_t * esh, int offset)
 bool esh_hist_init(esh_t * esh)
 {
     (void) esh;
+#ifdef ESH_HIST_SHARED
+    // Only the first instance sets up the shared ring.
+    if (RING->hist) {
+        return false;
+    }
+#endif
 #if ESH_HIST_ALLOC == STATIC
     static char esh_hist[ESH_HIST_LEN] = {0};
-    ESH_INSTANCE->hist.hist = &esh_hist[0];
-    init_buffer(ESH_INSTANCE->hist.hist);
+    RING->hist = &esh_hist[0];
+    init_buffer(RING->hist);
     return false;
 #elif ESH_HIST_ALLOC == MALLOC
-    ESH_INSTANCE->hist.hist = malloc(ESH_HIST_LEN);
-    if (ESH_INSTANCE->hist.hist) {
-        init_buffer(ESH_INSTANCE->hist.hist);
+    RING->hist = malloc(ESH_HIST_LEN);
+    if (RING->hist) {
+        init_buffer(RING->hist);
         return false;
     } else {
         return true;
     }
 #elif ESH_HIST_ALLOC == MANUAL
-    ESH_INSTANCE->hist.hist = NULL;
+    RING->hist = NULL;
     return false;
 #endif
 }
 
 
-int esh_hist_nth(esh_t * esh, int n)
+void esh_hist_free(esh_t * esh)
 {
     (void) esh;
-    const int start = modulo(ESH_INSTANCE->hist.tail - 1, ESH_HIST_LEN);
-    const int stop = (ESH_INSTANCE->hist.tail + 1) % ESH_HIST_LEN;
+#if ESH_HIST_ALLOC == MALLOC && !defined(ESH_HIST_SHARED)
+    free(RING->hist);
+    RING->hist = NULL;
+#endif
+}
 
-    for (int i = start; i != stop; i = modulo(i - 1, ESH_HIST_LEN)) {
-        if (n && ESH_INSTANCE->hist.hist[i] == 0) {
+
+/**
+ * esh_hist_nth(), for use with the lock held.
+ */
+static int nth(esh_t * esh, int n)
+{
+    (void) esh;
+#ifdef ESH_HIST_SHARED
+    n += (int) (RING->added - ESH_INSTANCE->hist.mark);
+#endif
+    const int start = prev(RING->tail);
+    const int stop = next(RING->tail);
+
+    for (int i = start; i != stop; i = prev(i)) {
+        if (n && RING->hist[i] == 0) {
             --n;
-        } else if (ESH_INSTANCE->hist.hist[i] == 0) {
-            return (i + 1) % ESH_HIST_LEN;
+        } else if (RING->hist[i] == 0) {
+            return next(i);
         }
     }
 
@@ -160,43 +247,332 @@ int esh_hist_nth(esh_t * esh, int n)
 }
 
 
-bool esh_hist_add(esh_t * esh, char const * s)
+int esh_hist_nth(esh_t * esh, int n)
 {
     (void) esh;
-    const int start = (ESH_INSTANCE->hist.tail + 1) % ESH_HIST_LEN;
+    ESH_TRACE_BEGIN(ESH_INSTANCE, ESH_TRACE_HIST_FIND, 0);
+    ESH_HIST_LOCK();
+    int const offset = nth(ESH_INSTANCE, n);
+    ESH_HIST_UNLOCK();
+    ESH_TRACE_END(ESH_INSTANCE, ESH_TRACE_HIST_FIND, 0);
+    return offset;
+}
 
-    for (int i = start; ; i = (i + 1) % ESH_HIST_LEN)
+
+void esh_hist_mark(esh_t * esh)
+{
+    (void) esh;
+#ifdef ESH_HIST_SHARED
+    ESH_HIST_LOCK();
+    ESH_INSTANCE->hist.mark = RING->added;
+    ESH_HIST_UNLOCK();
+#endif
+}
+
+
+/**
+ * Return whether a byte of the ring belongs to a command, rather than ending
+ * one or being part of the initial fill.
+ */
+static bool in_entry(char c)
+{
+    return c && c != (char) 0xff;
+}
+
+
+/**
+ * esh_hist_add(), for use with the lock held.
+ */
+static bool add(esh_t * esh, char const * s)
+{
+    (void) esh;
+    const int start = next(RING->tail);
+    const int last = prev(RING->tail);
+    char was = 0;   // What i - 1 held; the tail ends an entry
+
+    for (int i = start; ; i = next(i))
     {
-        if (i == modulo(ESH_INSTANCE->hist.tail - 1, ESH_HIST_LEN)) {
+        // An entry is gone once its first character is overwritten.
+        if (!was && in_entry(RING->hist[i])) {
+            ESH_STAT_INC(ESH_INSTANCE, evictions);
+        }
+
+        if (i == last) {
             // Wrapped around
-            ESH_INSTANCE->hist.tail = 0;
-            init_buffer(ESH_INSTANCE->hist.hist);
+            RING->tail = 0;
+            init_buffer(RING->hist);
             return true;
         }
 
-        ESH_INSTANCE->hist.hist[i] = *s;
+        was = RING->hist[i];
+        RING->hist[i] = *s;
 
         if (*s) {
             ++s;
         } else {
-            ESH_INSTANCE->hist.tail = i;
+            RING->tail = i;
+            // The rest of an entry cut short can't be recalled, and has been
+            // counted, so clear it like the initial fill.
+            for (int j = next(i); was && in_entry(RING->hist[j]); j = next(j)) {
+                RING->hist[j] = (char) 0xff;
+            }
+#ifdef ESH_HIST_SHARED
+            ++RING->added;
+#endif
             return false;
         }
     }
 }
 
 
+#ifdef ESH_HIST_PERSIST
+
+/*
+ * Each sector of the store starts with a header: a magic byte, then the
+ * sector's sequence number, little-endian, one more than that of the sector
+ * before it. After that come the commands, each as a length byte followed by
+ * its characters. A length of 0xff, as erased, marks the end of the log in
+ * that sector. The length is written before the characters, so a command cut
+ * off by a reset still has a length to skip it by.
+ */
+#define STORE_MAGIC 0xe5
+#define HEADER_LEN  3
+#define ERASED      0xff
+
+/**
+ * Read a sector's header.
+ * @return false if the sector has never been used, or can't be read
+ */
+static bool read_header(struct esh_hist_store const * store, size_t sector,
+        uint16_t * seq)
+{
+    uint8_t header[HEADER_LEN];
+
+    if (!store->read(sector * store->sector_len, (char *) header, HEADER_LEN,
+                store->arg) || header[0] != STORE_MAGIC) {
+        return false;
+    }
+    *seq = (uint16_t) (header[1] | header[2] << 8);
+    return true;
+}
+
+
+/**
+ * Erase the next sector and start appending to it.
+ * @return false on error
+ */
+static bool next_sector(esh_t * esh)
+{
+    (void) esh;
+    struct esh_hist_store const * store = RING->store;
+    size_t const sector = (RING->sector + 1) % store->sectors;
+    uint16_t const seq = (uint16_t) (RING->seq + 1);
+    char const header[HEADER_LEN] = {
+        (char) STORE_MAGIC, (char) (seq & 0xff), (char) (seq >> 8)
+    };
+
+    if (!store->erase(sector, store->arg)
+            || !store->write(sector * store->sector_len, header, HEADER_LEN,
+                store->arg)) {
+        return false;
+    }
+    RING->sector = sector;
+    RING->seq = seq;
+    RING->pos = HEADER_LEN;
+    return true;
+}
+
+
+/**
+ * Append a command to the store. On a write error, stop saving.
+ */
+static void save(esh_t * esh, char const * s)
+{
+    (void) esh;
+    struct esh_hist_store const * store = RING->store;
+    size_t const len = strlen(s);
+
+    if (!store || len >= ERASED || HEADER_LEN + 1 + len > store->sector_len) {
+        return;
+    }
+
+    if (RING->pos + 1 + len > store->sector_len && !next_sector(ESH_INSTANCE)) {
+        RING->store = NULL;
+        return;
+    }
+
+    size_t const addr = RING->sector * store->sector_len + RING->pos;
+    char const len_byte = (char) len;
+
+    if (!store->write(addr, &len_byte, 1, store->arg)
+            || !store->write(addr + 1, s, len, store->arg)) {
+        RING->store = NULL;
+        return;
+    }
+    RING->pos += 1 + len;
+}
+
+
+/**
+ * Restore the commands in one sector of the store, using the edit buffer to
+ * hold each one.
+ * @return where the log in the sector ends, or 0 on a read error
+ */
+static size_t load_sector(esh_t * esh, struct esh_hist_store const * store,
+        size_t sector)
+{
+    (void) esh;
+    size_t const base = sector * store->sector_len;
+    size_t pos = HEADER_LEN;
+    char * const buf = ESH_INSTANCE->buffer;
+
+    while (pos < store->sector_len) {
+        uint8_t len;
+
+        if (!store->read(base + pos, (char *) &len, 1, store->arg)) {
+            return 0;
+        } else if (len == ERASED || pos + 1 + len > store->sector_len) {
+            break;
+        }
+
+        // Commands too long for the buffer are skipped.
+        if (len <= ESH_BUFFER_LEN) {
+            if (!store->read(base + pos + 1, buf, len, store->arg)) {
+                return 0;
+            }
+            buf[len] = 0;
+            // A command cut off while being written has erased bytes at its
+            // end; leave it out.
+            if (!memchr(buf, ERASED, len)) {
+                add(ESH_INSTANCE, buf);
+            }
+        }
+        pos += 1 + len;
+    }
+    return pos;
+}
+
+
+bool esh_hist_load(esh_t * esh, struct esh_hist_store const * store)
+{
+    (void) esh;
+    size_t newest = 0;
+    uint16_t newest_seq = 0;
+    bool found = false;
+    uint16_t first_seq, seq, next_seq;
+    bool const first_valid = read_header(store, 0, &first_seq);
+    bool valid = first_valid;
+
+    // Sectors are used in turn, so the newest is the one whose successor
+    // doesn't carry on its sequence.
+    seq = first_seq;
+    for (size_t i = 0; i < store->sectors; ++i) {
+        size_t const next = (i + 1) % store->sectors;
+        bool next_valid;
+
+        if (next) {
+            next_valid = read_header(store, next, &next_seq);
+        } else {
+            next_valid = first_valid;
+            next_seq = first_seq;
+        }
+
+        if (valid && !found
+                && (!next_valid || next_seq != (uint16_t) (seq + 1))) {
+            newest = i;
+            newest_seq = seq;
+            found = true;
+        }
+        valid = next_valid;
+        seq = next_seq;
+    }
+
+    ESH_HIST_LOCK();
+    RING->store = store;
+    if (!found) {
+        // A new store
+        RING->sector = store->sectors - 1;
+        RING->seq = UINT16_MAX;
+        if (!next_sector(ESH_INSTANCE)) {
+            RING->store = NULL;
+        }
+    } else {
+        // Replay from the oldest sector to the newest.
+        for (size_t i = 1; i <= store->sectors; ++i) {
+            size_t const sector = (newest + i) % store->sectors;
+            size_t pos = 0;
+
+            if (read_header(store, sector, &seq)) {
+                pos = load_sector(ESH_INSTANCE, store, sector);
+                if (!pos) {
+                    RING->store = NULL;
+                    break;
+                }
+            }
+            if (sector == newest) {
+                if (!pos) {
+                    RING->store = NULL;
+                    break;
+                }
+                RING->sector = sector;
+                RING->seq = newest_seq;
+                RING->pos = pos;
+            }
+        }
+    }
+    bool const ok = RING->store != NULL;
+    ESH_HIST_UNLOCK();
+    return ok;
+}
+
+#else // ESH_HIST_PERSIST
+
+#define save(esh, s) ((void) 0)
+
+#endif // ESH_HIST_PERSIST
+
+
+bool esh_hist_add(esh_t * esh, char const * s)
+{
+    (void) esh;
+    ESH_TRACE_BEGIN(ESH_INSTANCE, ESH_TRACE_HIST_ADD, 0);
+    ESH_HIST_LOCK();
+    bool const overflow = add(ESH_INSTANCE, s);
+    if (!overflow) {
+        save(ESH_INSTANCE, s);
+    }
+    ESH_HIST_UNLOCK();
+    ESH_TRACE_END(ESH_INSTANCE, ESH_TRACE_HIST_ADD, 0);
+    return overflow;
+}
+
+
 void esh_hist_print(esh_t * esh, int offset)
 {
     (void) esh;
+    ESH_STAT_INC(ESH_INSTANCE, redraws);
+    ESH_TRACE_BEGIN(ESH_INSTANCE, ESH_TRACE_HIST_PRINT, 0);
     // Clear the line
     esh_puts_flash(ESH_INSTANCE, FSTR(ESC_ERASE_LINE "\r"));
 
     esh_print_prompt(ESH_INSTANCE);
 
     if (offset >= 0) {
+        ESH_HIST_LOCK();
+        // With the viewport enabled, show only the tail, the same way the
+        // line will be drawn once it is substituted into the buffer.
+        size_t const cols = esh_viewport_cols(ESH_INSTANCE);
+        if (cols) {
+            size_t const len = entry_len(ESH_INSTANCE, offset);
+            if (len > cols) {
+                esh_putc(ESH_INSTANCE, '<');
+                offset = forward(offset, len - cols + 1);
+            }
+        }
         for_each_char(ESH_INSTANCE, offset, esh_putc);
+        ESH_HIST_UNLOCK();
     }
+    ESH_TRACE_END(ESH_INSTANCE, ESH_TRACE_HIST_PRINT, 0);
 }
 
 
@@ -204,8 +580,10 @@ bool esh_hist_substitute(esh_t * esh)
 {
     (void) esh;
     if (ESH_INSTANCE->hist.idx) {
-        int offset = esh_hist_nth(ESH_INSTANCE, ESH_INSTANCE->hist.idx - 1);
+        ESH_HIST_LOCK();
+        int offset = nth(ESH_INSTANCE, ESH_INSTANCE->hist.idx - 1);
         clobber_buffer(ESH_INSTANCE, offset);
+        ESH_HIST_UNLOCK();
         esh_restore(ESH_INSTANCE);
         ESH_INSTANCE->hist.idx = 0;
         return true;
@@ -220,8 +598,12 @@ bool esh_hist_substitute(esh_t * esh)
 
 void esh_set_histbuf(esh_t * esh, char * buffer)
 {
-    ESH_INSTANCE->hist.hist = buffer;
-    init_buffer(ESH_INSTANCE->hist.hist);
+    (void) esh;
+    // A shared buffer is set up once, by whichever instance gets there first.
+    if (RING->hist != buffer) {
+        RING->hist = buffer;
+        init_buffer(RING->hist);
+    }
 }
 
 #else // ESH_HIST_ALLOC == MANUAL
@@ -26,6 +26,7 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <inttypes.h>
 
 /*
  * esh history support. This provides either a full history implementation or
@@ -39,10 +40,45 @@ typedef struct esh esh_t;
 #ifdef ESH_HIST_ALLOC
 // Begin actual history implementation
 
-struct esh_hist {
+/**
+ * Type of positions within the ring buffer, and of counts of strings in it.
+ * The compact layout uses the smallest type that can count up to
+ * ESH_HIST_LEN; it is signed beyond a byte so that arithmetic on it stays
+ * signed where int is only 16 bits.
+ */
+#if defined(ESH_COMPACT) && ESH_HIST_LEN < 256
+typedef uint8_t esh_hist_index_t;
+#elif defined(ESH_COMPACT) && ESH_HIST_LEN < 32768
+typedef int16_t esh_hist_index_t;
+#else
+typedef int esh_hist_index_t;
+#endif
+
+/**
+ * The ring buffer itself. With ESH_HIST_SHARED, there is one of these for all
+ * instances; otherwise each has its own.
+ */
+struct esh_hist_ring {
     char * hist;
-    int tail;
-    int idx;
+    esh_hist_index_t tail;
+#ifdef ESH_HIST_SHARED
+    unsigned long added;    ///< Number of strings ever added
+#endif
+#ifdef ESH_HIST_PERSIST
+    struct esh_hist_store const * store;    ///< Where to save, or NULL
+    size_t sector;          ///< Sector of .store being appended to
+    size_t pos;             ///< Where in .sector the next command goes
+    uint16_t seq;           ///< Sequence number of .sector
+#endif
+};
+
+struct esh_hist {
+#ifndef ESH_HIST_SHARED
+    struct esh_hist_ring ring;
+#else
+    unsigned long mark;     ///< ring.added when browsing began
+#endif
+    esh_hist_index_t idx;
 };
 
 /**
@@ -53,6 +89,13 @@ struct esh_hist {
  */
 bool esh_hist_init(esh_t * esh);
 
+/**
+ * Release what esh_hist_init() allocated for this instance. A shared ring
+ * stays, for the instances still using it.
+ * @param esh - esh instance
+ */
+void esh_hist_free(esh_t * esh);
+
 /**
  * Count back n strings from the current tail of the ring buffer and return the
  * index the string starts at.
@@ -64,6 +107,14 @@ bool esh_hist_init(esh_t * esh);
  */
 int esh_hist_nth(esh_t * esh, int n);
 
+/**
+ * Note where the history ends as browsing starts. With ESH_HIST_SHARED,
+ * esh_hist_nth() then keeps counting from there, so strings added by other
+ * instances while browsing don't shift what is selected.
+ * @param esh - esh instance
+ */
+void esh_hist_mark(esh_t * esh);
+
 /**
  * Add a string into the buffer. If the string doesn't fit, the buffer is
  * intentionally reset to avoid restoring a corrupted string later.
@@ -91,8 +142,8 @@ bool esh_hist_substitute(esh_t * esh);
 #else // ESH_HIST_ALLOC
 // Begin placeholder implementation
 
-esh_t_hist {
-    size_t idx;
+struct esh_hist {
+    int idx;
 };
 
 #define INL static inline __attribute__((always_inline))
@@ -103,6 +154,11 @@ INL bool esh_hist_init(esh_t * esh)
     return false;
 }
 
+INL void esh_hist_free(esh_t * esh)
+{
+    (void) esh;
+}
+
 INL int esh_hist_nth(esh_t * esh, int n)
 {
     (void) esh;
@@ -110,6 +166,11 @@ INL int esh_hist_nth(esh_t * esh, int n)
     return -1;
 }
 
+INL void esh_hist_mark(esh_t * esh)
+{
+    (void) esh;
+}
+
 INL bool esh_hist_add(esh_t * esh, char const * s)
 {
     (void) esh;
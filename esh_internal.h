@@ -26,6 +26,18 @@
 
 #include <esh_incl_config.h>
 #include <esh_hist.h>
+#include <esh_viewport.h>
+#include <esh_data.h>
+#include <esh_xmodem.h>
+#include <esh_rpc.h>
+#include <esh_pipe.h>
+#include <esh_vars.h>
+#include <esh_macro.h>
+#include <esh_watch.h>
+#include <esh_statusbar.h>
+#include <esh_stats.h>
+#include <esh_trace.h>
+#include <esh_record.h>
 
 /**
  * If we're building for Rust, we need to know the size of a &[u8] in order
@@ -44,6 +56,23 @@ struct char_slice {
 };
 #endif
 
+/**
+ * Type of positions within the line buffer. The compact layout uses the
+ * smallest type that can count up to ESH_BUFFER_LEN + 1, which is where .cnt
+ * sits after an overflow.
+ */
+#if defined(ESH_COMPACT) && ESH_BUFFER_LEN < 255
+typedef uint8_t esh_index_t;
+#elif defined(ESH_COMPACT) && ESH_BUFFER_LEN < 65535
+typedef uint16_t esh_index_t;
+#else
+typedef size_t esh_index_t;
+#endif
+
+#if defined(ESH_COMPACT) && defined(ESH_RUST)
+#   error "ESH_COMPACT is not supported by the Rust bindings"
+#endif
+
 /**
  * esh instance struct. This holds all of the state that needs to be saved
  * between calls to esh_rx().
@@ -54,25 +83,68 @@ typedef struct esh {
      * stored, not characters plus termination.
      */
     char buffer[ESH_BUFFER_LEN + 1];
+#ifdef ESH_BRACE_EXPANSION
+    char expand[ESH_BUFFER_LEN + 1];    ///< Arguments of the expanded command
+#endif
 
     /**
      * The Rust bindings require space allocated for an argv array of &[u8],
-     * which can share memory with C's char* array to save limited SRAM.
+     * which can share memory with C's char* array to save limited SRAM. The
+     * compact layout doesn't keep argv here at all; see ESH_ARGV().
      */
 #ifdef ESH_RUST
     union {
         char * argv[ESH_ARGC_MAX];
         struct char_slice rust_argv[ESH_ARGC_MAX];
     };
-#else
+#elif !defined(ESH_COMPACT)
     char * argv[ESH_ARGC_MAX];
 #endif
 
-    size_t cnt;             ///< Number of characters currently held in .buffer
-    size_t ins;             ///< Position of the current insertion point
+    esh_index_t cnt;        ///< Number of characters currently held in .buffer
+    esh_index_t ins;        ///< Position of the current insertion point
     uint8_t flags;          ///< State flags for escape sequence parser
+    int status;             ///< Exit status of the last command run
     struct esh_hist hist;
-#ifndef ESH_STATIC_CALLBACKS
+#ifdef ESH_VIEWPORT
+    struct esh_viewport vp;
+#endif
+#ifdef ESH_DATA_MODE
+    struct esh_data data;
+#endif
+#ifdef ESH_XMODEM
+    struct esh_xmodem xmodem;
+#endif
+#ifdef ESH_RPC
+    struct esh_rpc rpc;
+#endif
+#ifdef ESH_PIPE
+    struct esh_pipe pipe;
+#endif
+#ifdef ESH_VARS
+    struct esh_vars vars;
+#endif
+#ifdef ESH_MACROS
+    struct esh_macro macro;
+#endif
+#ifdef ESH_WATCH
+    struct esh_watch watch;
+#endif
+#ifdef ESH_STATUSBAR
+    struct esh_statusbar statusbar;
+#endif
+#ifdef ESH_STATS
+    struct esh_stats stats;
+#endif
+#ifdef ESH_TRACE
+    struct esh_trace trace;
+#endif
+#ifdef ESH_RECORD
+    struct esh_record record;
+#endif
+#if defined(ESH_COMPACT) && !defined(ESH_STATIC_CALLBACKS)
+    struct esh_ops const * ops;
+#elif !defined(ESH_STATIC_CALLBACKS)
     esh_cb_command cb_command;
     esh_cb_print print;
     esh_cb_overflow overflow;
@@ -82,6 +154,17 @@ typedef struct esh {
     void *cb_overflow_arg;
 } esh_t;
 
+/**
+ * Declare the argv array for one command, as a char ** called name. It only
+ * needs to live until the command returns, so the compact layout puts it on
+ * the stack of whoever is about to run one instead of in every instance.
+ */
+#ifdef ESH_COMPACT
+#   define ESH_ARGV(name) char * name[ESH_ARGC_MAX]
+#else
+#   define ESH_ARGV(name) char ** const name = ESH_INSTANCE->argv
+#endif
+
 /**
  * On AVR, a number of strings should be stored in and read from flash space.
  * Other architectures have linearized address spaces and don't require this.
@@ -102,6 +185,12 @@ typedef struct esh {
  */
 bool esh_putc(esh_t * esh, char c);
 
+/**
+ * @internal
+ * Print an unsigned number in decimal.
+ */
+bool esh_putu(esh_t * esh, unsigned long n);
+
 /**
  * @internal
  * Print a string located in RAM.
@@ -129,6 +218,12 @@ void esh_print_prompt(esh_t * esh);
  */
 void esh_restore(esh_t * esh);
 
+/**
+ * Move only the terminal cursor, by n columns. This does not move the
+ * insertion point.
+ */
+void esh_term_cursor_move(esh_t * esh, int n);
+
 /**
  * Call the print callback. Wrapper to avoid ifdefs for static callback.
  */
@@ -137,7 +232,14 @@ void esh_do_print_callback(esh_t * esh, char c);
 /**
  * Call the main callback. Wrapper to avoid ifdefs for static callback.
  */
-void esh_do_callback(esh_t * esh, int argc, char ** argv);
+int esh_do_callback(esh_t * esh, int argc, char ** argv);
+
+/**
+ * Return whether a command has taken over the console: data mode, a file
+ * transfer or watch. No more commands on the line are run, and the prompt
+ * waits until it ends.
+ */
+bool esh_console_held(esh_t * esh);
 
 /**
  * Call the overflow callback. Wrapper to avoid ifdefs for the static
@@ -155,6 +257,7 @@ void esh_do_overflow_callback(esh_t * esh, char const * buffer);
 size_t esh_get_slice_size(void);
 #endif
 
+#define ESC_CSI             "\33["
 #define ESC_CURSOR_RIGHT    "\33[1C"
 #define ESC_CURSOR_LEFT     "\33[1D"
 #define ESC_ERASE_LINE      "\33[2K"
@@ -0,0 +1,440 @@
+/*
+ * esh - embedded shell
+ * Copyright (C) 2017 Chris Pavlina
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <esh.h>
+#define ESH_INTERNAL_INCLUDE
+#include <esh_argparser.h>
+#include <esh_internal.h>
+#include <string.h>
+
+#ifdef ESH_MACROS
+// Begin actual macro implementation
+
+#ifndef ESH_MACRO_LEN
+#   error "ESH_MACROS requires ESH_MACRO_LEN to be defined"
+#endif
+
+/*
+ * A macro is stored as its name, NUL-terminated, then each command as an
+ * operator byte followed by its arguments, each NUL-terminated, then an end
+ * byte. Operator bytes are OP_BASE plus the enum esh_chain joining the
+ * command to the one before, and the end byte is OP_BASE + ESH_CHAIN_END.
+ * No argument may start with a byte of OP_BASE or above, which can't occur
+ * in ASCII or UTF-8 text; that is what tells an operator from an argument.
+ * This is the same format ESH_MACRO() produces for macros in flash.
+ */
+#define OP_BASE 0xf8u
+
+#ifdef ESH_MACROS_BUILTIN
+static char const AVR_ONLY(__flash) builtin[] = ESH_MACROS_BUILTIN;
+#else
+static char const AVR_ONLY(__flash) builtin[] = "";
+#endif
+
+/**
+ * Location of a macro: in the RAM arena or the flash table, and where.
+ */
+struct where {
+    bool flash;
+    size_t i;
+};
+
+
+/**
+ * Read one byte of a macro.
+ */
+static uint8_t byte_at(esh_t * esh, struct where w)
+{
+    (void) esh;
+    return (uint8_t) (w.flash ? builtin[w.i] : ESH_INSTANCE->macro.arena[w.i]);
+}
+
+
+/**
+ * Return whether the NUL-terminated name at w equals name[0..len).
+ */
+static bool name_is(esh_t * esh, struct where w, char const * name,
+        size_t len)
+{
+    (void) esh;
+    for (size_t i = 0; i < len; ++i, ++w.i) {
+        if (byte_at(ESH_INSTANCE, w) != (uint8_t) name[i]) {
+            return false;
+        }
+    }
+    return !byte_at(ESH_INSTANCE, w);
+}
+
+
+/**
+ * Skip over a NUL-terminated string at *w.
+ */
+static void skip_str(esh_t * esh, struct where * w)
+{
+    (void) esh;
+    while (byte_at(ESH_INSTANCE, *w)) {
+        ++w->i;
+    }
+    ++w->i;
+}
+
+
+/**
+ * Skip over the commands of a macro at *w, up to and including the end byte.
+ */
+static void skip_commands(esh_t * esh, struct where * w)
+{
+    (void) esh;
+    while (byte_at(ESH_INSTANCE, *w) != OP_BASE + ESH_CHAIN_END) {
+        ++w->i;
+        while (byte_at(ESH_INSTANCE, *w) < OP_BASE) {
+            skip_str(ESH_INSTANCE, w);
+        }
+    }
+    ++w->i;
+}
+
+
+/**
+ * Return whether there is a macro at w; in RAM, this means w is before
+ * limit, and in flash, that its name isn't empty.
+ */
+static bool more(esh_t * esh, struct where w, size_t limit)
+{
+    (void) esh;
+    return w.flash ? byte_at(ESH_INSTANCE, w) != 0 : w.i < limit;
+}
+
+
+/**
+ * Find a macro by name, looking in RAM before flash, so macros defined at the
+ * prompt override those in flash.
+ * @param limit - end of the RAM macros to search
+ * @param w - on return, where the macro's name starts
+ * @return false if there is no such macro
+ */
+static bool find(esh_t * esh, char const * name, size_t len, size_t limit,
+        struct where * w)
+{
+    (void) esh;
+    for (int flash = 0; flash < 2; ++flash) {
+        for (*w = (struct where) {flash, 0}; more(ESH_INSTANCE, *w, limit); ) {
+            if (name_is(ESH_INSTANCE, *w, name, len)) {
+                return true;
+            }
+            skip_str(ESH_INSTANCE, w);
+            skip_commands(ESH_INSTANCE, w);
+        }
+    }
+    return false;
+}
+
+
+/**
+ * Print the NUL-terminated string at *w and skip over it.
+ */
+static void put_str(esh_t * esh, struct where * w)
+{
+    (void) esh;
+    uint8_t c;
+
+    while ((c = byte_at(ESH_INSTANCE, *w))) {
+        esh_putc(ESH_INSTANCE, (char) c);
+        ++w->i;
+    }
+    ++w->i;
+}
+
+
+/**
+ * Print every macro, in a form that could be typed back in to define it.
+ */
+static void list(esh_t * esh)
+{
+    (void) esh;
+    for (int flash = 0; flash < 2; ++flash) {
+        struct where w = {flash, 0};
+
+        while (more(ESH_INSTANCE, w, ESH_INSTANCE->macro.used)) {
+            uint8_t op;
+            bool first = true;
+
+            esh_puts_flash(ESH_INSTANCE, FSTR("macro "));
+            put_str(ESH_INSTANCE, &w);
+
+            while ((op = byte_at(ESH_INSTANCE, w)) != OP_BASE + ESH_CHAIN_END) {
+                ++w.i;
+                // A brace expansion lists as &&, which differs only if the
+                // operator before the braces skipped the first of them.
+                if (op == OP_BASE + ESH_CHAIN_AND
+                        || op == OP_BASE + ESH_CHAIN_NEXT) {
+                    esh_puts_flash(ESH_INSTANCE, FSTR(" &&"));
+                } else if (op == OP_BASE + ESH_CHAIN_OR) {
+                    esh_puts_flash(ESH_INSTANCE, FSTR(" ||"));
+                } else if (!first) {
+                    esh_puts_flash(ESH_INSTANCE, FSTR(" ;"));
+                }
+                first = false;
+
+                while (byte_at(ESH_INSTANCE, w) < OP_BASE) {
+                    esh_puts_flash(ESH_INSTANCE, FSTR(" '"));
+                    put_str(ESH_INSTANCE, &w);
+                    esh_putc(ESH_INSTANCE, '\'');
+                }
+            }
+            ++w.i;
+            esh_putc(ESH_INSTANCE, '\n');
+        }
+    }
+}
+
+
+/**
+ * Append a byte to the macro being built at the end of the arena.
+ * @return false if there is no room
+ */
+static bool put(esh_t * esh, size_t * end, uint8_t c)
+{
+    (void) esh;
+    if (*end >= ESH_MACRO_LEN) {
+        return false;
+    }
+    ESH_INSTANCE->macro.arena[(*end)++] = (char) c;
+    return true;
+}
+
+
+/**
+ * Append a NUL-terminated string to the macro being built.
+ */
+static bool put_arg(esh_t * esh, size_t * end, char const * s)
+{
+    (void) esh;
+    do {
+        if (!put(ESH_INSTANCE, end, (uint8_t) *s)) {
+            return false;
+        }
+    } while (*s++);
+    return true;
+}
+
+
+/**
+ * Parse the commands from buffer[i] on into a macro at the end of the arena.
+ * @param end - where to store; on return, the end of the macro
+ * @return false, having said why, if they didn't fit or can't be stored
+ */
+static bool compile(esh_t * esh, size_t i, size_t * end)
+{
+    (void) esh;
+    struct esh_parse_pos pos = {i, 0};
+    enum esh_chain op = ESH_CHAIN_SEQ;
+    enum esh_chain prev;
+    ESH_ARGV(argv);
+
+    do {
+        prev = op;
+        int argc = esh_parse_args(ESH_INSTANCE, &pos, &op, argv);
+
+        if (argc < 0) {
+            // The parser has already said what was wrong with the filters.
+            return false;
+        } else if (argc > ESH_ARGC_MAX || esh_pipe_pending(ESH_INSTANCE)) {
+            esh_pipe_end(ESH_INSTANCE);
+            esh_puts_flash(ESH_INSTANCE, FSTR("esh: bad macro\n"));
+            return false;
+        } else if (!argc) {
+            continue;
+        }
+
+        if (!put(ESH_INSTANCE, end, OP_BASE + prev)) {
+            goto full;
+        }
+        for (int j = 0; j < argc; ++j) {
+            if ((uint8_t) argv[j][0] >= OP_BASE) {
+                esh_puts_flash(ESH_INSTANCE, FSTR("esh: bad macro\n"));
+                return false;
+            } else if (!put_arg(ESH_INSTANCE, end, argv[j])) {
+                goto full;
+            }
+        }
+    } while (op != ESH_CHAIN_END);
+
+    if (put(ESH_INSTANCE, end, OP_BASE + ESH_CHAIN_END)) {
+        return true;
+    }
+
+full:
+    esh_puts_flash(ESH_INSTANCE, FSTR("esh: out of macro space\n"));
+    return false;
+}
+
+
+/**
+ * Delete the macro in RAM whose name starts at arena[start], moving the ones
+ * after it (up to end) down over it.
+ * @return the number of bytes freed
+ */
+static size_t drop(esh_t * esh, size_t start, size_t end)
+{
+    (void) esh;
+    struct where w = {false, start};
+
+    skip_str(ESH_INSTANCE, &w);
+    skip_commands(ESH_INSTANCE, &w);
+    memmove(&ESH_INSTANCE->macro.arena[start], &ESH_INSTANCE->macro.arena[w.i],
+            end - w.i);
+    return w.i - start;
+}
+
+
+bool esh_macro_define(esh_t * esh)
+{
+    (void) esh;
+    char * const buf = ESH_INSTANCE->buffer;
+    size_t i = 0;
+
+    for (; buf[i] == ' '; ++i);
+    if (strncmp(&buf[i], "macro", 5) || (buf[i + 5] && buf[i + 5] != ' ')) {
+        return false;
+    }
+    for (i += 5; buf[i] == ' '; ++i);
+
+    ESH_INSTANCE->status = 0;
+    if (!buf[i]) {
+        list(ESH_INSTANCE);
+        return true;
+    }
+
+    char const * const name = &buf[i];
+    size_t name_len = 0;
+    while (buf[i] && buf[i] != ' ') {
+        ++i;
+        ++name_len;
+    }
+
+    size_t used = ESH_INSTANCE->macro.used;
+    struct where old;
+    bool const exists = find(ESH_INSTANCE, name, name_len, used, &old)
+        && !old.flash;
+
+    for (; buf[i] == ' '; ++i);
+    if (!buf[i]) {
+        // No commands: forget the macro.
+        if (exists) {
+            ESH_INSTANCE->macro.used -= drop(ESH_INSTANCE, old.i, used);
+        } else {
+            ESH_INSTANCE->status = 1;
+        }
+        return true;
+    }
+
+    // Build the new macro after the others, and only drop the old one once
+    // the new one is complete, so a failed definition changes nothing.
+    size_t end = used;
+    bool ok = true;
+    for (size_t j = 0; j < name_len && ok; ++j) {
+        ok = put(ESH_INSTANCE, &end, (uint8_t) name[j]);
+    }
+    ok = ok && put(ESH_INSTANCE, &end, 0);
+    if (!ok) {
+        esh_puts_flash(ESH_INSTANCE, FSTR("esh: out of macro space\n"));
+    } else {
+        ok = compile(ESH_INSTANCE, i, &end);
+    }
+
+    if (!ok) {
+        ESH_INSTANCE->status = 1;
+    } else if (exists) {
+        ESH_INSTANCE->macro.used = end - drop(ESH_INSTANCE, old.i, end);
+    } else {
+        ESH_INSTANCE->macro.used = end;
+    }
+    return true;
+}
+
+
+bool esh_macro_run(esh_t * esh, int argc, char ** argv)
+{
+    (void) esh;
+    struct where w;
+
+    // Macros don't run macros, so they can't recurse.
+    if (ESH_INSTANCE->macro.running
+            || !find(ESH_INSTANCE, argv[0], strlen(argv[0]),
+                ESH_INSTANCE->macro.used, &w)) {
+        return false;
+    }
+
+    if (argc > 1) {
+        esh_puts_flash(ESH_INSTANCE, FSTR("esh: macros take no arguments\n"));
+        ESH_INSTANCE->status = 1;
+        return true;
+    }
+
+    ESH_INSTANCE->macro.running = true;
+    skip_str(ESH_INSTANCE, &w);
+
+    uint8_t op;
+    bool ran = true;
+    ESH_ARGV(words);
+
+    while ((op = byte_at(ESH_INSTANCE, w)) != OP_BASE + ESH_CHAIN_END) {
+        char * const args = ESH_INSTANCE->macro.args;
+        size_t len = 0;
+        int n = 0;
+
+        // Copy the arguments out; a macro in flash may not fit.
+        for (++w.i; byte_at(ESH_INSTANCE, w) < OP_BASE; ++n) {
+            if (n < ESH_ARGC_MAX) {
+                words[n] = &args[len];
+            }
+            uint8_t c;
+            do {
+                c = byte_at(ESH_INSTANCE, w);
+                ++w.i;
+                if (len < ESH_BUFFER_LEN) {
+                    args[len++] = (char) c;
+                }
+            } while (c);
+        }
+        args[len] = 0;
+
+        ran = esh_chain_continues(ESH_INSTANCE,
+                (enum esh_chain)(op - OP_BASE), ran);
+        if (!ran) {
+            continue;
+        } else if (n > ESH_ARGC_MAX || len >= ESH_BUFFER_LEN) {
+            esh_do_overflow_callback(ESH_INSTANCE, args);
+            ESH_INSTANCE->status = ESH_STATUS_OVERFLOW;
+            break;
+        }
+
+        esh_do_callback(ESH_INSTANCE, n, words);
+        if (esh_console_held(ESH_INSTANCE)) {
+            break;
+        }
+    }
+
+    ESH_INSTANCE->macro.running = false;
+    return true;
+}
+
+#endif // ESH_MACROS
@@ -0,0 +1,92 @@
+/*
+ * esh - embedded shell
+ * Copyright (C) 2017 Chris Pavlina
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef ESH_INTERNAL_INCLUDE
+#error "esh_macro.h is an internal header and should not be included by the user."
+#endif // ESH_INTERNAL_INCLUDE
+
+#ifndef ESH_MACRO_H
+#define ESH_MACRO_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <inttypes.h>
+
+/*
+ * esh macros: named sequences of commands, stored already split into
+ * arguments so running one needs no parsing. When not enabled in
+ * configuration, a placeholder implementation is provided so the main esh
+ * code need not be conditionally compiled.
+ */
+
+struct esh;
+typedef struct esh esh_t;
+
+#ifdef ESH_MACROS
+// Begin actual macro implementation
+
+struct esh_macro {
+    size_t used;                        ///< Bytes of .arena in use
+    bool running;                       ///< A macro is being run
+    char arena[ESH_MACRO_LEN];          ///< Macros defined at the prompt
+    char args[ESH_BUFFER_LEN + 1];      ///< Arguments of the running command
+};
+
+/**
+ * If the line in the buffer defines a macro (`macro NAME commands...`), do
+ * so.
+ * @param esh - esh instance
+ * @return true iff the line was a macro command, and has been handled
+ */
+bool esh_macro_define(esh_t * esh);
+
+/**
+ * If a command names a macro, run the macro.
+ * @param esh - esh instance
+ * @param argc - number of arguments, including the command name
+ * @param argv - arguments
+ * @return true iff it was a macro, and has been run
+ */
+bool esh_macro_run(esh_t * esh, int argc, char ** argv);
+
+#else // ESH_MACROS
+// Begin placeholder implementation
+
+#define INL static inline __attribute__((always_inline))
+
+INL bool esh_macro_define(esh_t * esh)
+{
+    (void) esh;
+    return false;
+}
+
+INL bool esh_macro_run(esh_t * esh, int argc, char ** argv)
+{
+    (void) esh;
+    (void) argc;
+    (void) argv;
+    return false;
+}
+
+#undef INL
+
+#endif // ESH_MACROS
+
+#endif // ESH_MACRO_H
@@ -0,0 +1,311 @@
+/*
+ * esh - embedded shell
+ * Copyright (C) 2017 Chris Pavlina
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <esh.h>
+#define ESH_INTERNAL_INCLUDE
+#include <esh_internal.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef ESH_MUX
+// Begin actual multiplexer implementation
+
+#if ESH_ALLOC != MALLOC
+#   error "ESH_MUX needs several esh instances, so ESH_ALLOC must be MALLOC"
+#endif
+
+#ifndef ESH_MUX_CHANNELS
+#   error "ESH_MUX requires ESH_MUX_CHANNELS to be defined"
+#endif
+
+#ifndef ESH_MUX_TX_LEN
+#   error "ESH_MUX requires ESH_MUX_TX_LEN to be defined"
+#endif
+
+#if ESH_MUX_CHANNELS > 16
+#   error "ESH_MUX_CHANNELS must be at most 16"
+#endif
+
+#define DLE     0x10    ///< Frame lead-in
+#define XON     0x11
+#define XOFF    0x13
+#define CTRL    0x80    ///< Channel byte flag for control frames
+
+/**
+ * Longest data frame. The length byte counts data bytes only.
+ */
+#define FRAME_MAX 255
+
+enum mux_rx_state {
+    RX_IDLE,            ///< Between frames
+    RX_CHANNEL,         ///< Got DLE, expecting a channel byte
+    RX_LENGTH,          ///< Expecting a length byte
+    RX_DATA,            ///< Inside a data frame
+    RX_CONTROL,         ///< Expecting a control operation byte
+};
+
+struct esh_mux_chan {
+    esh_mux_t * mux;
+    esh_t * esh;
+    size_t tx_cnt;                  ///< Bytes held in .tx
+    size_t dropped;                 ///< Bytes dropped while paused and full
+    bool paused;                    ///< Peer asked us to stop sending
+    char tx[ESH_MUX_TX_LEN];        ///< Output awaiting a flush
+};
+
+struct esh_mux {
+    esh_mux_write write;
+    void * write_arg;
+    bool plain0;                    ///< Channel 0 is plain text, not framed
+    uint8_t rx_state;
+    uint8_t rx_chan;
+    uint8_t rx_left;                ///< Data bytes left in the current frame
+    struct esh_mux_chan chan[ESH_MUX_CHANNELS];
+};
+
+
+/**
+ * Write a control frame to the link.
+ */
+static void send_control(esh_mux_t * mux, uint8_t chan, char op)
+{
+    char const frame[] = { DLE, (char)(CTRL | chan), op };
+    mux->write(frame, sizeof frame, mux->write_arg);
+}
+
+
+/**
+ * Write out the output held for one channel, unless the peer paused it.
+ */
+static void flush_chan(struct esh_mux_chan * chan)
+{
+    esh_mux_t * mux = chan->mux;
+    uint8_t const n = chan - &mux->chan[0];
+
+    if (chan->paused || !chan->tx_cnt) {
+        return;
+    }
+
+    if (n == 0 && mux->plain0) {
+        // Plain text, with DLE doubled so the peer can tell it from a frame
+        char const * p = chan->tx;
+        char const * const end = &chan->tx[chan->tx_cnt];
+        char const dle_dle[] = { DLE, DLE };
+
+        while (p < end) {
+            char const * dle = memchr(p, DLE, end - p);
+            char const * stop = dle ? dle : end;
+            if (stop > p) {
+                mux->write(p, stop - p, mux->write_arg);
+            }
+            if (dle) {
+                mux->write(dle_dle, 2, mux->write_arg);
+                ++stop;
+            }
+            p = stop;
+        }
+    } else {
+        for (size_t i = 0; i < chan->tx_cnt; i += FRAME_MAX) {
+            size_t len = chan->tx_cnt - i;
+            if (len > FRAME_MAX) {
+                len = FRAME_MAX;
+            }
+
+            char const header[] = { DLE, (char) n, (char) len };
+            mux->write(header, sizeof header, mux->write_arg);
+            mux->write(&chan->tx[i], len, mux->write_arg);
+        }
+    }
+
+    chan->tx_cnt = 0;
+}
+
+
+/**
+ * Handle a control frame from the peer.
+ */
+static void control(esh_mux_t * mux, uint8_t n, char op)
+{
+    if (n >= ESH_MUX_CHANNELS) {
+        return;
+    }
+
+    if (op == XOFF) {
+        mux->chan[n].paused = true;
+    } else if (op == XON) {
+        mux->chan[n].paused = false;
+        flush_chan(&mux->chan[n]);
+    }
+}
+
+
+/**
+ * Pass a run of received data to a channel's esh instance, if it has one.
+ */
+static void deliver(esh_mux_t * mux, uint8_t n, char const * buf, size_t len)
+{
+    if (n < ESH_MUX_CHANNELS && mux->chan[n].esh) {
+        esh_rx_buf(mux->chan[n].esh, buf, len);
+    }
+}
+
+
+esh_mux_t * esh_mux_init(esh_mux_write write, void * arg, bool plain0)
+{
+    esh_mux_t * mux = malloc(sizeof *mux);
+
+    if (mux) {
+        memset(mux, 0, sizeof *mux);
+        mux->write = write;
+        mux->write_arg = arg;
+        mux->plain0 = plain0;
+        for (size_t i = 0; i < ESH_MUX_CHANNELS; ++i) {
+            mux->chan[i].mux = mux;
+        }
+    }
+    return mux;
+}
+
+
+void esh_mux_attach(esh_mux_t * mux, unsigned channel, esh_t * esh)
+{
+    if (channel >= ESH_MUX_CHANNELS) {
+        return;
+    }
+
+    mux->chan[channel].esh = esh;
+#if !defined(ESH_STATIC_CALLBACKS) && !defined(ESH_COMPACT)
+    esh_register_print(esh, &esh_mux_print);
+#endif
+    esh_set_print_arg(esh, &mux->chan[channel]);
+}
+
+
+void esh_mux_print(esh_t * esh, char c, void * arg)
+{
+    (void) esh;
+    struct esh_mux_chan * chan = arg;
+
+    if (chan->tx_cnt == ESH_MUX_TX_LEN) {
+        flush_chan(chan);
+    }
+
+    if (chan->tx_cnt < ESH_MUX_TX_LEN) {
+        chan->tx[chan->tx_cnt++] = c;
+    } else {
+        ++chan->dropped;
+    }
+}
+
+
+void esh_mux_rx(esh_mux_t * mux, char const * buf, size_t len)
+{
+    size_t i = 0;
+
+    while (i < len) {
+        uint8_t const b = buf[i];
+
+        switch (mux->rx_state) {
+        case RX_IDLE: {
+            // Everything up to the next DLE is plain text for channel 0, or
+            // noise if channel 0 is framed too.
+            char const * dle = memchr(&buf[i], DLE, len - i);
+            size_t const stop = dle ? (size_t)(dle - buf) : len;
+            if (mux->plain0 && stop > i) {
+                deliver(mux, 0, &buf[i], stop - i);
+            }
+            if (dle) {
+                mux->rx_state = RX_CHANNEL;
+                i = stop + 1;
+            } else {
+                i = len;
+            }
+            break;
+        }
+
+        case RX_CHANNEL:
+            ++i;
+            if (b == DLE) {
+                // Escaped DLE in plain text
+                if (mux->plain0) {
+                    char const dle = DLE;
+                    deliver(mux, 0, &dle, 1);
+                }
+                mux->rx_state = RX_IDLE;
+            } else {
+                mux->rx_chan = b & ~CTRL;
+                mux->rx_state = (b & CTRL) ? RX_CONTROL : RX_LENGTH;
+            }
+            break;
+
+        case RX_LENGTH:
+            ++i;
+            mux->rx_left = b;
+            mux->rx_state = b ? RX_DATA : RX_IDLE;
+            break;
+
+        case RX_DATA: {
+            size_t n = len - i;
+            if (n > mux->rx_left) {
+                n = mux->rx_left;
+            }
+            deliver(mux, mux->rx_chan, &buf[i], n);
+            i += n;
+            mux->rx_left -= n;
+            if (!mux->rx_left) {
+                mux->rx_state = RX_IDLE;
+            }
+            break;
+        }
+
+        case RX_CONTROL:
+            ++i;
+            control(mux, mux->rx_chan, b);
+            mux->rx_state = RX_IDLE;
+            break;
+        }
+    }
+
+    // Batch all output produced while handling this input.
+    esh_mux_flush(mux);
+}
+
+
+void esh_mux_flush(esh_mux_t * mux)
+{
+    for (size_t i = 0; i < ESH_MUX_CHANNELS; ++i) {
+        flush_chan(&mux->chan[i]);
+    }
+}
+
+
+void esh_mux_throttle(esh_mux_t * mux, unsigned channel, bool stop)
+{
+    if (channel < ESH_MUX_CHANNELS) {
+        send_control(mux, channel, stop ? XOFF : XON);
+    }
+}
+
+
+size_t esh_mux_dropped(esh_mux_t * mux, unsigned channel)
+{
+    return (channel < ESH_MUX_CHANNELS) ? mux->chan[channel].dropped : 0;
+}
+
+#endif // ESH_MUX
@@ -0,0 +1,472 @@
+/*
+ * esh - embedded shell
+ * Copyright (C) 2017 Chris Pavlina
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <esh.h>
+#define ESH_INTERNAL_INCLUDE
+#include <esh_internal.h>
+#include <ctype.h>
+#include <string.h>
+
+#ifdef ESH_PIPE
+// Begin actual pipe implementation
+
+#if !defined(ESH_PIPE_STAGES) || !defined(ESH_PIPE_LINE_LEN) \
+    || !defined(ESH_PIPE_TAIL_LEN)
+#   error "ESH_PIPE requires ESH_PIPE_STAGES, _LINE_LEN and _TAIL_LEN"
+#endif
+
+#if ESH_PIPE_LINE_LEN < 24
+#   error "ESH_PIPE_LINE_LEN must be at least 24, to hold a line count"
+#endif
+
+enum filter_kind {
+    FILTER_GREP,
+    FILTER_HEAD,
+    FILTER_TAIL,
+    FILTER_COUNT,
+    FILTER_HEX,
+    N_FILTERS
+};
+
+static char const AVR_ONLY(__flash) filter_names[N_FILTERS][6] = {
+    [FILTER_GREP] = "grep",
+    [FILTER_HEAD] = "head",
+    [FILTER_TAIL] = "tail",
+    [FILTER_COUNT] = "count",
+    [FILTER_HEX] = "hex",
+};
+
+/**
+ * Lines kept by head and tail when no number is given.
+ */
+#define DEFAULT_LINES 10
+
+
+/**
+ * Return whether a string equals a name stored in flash.
+ */
+static bool name_is(char const * s, char const AVR_ONLY(__flash) * name)
+{
+    while (*s && *s == *name) {
+        ++s;
+        ++name;
+    }
+    return *s == *name;
+}
+
+
+/**
+ * Parse a line count.
+ * @return false if s isn't a plain decimal number
+ */
+static bool parse_lines(char const * s, unsigned long * n)
+{
+    *n = 0;
+    if (!*s) {
+        return false;
+    }
+    for (; *s; ++s) {
+        if (!isdigit((unsigned char) *s)) {
+            return false;
+        }
+        *n = *n * 10 + (*s - '0');
+    }
+    return true;
+}
+
+
+/**
+ * Return whether line[0..len) contains the pattern.
+ */
+static bool contains(char const * line, size_t len, char const * pattern)
+{
+    size_t const plen = strlen(pattern);
+
+    for (size_t i = 0; i + plen <= len; ++i) {
+        if (!memcmp(&line[i], pattern, plen)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/**
+ * Return whether word[0..len) is a hex number, with or without 0x.
+ */
+static bool is_hex(char const * word, size_t len)
+{
+    if (len > 2 && word[0] == '0' && (word[1] == 'x' || word[1] == 'X')) {
+        word += 2;
+        len -= 2;
+    }
+    for (size_t i = 0; i < len; ++i) {
+        if (!isxdigit((unsigned char) word[i])) {
+            return false;
+        }
+    }
+    return len > 0;
+}
+
+
+/**
+ * Reduce line[0..len) in place to the words in it that are hex numbers,
+ * separated by single spaces, and return the new length.
+ */
+static size_t keep_hex(char * line, size_t len)
+{
+    size_t out = 0;
+    size_t i = 0;
+
+    while (i < len) {
+        while (i < len && isspace((unsigned char) line[i])) {
+            ++i;
+        }
+        size_t const start = i;
+        while (i < len && !isspace((unsigned char) line[i])) {
+            ++i;
+        }
+        if (i > start && is_hex(&line[start], i - start)) {
+            if (out) {
+                line[out++] = ' ';
+            }
+            memmove(&line[out], &line[start], i - start);
+            out += i - start;
+        }
+    }
+    return out;
+}
+
+
+/**
+ * Keep output for tail, dropping the oldest if it doesn't fit.
+ */
+static void tail_store(esh_t * esh, char const * buf, size_t len)
+{
+    (void) esh;
+    struct esh_pipe * pipe = &ESH_INSTANCE->pipe;
+
+    for (size_t i = 0; i < len; ++i) {
+        size_t const at =
+            (pipe->tail_start + pipe->tail_len) % ESH_PIPE_TAIL_LEN;
+        pipe->tail[at] = buf[i];
+        if (pipe->tail_len < ESH_PIPE_TAIL_LEN) {
+            ++pipe->tail_len;
+        } else {
+            pipe->tail_start = (pipe->tail_start + 1) % ESH_PIPE_TAIL_LEN;
+            pipe->tail_lost = true;
+        }
+    }
+}
+
+
+/**
+ * Pass a line of output through the filters from the given stage on, and
+ * print whatever survives. Lines longer than the line buffer arrive in
+ * pieces, and only the last has nl set.
+ */
+static void run_line(esh_t * esh, size_t stage, char * line, size_t len,
+        bool nl)
+{
+    (void) esh;
+    struct esh_pipe * pipe = &ESH_INSTANCE->pipe;
+
+    for (; stage < pipe->n_stages; ++stage) {
+        struct esh_filter * f = &pipe->stages[stage];
+
+        switch (f->kind) {
+        case FILTER_GREP:
+            if (contains(line, len, f->pattern) == f->invert) {
+                return;
+            }
+            break;
+
+        case FILTER_HEAD:
+            if (f->seen >= f->limit) {
+                return;
+            }
+            f->seen += nl;
+            break;
+
+        case FILTER_TAIL:
+            tail_store(ESH_INSTANCE, line, len);
+            if (nl) {
+                tail_store(ESH_INSTANCE, "\n", 1);
+            }
+            return;
+
+        case FILTER_COUNT:
+            f->seen += nl;
+            return;
+
+        case FILTER_HEX:
+            len = keep_hex(line, len);
+            if (!len) {
+                return;
+            }
+            break;
+        }
+    }
+
+    for (size_t i = 0; i < len; ++i) {
+        esh_do_print_callback(ESH_INSTANCE, line[i]);
+    }
+    if (nl) {
+        esh_do_print_callback(ESH_INSTANCE, '\n');
+    }
+}
+
+
+/**
+ * At the end of the output, pass the last lines kept by tail on to the
+ * filters after it.
+ */
+static void tail_flush(esh_t * esh, size_t stage)
+{
+    (void) esh;
+    struct esh_pipe * pipe = &ESH_INSTANCE->pipe;
+    unsigned long const want = pipe->stages[stage].limit;
+    size_t i = pipe->tail_len;
+    unsigned long lines = 0;
+
+#define TAIL_AT(n) (pipe->tail[(pipe->tail_start + (n)) % ESH_PIPE_TAIL_LEN])
+
+    // Everything stored ends in a newline; find the start of the wanted line
+    // counting back from the end.
+    while (i && want) {
+        if (i != pipe->tail_len && TAIL_AT(i - 1) == '\n' && ++lines == want) {
+            break;
+        }
+        --i;
+    }
+
+    if (!i && pipe->tail_lost) {
+        // The oldest line was partly overwritten; don't show what's left.
+        while (i < pipe->tail_len && TAIL_AT(i) != '\n') {
+            ++i;
+        }
+        ++i;
+    }
+
+    pipe->len = 0;
+    for (; i < pipe->tail_len; ++i) {
+        char const c = TAIL_AT(i);
+        if (c == '\n' || pipe->len == ESH_PIPE_LINE_LEN) {
+            run_line(ESH_INSTANCE, stage + 1, pipe->line, pipe->len, c == '\n');
+            pipe->len = 0;
+        }
+        if (c != '\n') {
+            pipe->line[pipe->len++] = c;
+        }
+    }
+
+#undef TAIL_AT
+}
+
+
+/**
+ * At the end of the output, pass the line count on to the filters after it.
+ */
+static void count_flush(esh_t * esh, size_t stage)
+{
+    (void) esh;
+    struct esh_pipe * pipe = &ESH_INSTANCE->pipe;
+    unsigned long n = pipe->stages[stage].seen;
+    char digits[3 * sizeof n];
+    size_t i = 0;
+
+    do {
+        digits[i++] = '0' + n % 10;
+        n /= 10;
+    } while (n);
+
+    pipe->len = 0;
+    while (i) {
+        pipe->line[pipe->len++] = digits[--i];
+    }
+    run_line(ESH_INSTANCE, stage + 1, pipe->line, pipe->len, true);
+}
+
+
+/**
+ * Return whether the pipe already has a tail filter.
+ */
+static bool has_tail(esh_t * esh)
+{
+    (void) esh;
+    for (size_t i = 0; i < ESH_INSTANCE->pipe.n_stages; ++i) {
+        if (ESH_INSTANCE->pipe.stages[i].kind == FILTER_TAIL) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/**
+ * Print an error about a filter.
+ */
+static void bad_filter(esh_t * esh, char const * name)
+{
+    (void) esh;
+    esh_puts_flash(ESH_INSTANCE, FSTR("esh: bad filter: "));
+    esh_puts(ESH_INSTANCE, name);
+    esh_putc(ESH_INSTANCE, '\n');
+}
+
+
+void esh_pipe_clear(esh_t * esh)
+{
+    (void) esh;
+    ESH_INSTANCE->pipe.n_stages = 0;
+    ESH_INSTANCE->pipe.running = false;
+}
+
+
+bool esh_pipe_add(esh_t * esh, int argc, char ** argv)
+{
+    (void) esh;
+    struct esh_pipe * pipe = &ESH_INSTANCE->pipe;
+    struct esh_filter f = {0};
+    bool ok;
+
+    if (argc < 1) {
+        bad_filter(ESH_INSTANCE, "");
+        return false;
+    } else if (argc > ESH_PIPE_ARGC) {
+        bad_filter(ESH_INSTANCE, argv[0]);
+        return false;
+    } else if (pipe->n_stages == ESH_PIPE_STAGES) {
+        esh_puts_flash(ESH_INSTANCE, FSTR("esh: too many filters\n"));
+        return false;
+    }
+
+    for (f.kind = 0; f.kind < N_FILTERS; ++f.kind) {
+        if (name_is(argv[0], filter_names[f.kind])) {
+            break;
+        }
+    }
+
+    switch (f.kind) {
+    case FILTER_GREP:
+        f.invert = argc == 3 && !strcmp(argv[1], "-v");
+        f.pattern = argv[argc - 1];
+        ok = argc == 2 || f.invert;
+        break;
+
+    case FILTER_HEAD:
+    case FILTER_TAIL:
+        f.limit = DEFAULT_LINES;
+        ok = argc == 1 || (argc == 2 && parse_lines(argv[1], &f.limit));
+        // There is only one buffer for tail.
+        ok = ok && !(f.kind == FILTER_TAIL && has_tail(ESH_INSTANCE));
+        break;
+
+    case FILTER_COUNT:
+    case FILTER_HEX:
+        ok = argc == 1;
+        break;
+
+    default:
+        ok = false;
+        break;
+    }
+
+    if (!ok) {
+        bad_filter(ESH_INSTANCE, argv[0]);
+        return false;
+    }
+
+    pipe->stages[pipe->n_stages++] = f;
+    return true;
+}
+
+
+bool esh_pipe_pending(esh_t * esh)
+{
+    (void) esh;
+    return ESH_INSTANCE->pipe.n_stages != 0;
+}
+
+
+void esh_pipe_begin(esh_t * esh)
+{
+    (void) esh;
+    struct esh_pipe * pipe = &ESH_INSTANCE->pipe;
+
+    pipe->running = pipe->n_stages > 0;
+    pipe->len = 0;
+    pipe->tail_start = pipe->tail_len = 0;
+    pipe->tail_lost = false;
+}
+
+
+void esh_pipe_end(esh_t * esh)
+{
+    (void) esh;
+    struct esh_pipe * pipe = &ESH_INSTANCE->pipe;
+
+    if (!pipe->running) {
+        pipe->n_stages = 0;
+        return;
+    }
+
+    // Output that didn't end in a newline is still a line.
+    if (pipe->len) {
+        run_line(ESH_INSTANCE, 0, pipe->line, pipe->len, true);
+    }
+
+    // Each filter that holds output back releases it to the ones after it,
+    // in order, so that e.g. tail | count counts what tail printed.
+    for (size_t i = 0; i < pipe->n_stages; ++i) {
+        if (pipe->stages[i].kind == FILTER_TAIL) {
+            tail_flush(ESH_INSTANCE, i);
+        } else if (pipe->stages[i].kind == FILTER_COUNT) {
+            count_flush(ESH_INSTANCE, i);
+        }
+    }
+
+    esh_pipe_clear(ESH_INSTANCE);
+}
+
+
+bool esh_pipe_putc(esh_t * esh, char c)
+{
+    (void) esh;
+    struct esh_pipe * pipe = &ESH_INSTANCE->pipe;
+
+    if (!pipe->running) {
+        return false;
+    }
+
+    if (c == '\n') {
+        run_line(ESH_INSTANCE, 0, pipe->line, pipe->len, true);
+        pipe->len = 0;
+    } else {
+        if (pipe->len == ESH_PIPE_LINE_LEN) {
+            run_line(ESH_INSTANCE, 0, pipe->line, pipe->len, false);
+            pipe->len = 0;
+        }
+        pipe->line[pipe->len++] = c;
+    }
+    return true;
+}
+
+#endif // ESH_PIPE
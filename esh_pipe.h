@@ -0,0 +1,144 @@
+/*
+ * esh - embedded shell
+ * Copyright (C) 2017 Chris Pavlina
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef ESH_INTERNAL_INCLUDE
+#error "esh_pipe.h is an internal header and should not be included by the user."
+#endif // ESH_INTERNAL_INCLUDE
+
+#ifndef ESH_PIPE_H
+#define ESH_PIPE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <inttypes.h>
+
+/*
+ * esh output filters: `command | grep x | head 5`. While a piped command runs,
+ * its output is cut into lines and passed through the filters before it
+ * reaches the print callback. When not enabled in configuration, a
+ * placeholder implementation is provided so the main esh code need not be
+ * conditionally compiled.
+ */
+
+struct esh;
+typedef struct esh esh_t;
+
+#ifdef ESH_PIPE
+// Begin actual pipe implementation
+
+/**
+ * Most words in one filter (grep -v PATTERN).
+ */
+#define ESH_PIPE_ARGC 3
+
+struct esh_filter {
+    char const * pattern;   ///< grep: what to look for
+    unsigned long limit;    ///< head, tail: number of lines
+    unsigned long seen;     ///< head, count: lines seen so far
+    uint8_t kind;           ///< Which filter this is
+    bool invert;            ///< grep: keep lines that don't match
+};
+
+struct esh_pipe {
+    struct esh_filter stages[ESH_PIPE_STAGES];
+    uint8_t n_stages;       ///< Number of filters in .stages
+    bool running;           ///< Output is being filtered
+    bool tail_lost;         ///< .tail has overflowed since the command began
+    size_t len;             ///< Characters held in .line
+    size_t tail_start;      ///< Oldest character in .tail
+    size_t tail_len;        ///< Characters held in .tail
+    char line[ESH_PIPE_LINE_LEN];   ///< Line being collected
+    char tail[ESH_PIPE_TAIL_LEN];   ///< Last lines of output, for tail
+};
+
+/**
+ * Drop all filters. Called before parsing each command.
+ * @param esh - esh instance
+ */
+void esh_pipe_clear(esh_t * esh);
+
+/**
+ * Add a filter to the end of the pipe. On failure, prints why.
+ * @param esh - esh instance
+ * @param argc - number of words in the filter, including its name
+ * @param argv - words; must remain valid until esh_pipe_end()
+ * @return false if the filter is invalid or there are too many
+ */
+bool esh_pipe_add(esh_t * esh, int argc, char ** argv);
+
+/**
+ * Return whether any filters have been added since the last clear.
+ * @param esh - esh instance
+ */
+bool esh_pipe_pending(esh_t * esh);
+
+/**
+ * Start filtering output, if there are any filters.
+ * @param esh - esh instance
+ */
+void esh_pipe_begin(esh_t * esh);
+
+/**
+ * Flush whatever the filters are holding, and stop filtering.
+ * @param esh - esh instance
+ */
+void esh_pipe_end(esh_t * esh);
+
+/**
+ * Filter one character of output, if filtering.
+ * @param esh - esh instance
+ * @param c - character to print
+ * @return true iff the character was taken by the filters
+ */
+bool esh_pipe_putc(esh_t * esh, char c);
+
+#else // ESH_PIPE
+// Begin placeholder implementation
+
+#define INL static inline __attribute__((always_inline))
+
+INL bool esh_pipe_pending(esh_t * esh)
+{
+    (void) esh;
+    return false;
+}
+
+INL void esh_pipe_begin(esh_t * esh)
+{
+    (void) esh;
+}
+
+INL void esh_pipe_end(esh_t * esh)
+{
+    (void) esh;
+}
+
+INL bool esh_pipe_putc(esh_t * esh, char c)
+{
+    (void) esh;
+    (void) c;
+    return false;
+}
+
+#undef INL
+
+#endif // ESH_PIPE
+
+#endif // ESH_PIPE_H
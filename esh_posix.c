@@ -0,0 +1,461 @@
+/*
+ * esh - embedded shell
+ * Copyright (C) 2017 Chris Pavlina
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+// Before any system header: poll(), sigaction() and posix_openpt() are POSIX
+// and XSI, and the faster baud rates and TIOCGWINSZ are extensions.
+#define _XOPEN_SOURCE 700
+#define _DEFAULT_SOURCE
+
+#include <esh.h>
+#define ESH_INTERNAL_INCLUDE
+#include <esh_internal.h>
+#include <esh_posix.h>
+
+#ifdef ESH_POSIX
+// Begin actual POSIX port implementation
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <unistd.h>
+
+#ifndef ESH_POSIX_BUF_LEN
+#   error "ESH_POSIX requires ESH_POSIX_BUF_LEN to be defined"
+#endif
+
+static volatile sig_atomic_t winch_count;
+
+static struct {
+    unsigned long baud;
+    speed_t speed;
+} const speeds[] = {
+    { 1200, B1200 }, { 2400, B2400 }, { 4800, B4800 }, { 9600, B9600 },
+    { 19200, B19200 }, { 38400, B38400 },
+#ifdef B57600
+    { 57600, B57600 },
+#endif
+#ifdef B115200
+    { 115200, B115200 },
+#endif
+#ifdef B230400
+    { 230400, B230400 },
+#endif
+#ifdef B460800
+    { 460800, B460800 },
+#endif
+#ifdef B921600
+    { 921600, B921600 },
+#endif
+};
+
+
+static void on_winch(int sig)
+{
+    (void) sig;
+    ++winch_count;
+}
+
+
+/**
+ * Give esh the width of the terminal, if the port is one that knows it.
+ */
+static void read_width(esh_posix_t * port)
+{
+    port->winch = winch_count;
+#ifdef TIOCGWINSZ
+    struct winsize ws;
+    if (ioctl(port->out_fd, TIOCGWINSZ, &ws) == 0 && ws.ws_col) {
+        esh_set_width(port->esh, ws.ws_col);
+    }
+#endif
+}
+
+
+/**
+ * Put a terminal into raw mode: bytes in and out untouched, no echo, and no
+ * signals from control characters.
+ * @param fd - terminal
+ * @param saved - on return, the settings to restore
+ * @param baud - line rate to set, or 0 to leave it
+ * @param device - a serial device rather than the user's terminal, so modem
+ *                 control lines are ignored
+ * @return 0, or -1 with errno set
+ */
+static int set_raw(int fd, struct termios * saved, unsigned long baud,
+        bool device)
+{
+    struct termios term;
+
+    if (tcgetattr(fd, saved) < 0) {
+        return -1;
+    }
+    term = *saved;
+
+    term.c_iflag &= ~(BRKINT | ICRNL | IGNCR | INLCR | INPCK | ISTRIP | IXON
+            | PARMRK);
+    term.c_oflag &= ~(OPOST);
+    term.c_cflag &= ~(CSIZE | PARENB);
+    term.c_cflag |= CS8;
+    if (device) {
+        term.c_cflag |= CREAD | CLOCAL;
+    }
+    term.c_lflag &= ~(ECHO | ECHONL | ICANON | IEXTEN | ISIG);
+    term.c_cc[VMIN] = 1;
+    term.c_cc[VTIME] = 0;
+
+    if (baud) {
+        size_t i;
+        for (i = 0; i < sizeof speeds / sizeof speeds[0]; ++i) {
+            if (speeds[i].baud == baud) {
+                break;
+            }
+        }
+        if (i == sizeof speeds / sizeof speeds[0]) {
+            errno = EINVAL;
+            return -1;
+        }
+        cfsetispeed(&term, speeds[i].speed);
+        cfsetospeed(&term, speeds[i].speed);
+    }
+
+    return tcsetattr(fd, TCSAFLUSH, &term);
+}
+
+
+/**
+ * Allocate a port for an esh instance.
+ * @return port, or NULL with errno set
+ */
+static esh_posix_t * make_port(esh_t * esh, int in_fd, int out_fd)
+{
+    esh_posix_t * port = malloc(sizeof *port);
+
+    if (!port) {
+        return NULL;
+    }
+    memset(port, 0, sizeof *port);
+    port->esh = esh;
+    port->in_fd = in_fd;
+    port->out_fd = out_fd;
+    port->slave_fd = -1;
+    return port;
+}
+
+
+/**
+ * Hook a port up to its esh instance, once nothing more can fail, so the
+ * instance is never left printing to a port that has been freed.
+ */
+static esh_posix_t * attach(esh_posix_t * port)
+{
+    esh_set_print_arg(port->esh, port);
+#if !defined(ESH_STATIC_CALLBACKS) && !defined(ESH_COMPACT)
+    esh_register_print(port->esh, &esh_posix_print);
+#endif
+
+    // Only take SIGWINCH if nobody else has.
+    struct sigaction sa;
+    if (sigaction(SIGWINCH, NULL, &sa) == 0 && sa.sa_handler == SIG_DFL) {
+        memset(&sa, 0, sizeof sa);
+        sa.sa_handler = &on_winch;
+        sa.sa_flags = SA_RESTART;
+        sigemptyset(&sa.sa_mask);
+        sigaction(SIGWINCH, &sa, NULL);
+    }
+    read_width(port);
+    return port;
+}
+
+
+esh_posix_t * esh_posix_open(esh_t * esh, int in_fd, int out_fd)
+{
+    esh_posix_t * const port = make_port(esh, in_fd, out_fd);
+
+    if (!port) {
+        return NULL;
+    } else if (isatty(in_fd)) {
+        if (set_raw(in_fd, &port->saved, 0, false) < 0) {
+            int const err = errno;
+            free(port);
+            errno = err;
+            return NULL;
+        }
+        port->restore = true;
+    }
+    return attach(port);
+}
+
+
+esh_posix_t * esh_posix_open_path(esh_t * esh, char const * path,
+        unsigned long baud)
+{
+    int const fd = open(path, O_RDWR | O_NOCTTY);
+    bool const tty = fd >= 0 && isatty(fd);
+    struct termios saved;
+    int err;
+
+    if (fd < 0) {
+        return NULL;
+    } else if (!tty) {
+        err = baud ? ENOTTY : 0;
+    } else {
+        err = set_raw(fd, &saved, baud, true) < 0 ? errno : 0;
+    }
+
+    esh_posix_t * const port = err ? NULL : make_port(esh, fd, fd);
+
+    if (!port) {
+        err = err ? err : errno;
+        close(fd);
+        errno = err;
+        return NULL;
+    }
+
+    port->owns_fd = true;
+    if (tty) {
+        port->restore = true;
+        port->saved = saved;
+    }
+    return attach(port);
+}
+
+
+esh_posix_t * esh_posix_open_pty(esh_t * esh, char * name, size_t len)
+{
+    int const fd = posix_openpt(O_RDWR | O_NOCTTY);
+    int slave = -1;
+    struct termios saved;
+    char const * slave_name;
+    int err = 0;
+
+    if (fd < 0) {
+        return NULL;
+    }
+
+    if (grantpt(fd) < 0 || unlockpt(fd) < 0 || !(slave_name = ptsname(fd))) {
+        err = errno;
+    } else if (strlen(slave_name) >= len) {
+        err = ERANGE;
+    } else if ((slave = open(slave_name, O_RDWR | O_NOCTTY)) < 0
+            || set_raw(slave, &saved, 0, false) < 0) {
+        // Raw on the far side too, so even plain cat works as a client
+        err = errno;
+    } else {
+        strcpy(name, slave_name);
+    }
+
+    esh_posix_t * const port = err ? NULL : make_port(esh, fd, fd);
+
+    if (!port) {
+        err = err ? err : errno;
+        if (slave >= 0) {
+            close(slave);
+        }
+        close(fd);
+        errno = err;
+        return NULL;
+    }
+
+    // Keep the slave open, so the master doesn't hang up each time a client
+    // disconnects.
+    port->owns_fd = true;
+    port->slave_fd = slave;
+    return attach(port);
+}
+
+
+int esh_posix_fd(esh_posix_t * port)
+{
+    return port->in_fd;
+}
+
+
+/**
+ * Bytes go to esh in runs between carriage returns. Outside of binary
+ * transfers, a CR is given as a newline, and a newline right after it (CR LF)
+ * is dropped. Telnet sends any other CR as CR NUL, binary or not, and that
+ * NUL is dropped too; anywhere else, a NUL may be the start of an RPC frame.
+ */
+void esh_posix_rx(esh_posix_t * port, char const * buf, size_t len)
+{
+    while (len) {
+        bool const binary = esh_rx_binary(port->esh);
+        size_t n = 1;
+
+        if (port->after_cr && *buf == 0 && port->telnet) {
+            // Telnet's padding
+        } else if (port->after_cr && *buf == '\n' && !binary) {
+            // Second half of CR LF
+        } else if (*buf == '\r') {
+            esh_rx(port->esh, binary ? '\r' : '\n');
+        } else {
+            char const * const cr = memchr(buf, '\r', len);
+            n = cr ? (size_t) (cr - buf) : len;
+            esh_rx_buf(port->esh, buf, n);
+        }
+
+        port->after_cr = (*buf == '\r');
+        buf += n;
+        len -= n;
+    }
+}
+
+
+int esh_posix_read(esh_posix_t * port)
+{
+    char buf[ESH_POSIX_BUF_LEN];
+    ssize_t n;
+
+    do {
+        n = read(port->in_fd, buf, sizeof buf);
+    } while (n < 0 && errno == EINTR);
+
+    if (port->winch != winch_count) {
+        read_width(port);
+    }
+
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return 0;
+    } else if (n <= 0) {
+        return -1;
+    }
+
+    esh_posix_rx(port, buf, (size_t) n);
+    esh_posix_flush(port);
+    return (int) n;
+}
+
+
+int esh_posix_poll(esh_posix_t * port, int timeout)
+{
+    struct pollfd pfd = { port->in_fd, POLLIN, 0 };
+
+    esh_posix_flush(port);
+    int const ready = poll(&pfd, 1, timeout);
+
+    if (port->winch != winch_count) {
+        read_width(port);
+    }
+
+    if (ready < 0) {
+        // Interrupted, most likely by SIGWINCH
+        return errno == EINTR ? 0 : -1;
+    } else if (!ready) {
+        return 0;
+    } else {
+        return esh_posix_read(port);
+    }
+}
+
+
+void esh_posix_flush(esh_posix_t * port)
+{
+    size_t done = 0;
+
+    while (done < port->out_cnt) {
+        ssize_t const n = write(port->out_fd, &port->out[done],
+                port->out_cnt - done);
+
+        if (n > 0) {
+            done += (size_t) n;
+        } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            if (port->nonblock) {
+                // Keep the rest for when the far end has caught up.
+                memmove(port->out, &port->out[done], port->out_cnt - done);
+                port->out_cnt -= done;
+                return;
+            }
+            struct pollfd pfd = { port->out_fd, POLLOUT, 0 };
+            poll(&pfd, 1, -1);
+        } else if (n < 0 && errno != EINTR) {
+            // The far end has gone; the output goes nowhere.
+            port->failed = true;
+            break;
+        }
+    }
+    port->out_cnt = 0;
+}
+
+
+/**
+ * Buffer one byte of output, flushing first if the buffer is full. If it's
+ * still full, the far end isn't reading, and the byte is lost.
+ */
+static void put(esh_posix_t * port, char c)
+{
+    if (port->out_cnt == ESH_POSIX_BUF_LEN) {
+        esh_posix_flush(port);
+    }
+    if (port->out_cnt == ESH_POSIX_BUF_LEN) {
+        port->failed = true;
+    } else {
+        port->out[port->out_cnt++] = c;
+    }
+}
+
+
+void esh_posix_send(esh_posix_t * port, char const * buf, size_t len)
+{
+    for (size_t i = 0; i < len; ++i) {
+        put(port, buf[i]);
+    }
+}
+
+
+void esh_posix_print(esh_t * esh, char c, void * arg)
+{
+    esh_posix_t * const port = arg;
+    bool const binary = esh_rx_binary(esh);
+
+    // File transfers and RPC responses send binary through here, which must
+    // go out as is, but for telnet's own escapes: IAC doubled, and CR padded
+    // with NUL, which a telnet client takes off again.
+    if (c == '\n' && !binary) {
+        put(port, '\r');
+    } else if (c == (char) 0xff && port->telnet) {
+        put(port, c);
+    }
+    put(port, c);
+    if (c == '\r' && binary && port->telnet) {
+        put(port, 0);
+    }
+}
+
+
+void esh_posix_close(esh_posix_t * port)
+{
+    esh_posix_flush(port);
+    if (port->restore) {
+        tcsetattr(port->in_fd, TCSAFLUSH, &port->saved);
+    }
+    if (port->slave_fd >= 0) {
+        close(port->slave_fd);
+    }
+    if (port->owns_fd) {
+        close(port->in_fd);
+    }
+    free(port);
+}
+
+#endif // ESH_POSIX
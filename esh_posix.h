@@ -0,0 +1,77 @@
+/*
+ * esh - embedded shell
+ * Copyright (C) 2017 Chris Pavlina
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef ESH_INTERNAL_INCLUDE
+#error "esh_posix.h is an internal header and should not be included by the user."
+#endif // ESH_INTERNAL_INCLUDE
+
+#ifndef ESH_POSIX_H
+#define ESH_POSIX_H
+
+#ifdef ESH_POSIX
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <signal.h>
+#include <termios.h>
+
+/*
+ * esh POSIX port internals, shared with the socket server, which reads for
+ * itself and needs output that never blocks.
+ */
+
+struct esh_posix {
+    esh_t * esh;
+    void * owner;                   ///< Whatever opened the port, if not user
+    int in_fd;
+    int out_fd;
+    int slave_fd;                   ///< Our own hold on a PTY, or -1
+    bool owns_fd;                   ///< .in_fd was opened here, close it here
+    bool restore;                   ///< .saved must be put back on .in_fd
+    bool after_cr;                  ///< Last byte received was a CR
+    bool telnet;                    ///< Escape IAC and CR, drop CR's NUL
+    bool nonblock;                  ///< Keep what won't write, don't wait
+    bool failed;                    ///< Output was lost (nonblock only)
+    sig_atomic_t winch;             ///< SIGWINCH count when width was read
+    struct termios saved;           ///< Terminal settings to restore
+    size_t out_cnt;                 ///< Bytes held in .out
+    char out[ESH_POSIX_BUF_LEN];    ///< Output awaiting a flush
+};
+
+/**
+ * Pass received bytes to esh, translating line endings as esh_posix_read()
+ * does.
+ * @param port - port they came in on
+ * @param buf - bytes received
+ * @param len - number of bytes
+ */
+void esh_posix_rx(esh_posix_t * port, char const * buf, size_t len);
+
+/**
+ * Queue bytes to go out as they are, without translation.
+ * @param port - port to send them on
+ * @param buf - bytes to send
+ * @param len - number of bytes
+ */
+void esh_posix_send(esh_posix_t * port, char const * buf, size_t len);
+
+#endif // ESH_POSIX
+
+#endif // ESH_POSIX_H
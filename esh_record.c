@@ -0,0 +1,164 @@
+/*
+ * esh - embedded shell
+ * Copyright (C) 2017 Chris Pavlina
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <esh.h>
+#define ESH_INTERNAL_INCLUDE
+#include <esh_internal.h>
+#include <string.h>
+
+#ifdef ESH_RECORD
+// Begin actual recorder implementation
+
+#define HEX_PER_LINE 32     // Bytes per line of esh-record output
+
+/**
+ * Return the ring index after i.
+ */
+static size_t next(size_t i)
+{
+    return i + 1 == ESH_RECORD_LEN ? 0 : i + 1;
+}
+
+
+/**
+ * Drop the oldest record: a delta, whose bytes all but the last have the top
+ * bit set, then the byte received.
+ */
+static void drop_oldest(esh_t * esh)
+{
+    (void) esh;
+    struct esh_record * const rec = &ESH_INSTANCE->record;
+    uint8_t b;
+
+    do {
+        b = rec->ring[rec->tail];
+        rec->tail = next(rec->tail);
+        --rec->used;
+    } while (b & 0x80);
+
+    rec->tail = next(rec->tail);
+    --rec->used;
+}
+
+
+void esh_record_rx(esh_t * esh, char const * buf, size_t len)
+{
+    (void) esh;
+    struct esh_record * const rec = &ESH_INSTANCE->record;
+    uint32_t const now = ESH_RECORD_CLOCK();
+    uint32_t delta = now - rec->last;
+
+    rec->last = now;
+
+    for (; len; --len, ++buf) {
+        uint8_t encoded[6];
+        size_t n = 0;
+
+        // Delta in seven-bit groups, least significant first. Bytes after
+        // the first in a buffer all arrived together.
+        while (delta > 0x7f) {
+            encoded[n++] = (uint8_t) (delta | 0x80);
+            delta >>= 7;
+        }
+        encoded[n++] = (uint8_t) delta;
+        encoded[n++] = (uint8_t) *buf;
+        delta = 0;
+
+        while (ESH_RECORD_LEN - rec->used < n) {
+            drop_oldest(ESH_INSTANCE);
+        }
+
+        size_t head = rec->tail + rec->used;
+        if (head >= ESH_RECORD_LEN) {
+            head -= ESH_RECORD_LEN;
+        }
+        for (size_t i = 0; i < n; ++i) {
+            rec->ring[head] = encoded[i];
+            head = next(head);
+        }
+        rec->used += n;
+    }
+}
+
+
+/**
+ * Print a byte as two hex digits.
+ */
+static void put_hex(esh_t * esh, uint8_t b)
+{
+    (void) esh;
+    static char const AVR_ONLY(__flash) digits[] = "0123456789abcdef";
+    esh_putc(ESH_INSTANCE, digits[b >> 4]);
+    esh_putc(ESH_INSTANCE, digits[b & 0xf]);
+}
+
+
+void esh_record_dump(esh_t * esh)
+{
+    (void) esh;
+    struct esh_record const * const rec = &ESH_INSTANCE->record;
+    // Printing receives nothing, so the ring holds still while this runs.
+    size_t const used = rec->used;
+    size_t i = rec->tail;
+
+    esh_puts_flash(ESH_INSTANCE, FSTR("esh-record "));
+    esh_putu(ESH_INSTANCE, used);
+
+    for (size_t n = 0; n < used; ++n) {
+        if (n % HEX_PER_LINE == 0) {
+            esh_putc(ESH_INSTANCE, '\n');
+        }
+        put_hex(ESH_INSTANCE, rec->ring[i]);
+        i = next(i);
+    }
+
+    esh_puts_flash(ESH_INSTANCE, FSTR("\nesh-record end\n"));
+}
+
+
+void esh_record_reset(esh_t * esh)
+{
+    (void) esh;
+    ESH_INSTANCE->record.tail = 0;
+    ESH_INSTANCE->record.used = 0;
+}
+
+
+bool esh_record_command(esh_t * esh, int argc, char ** argv, int * status)
+{
+    (void) esh;
+
+    if (strcmp(argv[0], "esh-record")) {
+        return false;
+    }
+
+    *status = 0;
+    if (argc == 1) {
+        esh_record_dump(ESH_INSTANCE);
+    } else if (argc == 2 && !strcmp(argv[1], "reset")) {
+        esh_record_reset(ESH_INSTANCE);
+    } else {
+        esh_puts_flash(ESH_INSTANCE, FSTR("usage: esh-record [reset]\n"));
+        *status = 1;
+    }
+    return true;
+}
+
+#endif // ESH_RECORD
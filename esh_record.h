@@ -0,0 +1,105 @@
+/*
+ * esh - embedded shell
+ * Copyright (C) 2017 Chris Pavlina
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef ESH_INTERNAL_INCLUDE
+#error "esh_record.h is an internal header and should not be included by the user."
+#endif // ESH_INTERNAL_INCLUDE
+
+#ifndef ESH_RECORD_H
+#define ESH_RECORD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <inttypes.h>
+
+/*
+ * esh session recorder: every byte received goes into a ring, after the time
+ * since the byte before it, to be printed by `esh-record` and replayed on a
+ * host. When not enabled in configuration, a placeholder implementation is
+ * provided so the main esh code need not be conditionally compiled.
+ */
+
+struct esh;
+typedef struct esh esh_t;
+
+#ifdef ESH_RECORD
+// Begin actual recorder implementation
+
+#if ESH_RECORD_LEN < 6
+#error "ESH_RECORD_LEN must hold at least one record, 6 bytes"
+#endif
+
+/**
+ * Return the time now, in ticks of any clock that counts up and wraps at
+ * 2^32.
+ */
+uint32_t ESH_RECORD_CLOCK(void);
+
+struct esh_record {
+    uint8_t ring[ESH_RECORD_LEN];   ///< Records, oldest at .tail
+    size_t tail;                    ///< Start of the oldest record
+    size_t used;                    ///< Bytes of .ring in use
+    uint32_t last;                  ///< When the last byte was received
+};
+
+/**
+ * Record bytes received.
+ * @param esh - esh instance
+ * @param buf - bytes
+ * @param len - number of bytes
+ */
+void esh_record_rx(esh_t * esh, char const * buf, size_t len);
+
+/**
+ * Run the esh-record command, if that's what this is.
+ * @param esh - esh instance
+ * @param argc - number of arguments, including the command name
+ * @param argv - arguments
+ * @param status - exit status, if it was esh-record
+ * @return true iff it was esh-record
+ */
+bool esh_record_command(esh_t * esh, int argc, char ** argv, int * status);
+
+#else // ESH_RECORD
+// Begin placeholder implementation
+
+#define INL static inline __attribute__((always_inline))
+
+INL void esh_record_rx(esh_t * esh, char const * buf, size_t len)
+{
+    (void) esh;
+    (void) buf;
+    (void) len;
+}
+
+INL bool esh_record_command(esh_t * esh, int argc, char ** argv, int * status)
+{
+    (void) esh;
+    (void) argc;
+    (void) argv;
+    (void) status;
+    return false;
+}
+
+#undef INL
+
+#endif // ESH_RECORD
+
+#endif // ESH_RECORD_H
@@ -0,0 +1,316 @@
+/*
+ * esh - embedded shell
+ * Copyright (C) 2017 Chris Pavlina
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <esh.h>
+#define ESH_INTERNAL_INCLUDE
+#include <esh_internal.h>
+#include <esh_crc.h>
+
+#ifdef ESH_RPC
+// Begin actual RPC implementation
+
+#define INDEX_INLINE 0xff   ///< Request index meaning "name is argument 0"
+#define HEADER_LEN 2        ///< Tag and index
+#define CRC_LEN 2
+
+/**
+ * Emit a COBS block: its code byte, then the bytes held for it.
+ */
+static void emit_block(esh_t * esh, uint8_t code)
+{
+    (void) esh;
+    esh_do_print_callback(ESH_INSTANCE, code);
+    for (uint8_t i = 0; i < ESH_INSTANCE->rpc.blen; ++i) {
+        esh_do_print_callback(ESH_INSTANCE, ESH_INSTANCE->rpc.block[i]);
+    }
+    ESH_INSTANCE->rpc.blen = 0;
+}
+
+
+/**
+ * COBS-encode one byte of a response. Nonzero bytes are held until the next
+ * zero (or a full block) determines their code byte.
+ */
+static void encode(esh_t * esh, char c)
+{
+    (void) esh;
+    if (!c) {
+        emit_block(ESH_INSTANCE, ESH_INSTANCE->rpc.blen + 1);
+    } else {
+        ESH_INSTANCE->rpc.block[ESH_INSTANCE->rpc.blen++] = c;
+        if (ESH_INSTANCE->rpc.blen == ESH_RPC_BLOCK_LEN) {
+            emit_block(ESH_INSTANCE, 0xff);
+        }
+    }
+}
+
+
+/**
+ * Add one byte to the response payload.
+ */
+static void payload(esh_t * esh, char c)
+{
+    (void) esh;
+    ESH_INSTANCE->rpc.crc = esh_crc16(ESH_INSTANCE->rpc.crc, &c, 1);
+    encode(ESH_INSTANCE, c);
+}
+
+
+static void respond_begin(esh_t * esh, char tag)
+{
+    (void) esh;
+    esh_do_print_callback(ESH_INSTANCE, 0);
+    ESH_INSTANCE->rpc.blen = 0;
+    ESH_INSTANCE->rpc.crc = 0;
+    payload(ESH_INSTANCE, tag);
+    ESH_INSTANCE->rpc.capture = true;
+}
+
+
+static void respond_end(esh_t * esh, enum esh_rpc_status status, int result)
+{
+    (void) esh;
+    ESH_INSTANCE->rpc.capture = false;
+    payload(ESH_INSTANCE, status);
+    payload(ESH_INSTANCE, (char) result);
+
+    uint16_t const crc = ESH_INSTANCE->rpc.crc;
+    encode(ESH_INSTANCE, crc >> 8);
+    encode(ESH_INSTANCE, crc & 0xff);
+
+    // The final block's implied zero is dropped by the decoder.
+    emit_block(ESH_INSTANCE, ESH_INSTANCE->rpc.blen + 1);
+    esh_do_print_callback(ESH_INSTANCE, 0);
+}
+
+
+/**
+ * Give up on a request, and go back to typed input. This is usually a stray
+ * NUL from the keyboard rather than a host, so show a fresh prompt.
+ */
+static void drop_frame(esh_t * esh)
+{
+    (void) esh;
+    ESH_INSTANCE->rpc.in_frame = false;
+    ESH_INSTANCE->rpc.discard = false;
+    ESH_INSTANCE->cnt = ESH_INSTANCE->ins = 0;
+    esh_puts_flash(ESH_INSTANCE, FSTR("\n"));
+    esh_print_prompt(ESH_INSTANCE);
+}
+
+
+/**
+ * Store one decoded request byte. The rest of a request too long for the
+ * buffer is thrown away, still as binary, up to its closing NUL.
+ */
+static void store(esh_t * esh, char c)
+{
+    (void) esh;
+    if (ESH_INSTANCE->cnt < ESH_BUFFER_LEN) {
+        ESH_INSTANCE->buffer[ESH_INSTANCE->cnt++] = c;
+    } else {
+        ESH_INSTANCE->rpc.discard = true;
+    }
+}
+
+
+/**
+ * COBS-decode one nonzero request byte. The zero implied at the end of a
+ * block is only stored once the next block starts, so the one implied at the
+ * end of the frame is never stored at all.
+ */
+static void decode(esh_t * esh, uint8_t b)
+{
+    (void) esh;
+    if (!ESH_INSTANCE->rpc.left) {
+        if (ESH_INSTANCE->rpc.code && ESH_INSTANCE->rpc.code != 0xff) {
+            store(ESH_INSTANCE, 0);
+        }
+        ESH_INSTANCE->rpc.code = b;
+        ESH_INSTANCE->rpc.left = b - 1;
+    } else {
+        store(ESH_INSTANCE, b);
+        --ESH_INSTANCE->rpc.left;
+    }
+}
+
+
+/**
+ * Split the arguments of a decoded request into argv.
+ * @return status, ESH_RPC_OK if argv is ready
+ */
+static enum esh_rpc_status split_args(esh_t * esh, size_t end,
+        char ** argv, int * argc)
+{
+    (void) esh;
+    uint8_t const index = ESH_INSTANCE->buffer[1];
+    int n = 0;
+
+    if (end > HEADER_LEN && ESH_INSTANCE->buffer[end - 1]) {
+        // Last argument not terminated
+        return ESH_RPC_BAD_FRAME;
+    }
+
+    if (index != INDEX_INLINE) {
+        if (index >= ESH_INSTANCE->rpc.n_names) {
+            return ESH_RPC_BAD_COMMAND;
+        }
+        // Handlers receive char ** for compatibility, but must not modify
+        // argv[0] when it comes from the (const) name table.
+        argv[n++] = (char *) ESH_INSTANCE->rpc.names[index];
+    }
+
+    for (size_t i = HEADER_LEN; i < end; ++i) {
+        if (n < ESH_ARGC_MAX) {
+            argv[n] = &ESH_INSTANCE->buffer[i];
+        }
+        ++n;
+        while (ESH_INSTANCE->buffer[i]) {
+            ++i;
+        }
+    }
+
+    *argc = n;
+    if (!n) {
+        return ESH_RPC_BAD_COMMAND;
+    } else if (n > ESH_ARGC_MAX) {
+        return ESH_RPC_OVERFLOW;
+    } else {
+        return ESH_RPC_OK;
+    }
+}
+
+
+/**
+ * Verify and dispatch a complete request.
+ */
+static void end_frame(esh_t * esh)
+{
+    (void) esh;
+    size_t const n = ESH_INSTANCE->cnt;
+    char const tag = n ? ESH_INSTANCE->buffer[0] : 0;
+    enum esh_rpc_status status = ESH_RPC_BAD_FRAME;
+    int argc = 0;
+    int result = 0;
+    ESH_ARGV(argv);
+
+    if (!ESH_INSTANCE->rpc.discard && !ESH_INSTANCE->rpc.left
+            && n >= HEADER_LEN + CRC_LEN) {
+        size_t const end = n - CRC_LEN;
+        uint16_t const crc = ((uint8_t) ESH_INSTANCE->buffer[end] << 8)
+            | (uint8_t) ESH_INSTANCE->buffer[end + 1];
+
+        if (esh_crc16(0, ESH_INSTANCE->buffer, end) == crc) {
+            status = split_args(ESH_INSTANCE, end, argv, &argc);
+        }
+    }
+
+    respond_begin(ESH_INSTANCE, tag);
+    if (status == ESH_RPC_OK) {
+        result = esh_do_callback(ESH_INSTANCE, argc, argv);
+    }
+    respond_end(ESH_INSTANCE, status, result);
+
+    // Only now is the link back to text.
+    ESH_INSTANCE->rpc.in_frame = false;
+    ESH_INSTANCE->rpc.discard = false;
+    ESH_INSTANCE->cnt = ESH_INSTANCE->ins = 0;
+}
+
+
+size_t esh_rpc_rx(esh_t * esh, char const * buf, size_t len)
+{
+    (void) esh;
+    size_t i = 0;
+
+    if (!ESH_INSTANCE->rpc.in_frame) {
+        if (buf[0]) {
+            return 0;
+        }
+
+        // NUL lead-in: start a request. Whatever was being typed is dropped.
+        ESH_INSTANCE->rpc.in_frame = true;
+        ESH_INSTANCE->rpc.code = 0;
+        ESH_INSTANCE->rpc.left = 0;
+        ESH_INSTANCE->rpc.discard = false;
+        ESH_INSTANCE->flags = 0;
+        ESH_INSTANCE->cnt = ESH_INSTANCE->ins = 0;
+        i = 1;
+    }
+
+    ESH_INSTANCE->rpc.idle = false;
+
+    for (; i < len; ++i) {
+        uint8_t const b = buf[i];
+
+        if (b) {
+            if (!ESH_INSTANCE->rpc.discard) {
+                decode(ESH_INSTANCE, b);
+            }
+        } else if (ESH_INSTANCE->rpc.code) {
+            end_frame(ESH_INSTANCE);
+            return i + 1;
+        }
+        // A repeated NUL before any data is just more lead-in.
+    }
+
+    return len;
+}
+
+
+bool esh_rpc_binary(esh_t * esh)
+{
+    (void) esh;
+    return ESH_INSTANCE->rpc.in_frame;
+}
+
+
+void esh_rpc_tick(esh_t * esh)
+{
+    (void) esh;
+    if (!ESH_INSTANCE->rpc.in_frame) {
+        return;
+    } else if (ESH_INSTANCE->rpc.idle) {
+        drop_frame(ESH_INSTANCE);
+    }
+    ESH_INSTANCE->rpc.idle = true;
+}
+
+
+bool esh_rpc_putc(esh_t * esh, char c)
+{
+    (void) esh;
+    if (ESH_INSTANCE->rpc.capture) {
+        payload(ESH_INSTANCE, c);
+        return true;
+    } else {
+        return false;
+    }
+}
+
+
+void esh_rpc_set_commands(esh_t * esh, char const * const * names,
+        size_t count)
+{
+    (void) esh;
+    ESH_INSTANCE->rpc.names = names;
+    ESH_INSTANCE->rpc.n_names = count;
+}
+
+#endif // ESH_RPC
@@ -0,0 +1,118 @@
+/*
+ * esh - embedded shell
+ * Copyright (C) 2017 Chris Pavlina
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef ESH_INTERNAL_INCLUDE
+#error "esh_rpc.h is an internal header and should not be included by the user."
+#endif // ESH_INTERNAL_INCLUDE
+
+#ifndef ESH_RPC_H
+#define ESH_RPC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <inttypes.h>
+
+/*
+ * esh binary RPC support: COBS-framed requests carrying pre-split arguments,
+ * dispatched to the command callback without echo, prompt or tokenizing. When
+ * not enabled in configuration, a placeholder implementation is provided so
+ * the main esh code need not be conditionally compiled.
+ */
+
+struct esh;
+typedef struct esh esh_t;
+
+#ifdef ESH_RPC
+// Begin actual RPC implementation
+
+/**
+ * Longest run of nonzero bytes in one COBS block.
+ */
+#define ESH_RPC_BLOCK_LEN 254
+
+struct esh_rpc {
+    char const * const * names; ///< Command names, indexed by request
+    size_t n_names;             ///< Number of entries in .names
+    uint16_t crc;               ///< Running CRC of the response payload
+    uint8_t code;               ///< Code byte of the current request block
+    uint8_t left;               ///< Bytes left in the current request block
+    uint8_t blen;               ///< Bytes held in .block
+    bool in_frame;              ///< Receiving or answering a request
+    bool discard;               ///< Request too long; skip to its end
+    bool idle;                  ///< No request bytes since the last tick
+    bool capture;               ///< Output is being framed as a response
+    char block[ESH_RPC_BLOCK_LEN];  ///< Response bytes awaiting a code byte
+};
+
+/**
+ * Pass received bytes to the RPC decoder. If no request is being received,
+ * this only starts one if the first byte is the NUL lead-in.
+ * @param esh - esh instance
+ * @param buf - received bytes
+ * @param len - number of bytes in buf
+ * @return number of bytes consumed, or 0 if they are not part of a request.
+ */
+size_t esh_rpc_rx(esh_t * esh, char const * buf, size_t len);
+
+/**
+ * Return whether a request is being received or answered, so the link is
+ * carrying binary.
+ * @param esh - esh instance
+ */
+bool esh_rpc_binary(esh_t * esh);
+
+/**
+ * Frame one character of output, if a response is being sent.
+ * @param esh - esh instance
+ * @param c - character to print
+ * @return true iff the character was taken as part of a response
+ */
+bool esh_rpc_putc(esh_t * esh, char c);
+
+#else // ESH_RPC
+// Begin placeholder implementation
+
+#define INL static inline __attribute__((always_inline))
+
+INL size_t esh_rpc_rx(esh_t * esh, char const * buf, size_t len)
+{
+    (void) esh;
+    (void) buf;
+    (void) len;
+    return 0;
+}
+
+INL bool esh_rpc_binary(esh_t * esh)
+{
+    (void) esh;
+    return false;
+}
+
+INL bool esh_rpc_putc(esh_t * esh, char c)
+{
+    (void) esh;
+    (void) c;
+    return false;
+}
+
+#undef INL
+
+#endif // ESH_RPC
+
+#endif // ESH_RPC_H
@@ -157,6 +157,7 @@ extern "C" {
     fn esh_set_print_arg(esh: *mut Esh, arg: *mut Void);
     fn esh_set_overflow_arg(esh: *mut Esh, arg: *mut Void);
     fn esh_rx(esh: *mut Esh, c: u8);
+    fn esh_rx_buf(esh: *mut Esh, buf: *const u8, len: usize);
     fn esh_default_overflow(esh: *mut Esh, buf: *const u8, arg: *mut Void);
     fn esh_get_slice_size() -> usize;
     fn strlen(s: *const u8) -> usize;
@@ -220,6 +221,18 @@ impl Esh {
         }
     }
 
+    /**
+     * Pass in a block of bytes that were received. This is equivalent to
+     * calling rx() for each one.
+     */
+    pub fn rx_buf(&mut self, buf: &[u8]) {
+        // Safe: C API function is taking a known valid reference as a pointer,
+        // and reads no more than buf.len() bytes from buf
+        unsafe {
+            esh_rx_buf(self, buf.as_ptr(), buf.len());
+        }
+    }
+
     /**
      * -------------------------------------------------------------------------
      * 4.2. Callback registration functions
@@ -315,7 +328,7 @@ unsafe fn map_argv_to_slice<'a>(argv: *mut *mut u8, argc: i32) ->&'a[&'a str]
 #[allow(non_snake_case)]
 #[no_mangle]
 pub extern "C" fn ESH_COMMAND_CALLBACK(
-        esh: *mut Esh, argc: i32, argv: *mut *mut u8, arg: *mut Void)
+        esh: *mut Esh, argc: i32, argv: *mut *mut u8, arg: *mut Void) -> i32
 {
     if arg != ptr::null_mut() {
         // Safe: `arg` came from us originally, transmuted from the same type
@@ -329,6 +342,8 @@ pub extern "C" fn ESH_COMMAND_CALLBACK(
 
         func(esh_self, argv_slices);
     }
+    // Rust command handlers don't report a status; treat them as successful.
+    0
 }
 
 #[allow(non_snake_case)]
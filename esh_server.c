@@ -0,0 +1,602 @@
+/*
+ * esh - embedded shell
+ * Copyright (C) 2017 Chris Pavlina
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+// Before any system header: accept4() and the socket flags are extensions.
+#define _GNU_SOURCE
+
+#include <esh.h>
+#define ESH_INTERNAL_INCLUDE
+#include <esh_internal.h>
+#include <esh_posix.h>
+
+#ifdef ESH_SERVER
+// Begin actual socket server implementation
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#ifndef ESH_POSIX
+#   error "ESH_SERVER runs its sessions on POSIX ports, so needs ESH_POSIX"
+#endif
+
+#if ESH_ALLOC != MALLOC
+#   error "ESH_SERVER needs ESH_ALLOC MALLOC, for an instance per session"
+#endif
+
+#ifndef ESH_SERVER_SESSIONS
+#   error "ESH_SERVER requires ESH_SERVER_SESSIONS to be defined"
+#endif
+
+#define EVENTS          64  ///< Events taken per epoll_wait()
+#define READS           4   ///< Reads per session per wakeup, so none hogs it
+
+// Telnet (RFC 854, 857, 858, 1073)
+#define IAC             255
+#define DONT            254
+#define DO              253
+#define WONT            252
+#define WILL            251
+#define SB              250
+#define SE              240
+#define OPT_ECHO        1
+#define OPT_SGA         3
+#define OPT_NAWS        31
+
+enum telnet_state {
+    TN_DATA,            ///< Plain data
+    TN_IAC,             ///< Got IAC
+    TN_OPTION,          ///< Got IAC and a verb, expecting the option
+    TN_SB,              ///< Inside a subnegotiation
+    TN_SB_IAC,          ///< Got IAC inside a subnegotiation
+};
+
+/**
+ * A listening socket, or a session on an accepted one. The epoll data of
+ * each points here.
+ */
+struct esh_server_conn {
+    esh_server_t * server;
+    int fd;
+    esh_t * esh;                    ///< NULL for a listening socket
+    esh_posix_t * port;
+    char * path;                    ///< Unix socket to remove on close
+    bool telnet;                    ///< Speaks telnet
+    bool want_out;                  ///< Waiting for room to write
+    bool hangup;                    ///< On the dying list
+    uint8_t tn_state;
+    uint8_t tn_verb;
+    uint8_t sb_len;
+    uint8_t sb[5];                  ///< Subnegotiation: option, and 4 bytes
+    struct esh_server_conn * next;
+    struct esh_server_conn * prev;
+    struct esh_server_conn * next_dying;
+};
+
+struct esh_server {
+    int epfd;
+    esh_server_session cb;
+    void * arg;
+    size_t sessions;
+    struct esh_server_conn * list;          ///< Sessions
+    struct esh_server_conn * listeners;
+    struct esh_server_conn * dying;         ///< To close at the end of a round
+    char buf[ESH_POSIX_BUF_LEN];            ///< Input, one session at a time
+};
+
+// Character mode: we echo, nobody sends go-ahead, and tell us your width.
+static unsigned char const negotiation[] = {
+    IAC, WILL, OPT_ECHO, IAC, WILL, OPT_SGA, IAC, DO, OPT_NAWS,
+};
+
+
+esh_server_t * esh_server_init(esh_server_session cb, void * arg)
+{
+    esh_server_t * server = malloc(sizeof *server);
+
+    if (!server) {
+        return NULL;
+    }
+    memset(server, 0, sizeof *server);
+    server->cb = cb;
+    server->arg = arg;
+    server->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (server->epfd < 0) {
+        int const err = errno;
+        free(server);
+        errno = err;
+        return NULL;
+    }
+
+    // A client that goes away mid-write must not kill the server. Only take
+    // SIGPIPE if nobody else has.
+    struct sigaction sa;
+    if (sigaction(SIGPIPE, NULL, &sa) == 0 && sa.sa_handler == SIG_DFL) {
+        memset(&sa, 0, sizeof sa);
+        sa.sa_handler = SIG_IGN;
+        sigemptyset(&sa.sa_mask);
+        sigaction(SIGPIPE, &sa, NULL);
+    }
+    return server;
+}
+
+
+/**
+ * Add a socket to the epoll set and a list.
+ * @return connection, or NULL with errno set and the socket closed
+ */
+static struct esh_server_conn * add_conn(esh_server_t * server, int fd,
+        struct esh_server_conn ** list)
+{
+    struct esh_server_conn * conn = malloc(sizeof *conn);
+
+    if (!conn) {
+        close(fd);
+        errno = ENOMEM;
+        return NULL;
+    }
+    memset(conn, 0, sizeof *conn);
+    conn->server = server;
+    conn->fd = fd;
+
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = conn };
+    if (epoll_ctl(server->epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        int const err = errno;
+        close(fd);
+        free(conn);
+        errno = err;
+        return NULL;
+    }
+
+    conn->next = *list;
+    if (*list) {
+        (*list)->prev = conn;
+    }
+    *list = conn;
+    return conn;
+}
+
+
+/**
+ * Take a connection off a list, close its socket and free it.
+ */
+static void remove_conn(struct esh_server_conn * conn,
+        struct esh_server_conn ** list)
+{
+    if (conn->prev) {
+        conn->prev->next = conn->next;
+    } else {
+        *list = conn->next;
+    }
+    if (conn->next) {
+        conn->next->prev = conn->prev;
+    }
+    close(conn->fd);
+    free(conn->path);
+    free(conn);
+}
+
+
+/**
+ * Bind a new socket, listen on it and add it.
+ * @return listener, or NULL with errno set
+ */
+static struct esh_server_conn * listen_on(esh_server_t * server, int domain,
+        struct sockaddr const * addr, socklen_t len)
+{
+    int const fd = socket(domain, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+            0);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    int const one = 1;
+    if ((domain == AF_INET
+            && setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof one) < 0)
+            || bind(fd, addr, len) < 0 || listen(fd, SOMAXCONN) < 0) {
+        int const err = errno;
+        close(fd);
+        errno = err;
+        return NULL;
+    }
+    return add_conn(server, fd, &server->listeners);
+}
+
+
+int esh_server_listen_unix(esh_server_t * server, char const * path)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+
+    if (strlen(path) >= sizeof addr.sun_path) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    char * const copy = strdup(path);
+    if (!copy) {
+        return -1;
+    }
+
+    // A socket left behind by an earlier run would make bind() fail.
+    struct stat st;
+    if (stat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        unlink(path);
+    }
+
+    struct esh_server_conn * const conn = listen_on(server, AF_UNIX,
+            (struct sockaddr const *) &addr, sizeof addr);
+    if (!conn) {
+        int const err = errno;
+        free(copy);
+        errno = err;
+        return -1;
+    }
+    conn->path = copy;
+    return 0;
+}
+
+
+int esh_server_listen_tcp(esh_server_t * server, unsigned port, bool telnet)
+{
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons((uint16_t) port),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    socklen_t len = sizeof addr;
+
+    struct esh_server_conn * const conn = listen_on(server, AF_INET,
+            (struct sockaddr const *) &addr, len);
+    if (!conn) {
+        return -1;
+    }
+    conn->telnet = telnet;
+
+    if (getsockname(conn->fd, (struct sockaddr *) &addr, &len) < 0) {
+        return -1;
+    }
+    return ntohs(addr.sin_port);
+}
+
+
+/**
+ * Put a session on the dying list, to be closed at the end of the round, once
+ * nothing else can be looking at it.
+ */
+static void hangup(struct esh_server_conn * conn)
+{
+    if (!conn->hangup) {
+        conn->hangup = true;
+        conn->next_dying = conn->server->dying;
+        conn->server->dying = conn;
+    }
+}
+
+
+void esh_server_hangup(esh_t * esh)
+{
+    esh_posix_t * const port = ESH_INSTANCE->cb_print_arg;
+
+    hangup(port->owner);
+}
+
+
+/**
+ * Close every session on the dying list and free its instance.
+ */
+static void reap(esh_server_t * server)
+{
+    while (server->dying) {
+        struct esh_server_conn * const conn = server->dying;
+
+        server->dying = conn->next_dying;
+        server->cb(conn->esh, false, server->arg);
+        esh_posix_close(conn->port);
+        esh_free(conn->esh);
+        remove_conn(conn, &server->list);
+        --server->sessions;
+    }
+}
+
+
+/**
+ * Write out what a session has buffered. What doesn't fit in the socket
+ * waits for EPOLLOUT.
+ */
+static void flush(struct esh_server_conn * conn)
+{
+    esh_posix_flush(conn->port);
+    if (conn->port->failed) {
+        hangup(conn);
+        return;
+    }
+
+    bool const want_out = conn->port->out_cnt != 0;
+    if (want_out != conn->want_out) {
+        struct epoll_event ev = {
+            .events = want_out ? EPOLLIN | EPOLLOUT : EPOLLIN,
+            .data.ptr = conn,
+        };
+        epoll_ctl(conn->server->epfd, EPOLL_CTL_MOD, conn->fd, &ev);
+        conn->want_out = want_out;
+    }
+}
+
+
+/**
+ * Start a session on an accepted socket.
+ */
+static void open_session(esh_server_t * server, int fd, bool telnet)
+{
+    if (server->sessions >= ESH_SERVER_SESSIONS) {
+        close(fd);
+        return;
+    }
+
+    esh_t * const esh = esh_init();
+    esh_posix_t * const port = esh ? esh_posix_open(esh, fd, fd) : NULL;
+    struct esh_server_conn * const conn = port
+        ? add_conn(server, fd, &server->list) : NULL;
+
+    if (!conn) {
+        if (port) {
+            esh_posix_close(port);
+        } else {
+            close(fd);
+        }
+        if (esh) {
+            esh_free(esh);
+        }
+        return;
+    }
+
+    ++server->sessions;
+    conn->esh = esh;
+    conn->port = port;
+    conn->telnet = telnet;
+    port->owner = conn;
+    port->nonblock = true;
+    port->telnet = telnet;
+
+    if (telnet) {
+        esh_posix_send(port, (char const *) negotiation, sizeof negotiation);
+    }
+    server->cb(esh, true, server->arg);
+    esh_print_prompt(esh);
+    flush(conn);
+}
+
+
+/**
+ * Accept everything waiting on a listening socket.
+ */
+static void accept_all(esh_server_t * server, struct esh_server_conn * lis)
+{
+    for (;;) {
+        int const fd = accept4(lis->fd, NULL, NULL,
+                SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+        if (fd >= 0) {
+            open_session(server, fd, lis->telnet);
+        } else if (errno != EINTR && errno != ECONNABORTED) {
+            // EAGAIN: all taken. Anything else (out of descriptors), try
+            // again next round.
+            break;
+        }
+    }
+}
+
+
+/**
+ * Answer a client asking to turn on an option we don't do.
+ */
+static void refuse(struct esh_server_conn * conn, uint8_t verb, uint8_t opt)
+{
+    if ((verb == DO && opt != OPT_ECHO && opt != OPT_SGA)
+            || (verb == WILL && opt != OPT_NAWS && opt != OPT_SGA)) {
+        char const reply[] = {
+            (char) IAC, (char) (verb == DO ? WONT : DONT), (char) opt,
+        };
+        esh_posix_send(conn->port, reply, sizeof reply);
+    }
+}
+
+
+/**
+ * Take telnet commands out of received bytes, in place, acting on them.
+ * @return number of data bytes left
+ */
+static size_t telnet_rx(struct esh_server_conn * conn, char * buf, size_t len)
+{
+    size_t n = 0;
+
+    for (size_t i = 0; i < len; ++i) {
+        uint8_t const c = (uint8_t) buf[i];
+
+        switch (conn->tn_state) {
+        case TN_DATA:
+            if (c == IAC) {
+                conn->tn_state = TN_IAC;
+            } else {
+                buf[n++] = (char) c;
+            }
+            break;
+
+        case TN_IAC:
+            if (c == IAC) {
+                buf[n++] = (char) c;
+                conn->tn_state = TN_DATA;
+            } else if (c >= WILL && c <= DONT) {
+                conn->tn_verb = c;
+                conn->tn_state = TN_OPTION;
+            } else if (c == SB) {
+                conn->sb_len = 0;
+                conn->tn_state = TN_SB;
+            } else {
+                // Two-byte commands: NOP, break, are-you-there...
+                conn->tn_state = TN_DATA;
+            }
+            break;
+
+        case TN_OPTION:
+            refuse(conn, conn->tn_verb, c);
+            conn->tn_state = TN_DATA;
+            break;
+
+        case TN_SB:
+            if (c == IAC) {
+                conn->tn_state = TN_SB_IAC;
+            } else if (conn->sb_len < sizeof conn->sb) {
+                conn->sb[conn->sb_len++] = c;
+            }
+            break;
+
+        case TN_SB_IAC:
+            if (c == IAC) {
+                if (conn->sb_len < sizeof conn->sb) {
+                    conn->sb[conn->sb_len++] = c;
+                }
+                conn->tn_state = TN_SB;
+                break;
+            }
+            if (c == SE && conn->sb_len == sizeof conn->sb
+                    && conn->sb[0] == OPT_NAWS) {
+                unsigned const width =
+                    (unsigned) conn->sb[1] << 8 | conn->sb[2];
+                if (width) {
+                    esh_set_width(conn->esh, width);
+                }
+            }
+            conn->tn_state = TN_DATA;
+            break;
+        }
+    }
+    return n;
+}
+
+
+/**
+ * Handle a wakeup on a session: read what has come in, a few blocks at most,
+ * hand it to esh, and write out the replies together.
+ */
+static void session_event(esh_server_t * server, struct esh_server_conn * conn,
+        uint32_t events)
+{
+    if (events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+        for (int i = 0; i < READS && !conn->hangup; ++i) {
+            ssize_t const n = read(conn->fd, server->buf, sizeof server->buf);
+
+            if (n > 0) {
+                size_t const len = conn->telnet
+                    ? telnet_rx(conn, server->buf, (size_t) n) : (size_t) n;
+                esh_posix_rx(conn->port, server->buf, len);
+                if ((size_t) n < sizeof server->buf) {
+                    break;
+                }
+            } else if (n == 0) {
+                hangup(conn);
+            } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            } else if (errno != EINTR) {
+                hangup(conn);
+            }
+        }
+    }
+    // Even when hanging up, the client may have shut down only its own side,
+    // and still be waiting for the replies.
+    flush(conn);
+}
+
+
+int esh_server_run(esh_server_t * server, int timeout)
+{
+    struct epoll_event events[EVENTS];
+    int const n = epoll_wait(server->epfd, events, EVENTS, timeout);
+
+    if (n < 0) {
+        return errno == EINTR ? 0 : -1;
+    }
+
+    for (int i = 0; i < n; ++i) {
+        struct esh_server_conn * const conn = events[i].data.ptr;
+
+        if (!conn->esh) {
+            accept_all(server, conn);
+        } else if (!conn->hangup) {
+            session_event(server, conn, events[i].events);
+        }
+    }
+    reap(server);
+    return n;
+}
+
+
+void esh_server_foreach(esh_server_t * server,
+        void (*fn)(esh_t * esh, void * arg), void * arg)
+{
+    for (struct esh_server_conn * conn = server->list; conn;
+            conn = conn->next) {
+        if (!conn->hangup) {
+            fn(conn->esh, arg);
+            flush(conn);
+        }
+    }
+    reap(server);
+}
+
+
+int esh_server_fd(esh_server_t * server)
+{
+    return server->epfd;
+}
+
+
+size_t esh_server_sessions(esh_server_t * server)
+{
+    return server->sessions;
+}
+
+
+void esh_server_close(esh_server_t * server)
+{
+    for (struct esh_server_conn * conn = server->list; conn;
+            conn = conn->next) {
+        hangup(conn);
+    }
+    reap(server);
+
+    while (server->listeners) {
+        if (server->listeners->path) {
+            unlink(server->listeners->path);
+        }
+        remove_conn(server->listeners, &server->listeners);
+    }
+    close(server->epfd);
+    free(server);
+}
+
+#endif // ESH_SERVER
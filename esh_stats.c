@@ -0,0 +1,88 @@
+/*
+ * esh - embedded shell
+ * Copyright (C) 2017 Chris Pavlina
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <esh.h>
+#define ESH_INTERNAL_INCLUDE
+#include <esh_internal.h>
+#include <string.h>
+
+#ifdef ESH_STATS
+// Begin actual counters implementation
+
+/**
+ * Print one line of esh-stats.
+ */
+static void put_counter(esh_t * esh, char const AVR_ONLY(__flash) * name,
+        unsigned long n)
+{
+    (void) esh;
+    esh_puts_flash(ESH_INSTANCE, name);
+    esh_putu(ESH_INSTANCE, n);
+    esh_putc(ESH_INSTANCE, '\n');
+}
+
+
+struct esh_stats const * esh_stats(esh_t * esh)
+{
+    (void) esh;
+    return &ESH_INSTANCE->stats;
+}
+
+
+void esh_stats_reset(esh_t * esh)
+{
+    (void) esh;
+    memset(&ESH_INSTANCE->stats, 0, sizeof ESH_INSTANCE->stats);
+}
+
+
+bool esh_stats_command(esh_t * esh, int argc, char ** argv, int * status)
+{
+    (void) esh;
+
+    if (strcmp(argv[0], "esh-stats")) {
+        return false;
+    }
+
+    if (argc == 2 && !strcmp(argv[1], "reset")) {
+        esh_stats_reset(ESH_INSTANCE);
+        *status = 0;
+        return true;
+    } else if (argc != 1) {
+        esh_puts_flash(ESH_INSTANCE, FSTR("usage: esh-stats [reset]\n"));
+        *status = 1;
+        return true;
+    }
+
+    // Take a copy first, so the counts don't include printing them.
+    struct esh_stats const stats = ESH_INSTANCE->stats;
+
+    put_counter(ESH_INSTANCE, FSTR("rx "), stats.rx);
+    put_counter(ESH_INSTANCE, FSTR("tx "), stats.tx);
+    put_counter(ESH_INSTANCE, FSTR("redraws "), stats.redraws);
+    put_counter(ESH_INSTANCE, FSTR("escapes "), stats.escapes);
+    put_counter(ESH_INSTANCE, FSTR("evictions "), stats.evictions);
+    put_counter(ESH_INSTANCE, FSTR("overflows "), stats.overflows);
+    put_counter(ESH_INSTANCE, FSTR("commands "), stats.commands);
+    *status = 0;
+    return true;
+}
+
+#endif // ESH_STATS
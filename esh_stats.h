@@ -0,0 +1,82 @@
+/*
+ * esh - embedded shell
+ * Copyright (C) 2017 Chris Pavlina
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef ESH_INTERNAL_INCLUDE
+#error "esh_stats.h is an internal header and should not be included by the user."
+#endif // ESH_INTERNAL_INCLUDE
+
+#ifndef ESH_STATS_H
+#define ESH_STATS_H
+
+#include <stdbool.h>
+
+/*
+ * esh runtime counters. The counters are bumped with ESH_STAT_ADD() and
+ * ESH_STAT_INC(), which compile to nothing when counters are not enabled in
+ * configuration, so the hot paths need not be conditionally compiled.
+ */
+
+struct esh;
+typedef struct esh esh_t;
+
+#ifdef ESH_STATS
+// Begin actual counters implementation
+
+/**
+ * Add n to one of the counters in struct esh_stats.
+ */
+#define ESH_STAT_ADD(esh, counter, n) ((esh)->stats.counter += (n))
+
+/**
+ * Run the esh-stats command, if that's what this is.
+ * @param esh - esh instance
+ * @param argc - number of arguments, including the command name
+ * @param argv - arguments
+ * @param status - exit status, if it was esh-stats
+ * @return true iff it was esh-stats
+ */
+bool esh_stats_command(esh_t * esh, int argc, char ** argv, int * status);
+
+#else // ESH_STATS
+// Begin placeholder implementation
+
+#define ESH_STAT_ADD(esh, counter, n) ((void) 0)
+
+#define INL static inline __attribute__((always_inline))
+
+INL bool esh_stats_command(esh_t * esh, int argc, char ** argv, int * status)
+{
+    (void) esh;
+    (void) argc;
+    (void) argv;
+    (void) status;
+    return false;
+}
+
+#undef INL
+
+#endif // ESH_STATS
+
+/**
+ * Add one to a counter.
+ */
+#define ESH_STAT_INC(esh, counter) ESH_STAT_ADD(esh, counter, 1)
+
+#endif // ESH_STATS_H
@@ -0,0 +1,235 @@
+/*
+ * esh - embedded shell
+ * Copyright (C) 2017 Chris Pavlina
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <esh.h>
+#define ESH_INTERNAL_INCLUDE
+#include <esh_internal.h>
+#include <string.h>
+
+#ifdef ESH_STATUSBAR
+// Begin actual status bar implementation
+
+#if !defined(ESH_STATUSBAR_LINES) || !defined(ESH_STATUSBAR_COLS) \
+        || !defined(ESH_STATUSBAR_TICKS)
+#   error "ESH_STATUSBAR requires ESH_STATUSBAR_LINES, _COLS and _TICKS"
+#endif
+
+#define ESC_SAVE_CURSOR     "\0337"
+#define ESC_RESTORE_CURSOR  "\0338"
+#define ESC_INDEX           "\33D"
+
+/**
+ * Send to the terminal directly, so that the bar is never caught by output
+ * filters, watch or RPC.
+ */
+static void emit(esh_t * esh, char c)
+{
+    (void) esh;
+    esh_do_print_callback(ESH_INSTANCE, c);
+}
+
+
+static void emit_str(esh_t * esh, char const * s)
+{
+    (void) esh;
+    while (*s) {
+        emit(ESH_INSTANCE, *s++);
+    }
+}
+
+
+static void emit_num(esh_t * esh, size_t n)
+{
+    (void) esh;
+    if (n >= 10) {
+        emit_num(ESH_INSTANCE, n / 10);
+    }
+    emit(ESH_INSTANCE, (char) ('0' + n % 10));
+}
+
+
+/**
+ * Move the cursor to a column (from zero) of a line of the bar.
+ */
+static void move(esh_t * esh, size_t line, size_t col)
+{
+    (void) esh;
+    emit_str(ESH_INSTANCE, ESC_CSI);
+    emit_num(ESH_INSTANCE,
+            ESH_INSTANCE->statusbar.rows - ESH_STATUSBAR_LINES + 1 + line);
+    emit(ESH_INSTANCE, ';');
+    emit_num(ESH_INSTANCE, col + 1);
+    emit(ESH_INSTANCE, 'H');
+}
+
+
+/**
+ * Redraw the part of a line of the bar that changed.
+ * @param saved - whether the cursor has been saved yet; it is saved before
+ *      the first change, so an update with no changes sends nothing
+ */
+static void draw_line(esh_t * esh, size_t line, bool * saved)
+{
+    (void) esh;
+    char const * text = ESH_INSTANCE->statusbar.text[line];
+    char * shown = ESH_INSTANCE->statusbar.shown[line];
+    size_t first, last, len;
+
+    for (first = 0; first < ESH_STATUSBAR_COLS && text[first] == shown[first];
+            ++first);
+    if (first == ESH_STATUSBAR_COLS) {
+        return;
+    }
+    for (last = ESH_STATUSBAR_COLS; text[last - 1] == shown[last - 1]; --last);
+    for (len = 0; len < ESH_STATUSBAR_COLS && text[len]; ++len);
+
+    if (!*saved) {
+        emit_str(ESH_INSTANCE, ESC_SAVE_CURSOR);
+        *saved = true;
+    }
+    move(ESH_INSTANCE, line, first);
+
+    // The text is NUL-padded; if the change reaches into the padding, erase
+    // to the end of the line rather than sending spaces.
+    for (size_t i = first; i < last && i < len; ++i) {
+        emit(ESH_INSTANCE, text[i]);
+    }
+    if (last > len) {
+        emit_str(ESH_INSTANCE, ESC_CSI "K");
+    }
+    memcpy(shown, text, ESH_STATUSBAR_COLS);
+}
+
+
+/**
+ * Send whatever changed since the last update.
+ */
+static void flush(esh_t * esh)
+{
+    (void) esh;
+    bool saved = false;
+
+    for (size_t i = 0; i < ESH_STATUSBAR_LINES; ++i) {
+        draw_line(ESH_INSTANCE, i, &saved);
+    }
+    if (saved) {
+        emit_str(ESH_INSTANCE, ESC_RESTORE_CURSOR);
+    }
+    ESH_INSTANCE->statusbar.dirty = false;
+    ESH_INSTANCE->statusbar.left = ESH_STATUSBAR_TICKS;
+}
+
+
+void esh_statusbar_setup(esh_t * esh, size_t rows)
+{
+    (void) esh;
+    struct esh_statusbar * sb = &ESH_INSTANCE->statusbar;
+
+    if (rows <= ESH_STATUSBAR_LINES) {
+        rows = 0;
+    }
+
+    if (sb->rows) {
+        // Give the whole screen back, and blank the old bar.
+        emit_str(ESH_INSTANCE, ESC_SAVE_CURSOR ESC_CSI "r");
+        for (size_t i = 0; i < ESH_STATUSBAR_LINES; ++i) {
+            move(ESH_INSTANCE, i, 0);
+            emit_str(ESH_INSTANCE, ESC_CSI "2K");
+        }
+        emit_str(ESH_INSTANCE, ESC_RESTORE_CURSOR);
+    }
+
+    sb->rows = rows;
+    if (!rows) {
+        return;
+    }
+
+    // Scroll up to make room, in case the cursor is on the lines about to
+    // become the bar. Index, unlike a newline, keeps the cursor's column, so
+    // a half-typed command is left as it was.
+    for (size_t i = 0; i < ESH_STATUSBAR_LINES; ++i) {
+        emit_str(ESH_INSTANCE, ESC_INDEX);
+    }
+    emit_str(ESH_INSTANCE, ESC_CSI);
+    emit_num(ESH_INSTANCE, ESH_STATUSBAR_LINES);
+    emit(ESH_INSTANCE, 'A');
+
+    // Setting the region homes the cursor, so save it around that.
+    emit_str(ESH_INSTANCE, ESC_SAVE_CURSOR ESC_CSI "1;");
+    emit_num(ESH_INSTANCE, rows - ESH_STATUSBAR_LINES);
+    emit(ESH_INSTANCE, 'r');
+    for (size_t i = 0; i < ESH_STATUSBAR_LINES; ++i) {
+        move(ESH_INSTANCE, i, 0);
+        emit_str(ESH_INSTANCE, ESC_CSI "2K");
+    }
+    emit_str(ESH_INSTANCE, ESC_RESTORE_CURSOR);
+
+    memset(sb->shown, 0, sizeof sb->shown);
+    flush(ESH_INSTANCE);
+}
+
+
+void esh_statusbar_set(esh_t * esh, size_t line, char const * text)
+{
+    (void) esh;
+    struct esh_statusbar * sb = &ESH_INSTANCE->statusbar;
+
+    if (line >= ESH_STATUSBAR_LINES) {
+        return;
+    }
+
+    // Control characters would move the cursor out of the bar.
+    size_t i;
+    for (i = 0; i < ESH_STATUSBAR_COLS && text[i]; ++i) {
+        sb->text[line][i] = ((unsigned char) text[i] < 0x20 || text[i] == 0x7f)
+            ? ' ' : text[i];
+    }
+    memset(&sb->text[line][i], 0, ESH_STATUSBAR_COLS - i);
+    sb->dirty = true;
+}
+
+
+void esh_statusbar_tick(esh_t * esh)
+{
+    (void) esh;
+    struct esh_statusbar * sb = &ESH_INSTANCE->statusbar;
+
+    if (sb->left) {
+        --sb->left;
+    }
+
+    // Anything sent during a binary transfer would corrupt it, so updates
+    // wait until it's over.
+    if (sb->rows && sb->dirty && !sb->left
+            && !esh_rx_binary(ESH_INSTANCE)) {
+        flush(ESH_INSTANCE);
+    }
+}
+
+
+void esh_statusbar_redraw(esh_t * esh)
+{
+    (void) esh;
+    memset(ESH_INSTANCE->statusbar.shown, 0xff,
+            sizeof ESH_INSTANCE->statusbar.shown);
+    ESH_INSTANCE->statusbar.dirty = true;
+}
+
+#endif // ESH_STATUSBAR
@@ -0,0 +1,49 @@
+/*
+ * esh - embedded shell
+ * Copyright (C) 2017 Chris Pavlina
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef ESH_INTERNAL_INCLUDE
+#error "esh_statusbar.h is an internal header and should not be included by the user."
+#endif // ESH_INTERNAL_INCLUDE
+
+#ifndef ESH_STATUSBAR_H
+#define ESH_STATUSBAR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * esh status bar: lines kept at the bottom of the terminal, below a scrolling
+ * region that the shell works in. The shell itself never needs to know about
+ * it, so there is no placeholder implementation.
+ */
+
+#ifdef ESH_STATUSBAR
+
+struct esh_statusbar {
+    size_t rows;            ///< Terminal height, or 0 when the bar is off
+    unsigned long left;     ///< Ticks until another update may be sent
+    bool dirty;             ///< .text differs from .shown
+    char text[ESH_STATUSBAR_LINES][ESH_STATUSBAR_COLS];     ///< Wanted
+    char shown[ESH_STATUSBAR_LINES][ESH_STATUSBAR_COLS];    ///< On screen
+};
+
+#endif // ESH_STATUSBAR
+
+#endif // ESH_STATUSBAR_H
@@ -0,0 +1,303 @@
+/*
+ * esh - embedded shell
+ * Copyright (C) 2017 Chris Pavlina
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <esh.h>
+#define ESH_INTERNAL_INCLUDE
+#include <esh_internal.h>
+#include <string.h>
+
+#ifdef ESH_TRACE
+// Begin actual tracing implementation
+
+void esh_trace_event(esh_t * esh, uint8_t kind, uint8_t arg)
+{
+    (void) esh;
+    struct esh_trace * const trace = &ESH_INSTANCE->trace;
+    struct esh_trace_event * const ev = &trace->ring[trace->head];
+
+    ev->time = ESH_TRACE_CLOCK();
+    ev->kind = kind;
+    ev->arg = arg;
+
+    if (++trace->head == ESH_TRACE_LEN) {
+        trace->head = 0;
+        trace->full = true;
+    }
+}
+
+
+/**
+ * Find the latency slot for a command, taking a free one if it has none. Once
+ * all but the last are taken, the last is shared by every other command.
+ */
+static uint8_t find_slot(esh_t * esh, char const * name)
+{
+    (void) esh;
+    struct esh_trace_slot * const slots = ESH_INSTANCE->trace.slots;
+    uint8_t i;
+
+    for (i = 0; i + 1 < ESH_TRACE_CMDS; ++i) {
+        if (!slots[i].name[0]) {
+            strncpy(slots[i].name, name, ESH_TRACE_NAME_LEN - 1);
+            return i;
+        } else if (!strncmp(slots[i].name, name, ESH_TRACE_NAME_LEN - 1)) {
+            return i;
+        }
+    }
+
+    strcpy(slots[i].name, "*");
+    return i;
+}
+
+
+struct esh_trace_mark esh_trace_command_begin(esh_t * esh, char const * name)
+{
+    (void) esh;
+    struct esh_trace_mark mark;
+
+    mark.slot = find_slot(ESH_INSTANCE, name);
+    esh_trace_event(ESH_INSTANCE, ESH_TRACE_COMMAND, mark.slot);
+    // Event first, so the time of the event itself isn't counted.
+    mark.time = ESH_TRACE_CLOCK();
+    return mark;
+}
+
+
+void esh_trace_command_end(esh_t * esh, struct esh_trace_mark const * mark)
+{
+    (void) esh;
+    uint32_t const t = ESH_TRACE_CLOCK() - mark->time;
+    struct esh_trace_slot * const slot = &ESH_INSTANCE->trace.slots[mark->slot];
+    uint8_t bucket = 0;
+
+    if (!slot->name[0]) {
+        // Reset while it ran
+        return;
+    }
+
+    esh_trace_event(ESH_INSTANCE,
+            ESH_TRACE_COMMAND | ESH_TRACE_END_FLAG, mark->slot);
+
+    if (!slot->count || t < slot->min) {
+        slot->min = t;
+    }
+    if (t > slot->max) {
+        slot->max = t;
+    }
+    ++slot->count;
+
+    for (uint32_t i = t; i; i >>= 1) {
+        ++bucket;
+    }
+
+    if (slot->buckets[bucket] == UINT16_MAX) {
+        // Halve them all, rather than saturating one, so the shape of the
+        // histogram holds. Round up so no bucket drops to empty.
+        for (uint8_t i = 0; i < ESH_TRACE_BUCKETS; ++i) {
+            slot->buckets[i] = (slot->buckets[i] + 1) / 2;
+        }
+    }
+    ++slot->buckets[bucket];
+}
+
+
+/**
+ * Return the time below which at least pct percent of the runs counted in a
+ * slot took, rounded up to the top of the bucket it falls in.
+ */
+static uint32_t percentile(struct esh_trace_slot const * slot, unsigned pct)
+{
+    unsigned long total = 0;
+    unsigned long seen = 0;
+    uint8_t i;
+
+    for (i = 0; i < ESH_TRACE_BUCKETS; ++i) {
+        total += slot->buckets[i];
+    }
+
+    unsigned long const want = (total * pct + 99) / 100;
+
+    for (i = 0; i < ESH_TRACE_BUCKETS - 1; ++i) {
+        seen += slot->buckets[i];
+        if (seen >= want) {
+            break;
+        }
+    }
+
+    // Bucket i holds times of i bits: up to 2^i - 1.
+    uint32_t const top = i < 32 ? ((uint32_t) 1 << i) - 1 : UINT32_MAX;
+
+    if (top < slot->min) {
+        return slot->min;
+    } else if (top > slot->max) {
+        return slot->max;
+    } else {
+        return top;
+    }
+}
+
+
+bool esh_trace_latency(esh_t * esh, size_t i, struct esh_latency * lat)
+{
+    (void) esh;
+    if (i >= ESH_TRACE_CMDS || !ESH_INSTANCE->trace.slots[i].name[0]) {
+        return false;
+    }
+
+    struct esh_trace_slot const * const slot = &ESH_INSTANCE->trace.slots[i];
+
+    lat->name = slot->name;
+    lat->count = slot->count;
+    lat->min = slot->min;
+    lat->p50 = percentile(slot, 50);
+    lat->p99 = percentile(slot, 99);
+    lat->max = slot->max;
+    return true;
+}
+
+
+void esh_trace_reset(esh_t * esh)
+{
+    (void) esh;
+    memset(&ESH_INSTANCE->trace, 0, sizeof ESH_INSTANCE->trace);
+}
+
+
+/**
+ * Print a number after a label.
+ */
+static void put_field(esh_t * esh, char const AVR_ONLY(__flash) * label,
+        unsigned long n)
+{
+    (void) esh;
+    esh_puts_flash(ESH_INSTANCE, label);
+    esh_putu(ESH_INSTANCE, n);
+}
+
+
+/**
+ * Print the latency table, one line per command.
+ */
+static void print_latency(esh_t * esh)
+{
+    (void) esh;
+    struct esh_latency lat;
+
+    for (size_t i = 0; esh_trace_latency(ESH_INSTANCE, i, &lat); ++i) {
+        if (!lat.count) {
+            // First run of esh-trace itself, still going
+            continue;
+        }
+        esh_puts(ESH_INSTANCE, lat.name);
+        put_field(ESH_INSTANCE, FSTR(" n="), lat.count);
+        put_field(ESH_INSTANCE, FSTR(" min="), lat.min);
+        put_field(ESH_INSTANCE, FSTR(" p50="), lat.p50);
+        put_field(ESH_INSTANCE, FSTR(" p99="), lat.p99);
+        put_field(ESH_INSTANCE, FSTR(" max="), lat.max);
+        esh_putc(ESH_INSTANCE, '\n');
+    }
+}
+
+
+/**
+ * Print one event of the dump: time, B or E, kind and argument.
+ */
+static void print_event(esh_t * esh, struct esh_trace_event const * ev)
+{
+    (void) esh;
+    uint8_t const kind = ev->kind & ~ESH_TRACE_END_FLAG;
+
+    esh_putu(ESH_INSTANCE, ev->time);
+    esh_puts_flash(ESH_INSTANCE,
+            (ev->kind & ESH_TRACE_END_FLAG) ? FSTR(" E ") : FSTR(" B "));
+
+    switch (kind) {
+    case ESH_TRACE_COMMAND:
+        esh_puts_flash(ESH_INSTANCE, FSTR("command "));
+        esh_puts(ESH_INSTANCE, ESH_INSTANCE->trace.slots[ev->arg].name);
+        break;
+    case ESH_TRACE_INPUT:
+        put_field(ESH_INSTANCE, FSTR("input "), ev->arg);
+        break;
+    case ESH_TRACE_REDRAW:
+        esh_puts_flash(ESH_INSTANCE, FSTR("redraw"));
+        break;
+    case ESH_TRACE_HIST_ADD:
+        esh_puts_flash(ESH_INSTANCE, FSTR("hist-add"));
+        break;
+    case ESH_TRACE_HIST_FIND:
+        esh_puts_flash(ESH_INSTANCE, FSTR("hist-find"));
+        break;
+    case ESH_TRACE_HIST_PRINT:
+        esh_puts_flash(ESH_INSTANCE, FSTR("hist-print"));
+        break;
+    default:
+        put_field(ESH_INSTANCE, FSTR("kind-"), kind);
+    }
+    esh_putc(ESH_INSTANCE, '\n');
+}
+
+
+/**
+ * Print the ring, oldest event first. Printing logs nothing, so the ring holds
+ * still while this runs.
+ */
+static void print_dump(esh_t * esh)
+{
+    (void) esh;
+    struct esh_trace const * const trace = &ESH_INSTANCE->trace;
+    size_t i = trace->full ? trace->head : 0;
+    size_t n = trace->full ? ESH_TRACE_LEN : trace->head;
+
+    put_field(ESH_INSTANCE, FSTR("esh-trace dump "), n);
+    esh_putc(ESH_INSTANCE, '\n');
+
+    for (; n; --n) {
+        print_event(ESH_INSTANCE, &trace->ring[i]);
+        if (++i == ESH_TRACE_LEN) {
+            i = 0;
+        }
+    }
+}
+
+
+bool esh_trace_command(esh_t * esh, int argc, char ** argv, int * status)
+{
+    (void) esh;
+
+    if (strcmp(argv[0], "esh-trace")) {
+        return false;
+    }
+
+    *status = 0;
+    if (argc == 1) {
+        print_latency(ESH_INSTANCE);
+    } else if (argc == 2 && !strcmp(argv[1], "dump")) {
+        print_dump(ESH_INSTANCE);
+    } else if (argc == 2 && !strcmp(argv[1], "reset")) {
+        esh_trace_reset(ESH_INSTANCE);
+    } else {
+        esh_puts_flash(ESH_INSTANCE, FSTR("usage: esh-trace [dump|reset]\n"));
+        *status = 1;
+    }
+    return true;
+}
+
+#endif // ESH_TRACE
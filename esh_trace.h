@@ -0,0 +1,183 @@
+/*
+ * esh - embedded shell
+ * Copyright (C) 2017 Chris Pavlina
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef ESH_INTERNAL_INCLUDE
+#error "esh_trace.h is an internal header and should not be included by the user."
+#endif // ESH_INTERNAL_INCLUDE
+
+#ifndef ESH_TRACE_H
+#define ESH_TRACE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <inttypes.h>
+
+/*
+ * esh tracing: timestamped begin and end events for commands, line redraws,
+ * history and input, kept in a ring for `esh-trace dump`, and a latency
+ * histogram per command. Events are logged with ESH_TRACE_BEGIN() and
+ * ESH_TRACE_END(), which compile to nothing when tracing is not enabled in
+ * configuration.
+ */
+
+struct esh;
+typedef struct esh esh_t;
+
+/**
+ * What an event is the beginning or end of.
+ */
+enum esh_trace_kind {
+    ESH_TRACE_COMMAND,      ///< A command; the argument is its latency slot
+    ESH_TRACE_INPUT,        ///< One byte through the line editor; the byte
+    ESH_TRACE_REDRAW,       ///< Redrawing the whole line
+    ESH_TRACE_HIST_ADD,     ///< Adding a command to history
+    ESH_TRACE_HIST_FIND,    ///< Finding an entry in history
+    ESH_TRACE_HIST_PRINT,   ///< Printing an entry from history
+};
+
+/// Set in the kind of an event that ends a span
+#define ESH_TRACE_END_FLAG 0x80
+
+/// Longest command name kept for the latency table, including the NUL
+#define ESH_TRACE_NAME_LEN 12
+
+/// Latency histogram buckets: one for each bit length of a 32-bit time
+#define ESH_TRACE_BUCKETS 33
+
+#ifdef ESH_TRACE
+// Begin actual tracing implementation
+
+#if ESH_TRACE_CMDS < 1 || ESH_TRACE_CMDS > 255
+#error "ESH_TRACE_CMDS must be from 1 to 255"
+#endif
+
+/**
+ * Return the time now, in ticks of any clock that counts up and wraps at
+ * 2^32 - a cycle counter, or a microsecond timer.
+ */
+uint32_t ESH_TRACE_CLOCK(void);
+
+struct esh_trace_event {
+    uint32_t time;                      ///< ESH_TRACE_CLOCK() when logged
+    uint8_t kind;                       ///< enum esh_trace_kind, and END_FLAG
+    uint8_t arg;                        ///< Depends on the kind
+};
+
+struct esh_trace_slot {
+    char name[ESH_TRACE_NAME_LEN];      ///< Command, empty if slot is free
+    unsigned long count;                ///< Times it has run
+    uint32_t min, max;                  ///< Fastest and slowest run
+    uint16_t buckets[ESH_TRACE_BUCKETS];    ///< Runs by bit length of time
+};
+
+struct esh_trace {
+    struct esh_trace_event ring[ESH_TRACE_LEN];
+    size_t head;                        ///< Where the next event goes
+    bool full;                          ///< The ring has wrapped
+    struct esh_trace_slot slots[ESH_TRACE_CMDS];
+};
+
+/**
+ * Where a command began, from esh_trace_command_begin().
+ */
+struct esh_trace_mark {
+    uint32_t time;
+    uint8_t slot;
+};
+
+/**
+ * Log one event.
+ * @param esh - esh instance
+ * @param kind - enum esh_trace_kind, with ESH_TRACE_END_FLAG if it ends a span
+ * @param arg - depends on the kind
+ */
+void esh_trace_event(esh_t * esh, uint8_t kind, uint8_t arg);
+
+/**
+ * Log the start of a command.
+ * @param esh - esh instance
+ * @param name - command name
+ * @return mark to pass to esh_trace_command_end() when it returns
+ */
+struct esh_trace_mark esh_trace_command_begin(esh_t * esh, char const * name);
+
+/**
+ * Log the end of a command and add its run time to its histogram.
+ * @param esh - esh instance
+ * @param mark - from esh_trace_command_begin()
+ */
+void esh_trace_command_end(esh_t * esh, struct esh_trace_mark const * mark);
+
+/**
+ * Run the esh-trace command, if that's what this is.
+ * @param esh - esh instance
+ * @param argc - number of arguments, including the command name
+ * @param argv - arguments
+ * @param status - exit status, if it was esh-trace
+ * @return true iff it was esh-trace
+ */
+bool esh_trace_command(esh_t * esh, int argc, char ** argv, int * status);
+
+#define ESH_TRACE_BEGIN(esh, kind, arg) esh_trace_event((esh), (kind), (arg))
+#define ESH_TRACE_END(esh, kind, arg) \
+    esh_trace_event((esh), (kind) | ESH_TRACE_END_FLAG, (arg))
+
+#else // ESH_TRACE
+// Begin placeholder implementation
+
+struct esh_trace_mark {
+    char unused;
+};
+
+#define ESH_TRACE_BEGIN(esh, kind, arg) ((void) 0)
+#define ESH_TRACE_END(esh, kind, arg) ((void) 0)
+
+#define INL static inline __attribute__((always_inline))
+
+INL struct esh_trace_mark esh_trace_command_begin(esh_t * esh,
+        char const * name)
+{
+    (void) esh;
+    (void) name;
+    struct esh_trace_mark const mark = { 0 };
+    return mark;
+}
+
+INL void esh_trace_command_end(esh_t * esh,
+        struct esh_trace_mark const * mark)
+{
+    (void) esh;
+    (void) mark;
+}
+
+INL bool esh_trace_command(esh_t * esh, int argc, char ** argv, int * status)
+{
+    (void) esh;
+    (void) argc;
+    (void) argv;
+    (void) status;
+    return false;
+}
+
+#undef INL
+
+#endif // ESH_TRACE
+
+#endif // ESH_TRACE_H
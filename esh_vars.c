@@ -0,0 +1,257 @@
+/*
+ * esh - embedded shell
+ * Copyright (C) 2017 Chris Pavlina
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <esh.h>
+#define ESH_INTERNAL_INCLUDE
+#include <esh_internal.h>
+#include <ctype.h>
+#include <string.h>
+
+#ifdef ESH_VARS
+// Begin actual variables implementation
+
+#if !defined(ESH_VARS_LEN) || !defined(ESH_VARS_SLOTS)
+#   error "ESH_VARS requires ESH_VARS_LEN and ESH_VARS_SLOTS to be defined"
+#endif
+
+#if ESH_VARS_SLOTS < 2 || (ESH_VARS_SLOTS & (ESH_VARS_SLOTS - 1))
+#   error "ESH_VARS_SLOTS must be a power of two"
+#endif
+
+#if ESH_VARS_LEN > UINT16_MAX - 1
+#   error "ESH_VARS_LEN must be less than 65535"
+#endif
+
+#define SLOT_MASK (ESH_VARS_SLOTS - 1)
+
+
+/**
+ * Hash a name onto its home slot.
+ */
+static size_t hash(char const * name, size_t len)
+{
+    uint16_t h = 5381;
+
+    while (len--) {
+        h = (h << 5) + h + (uint8_t) *name++;
+    }
+    return h & SLOT_MASK;
+}
+
+
+/**
+ * Return the entry a slot points to.
+ */
+static char * entry(esh_t * esh, size_t slot)
+{
+    (void) esh;
+    return &ESH_INSTANCE->vars.arena[ESH_INSTANCE->vars.index[slot] - 1];
+}
+
+
+/**
+ * Return the size of an entry, including both terminators.
+ */
+static size_t entry_size(char const * e)
+{
+    size_t const name_len = strlen(e) + 1;
+    return name_len + strlen(e + name_len) + 1;
+}
+
+
+/**
+ * Find the slot holding a name, or if it isn't there, the free slot where it
+ * would go. One slot is always kept free, so this terminates.
+ */
+static size_t find(esh_t * esh, char const * name, size_t len)
+{
+    (void) esh;
+    size_t slot = hash(name, len);
+
+    while (ESH_INSTANCE->vars.index[slot]) {
+        char const * e = entry(ESH_INSTANCE, slot);
+        if (!strncmp(e, name, len) && !e[len]) {
+            break;
+        }
+        slot = (slot + 1) & SLOT_MASK;
+    }
+    return slot;
+}
+
+
+/**
+ * Remove the variable in a slot, closing the gap in both the arena and the
+ * probe sequence.
+ */
+static void remove_slot(esh_t * esh, size_t slot)
+{
+    (void) esh;
+    struct esh_vars * vars = &ESH_INSTANCE->vars;
+    uint16_t const offset = vars->index[slot];
+    char * e = entry(ESH_INSTANCE, slot);
+    size_t const size = entry_size(e);
+
+    memmove(e, e + size, vars->used - (offset - 1) - size);
+    vars->used -= size;
+    for (size_t i = 0; i < ESH_VARS_SLOTS; ++i) {
+        if (vars->index[i] > offset) {
+            vars->index[i] -= size;
+        }
+    }
+
+    // Shift back any later entries of the same probe run that could no
+    // longer be found across the hole.
+    vars->index[slot] = 0;
+    for (size_t i = (slot + 1) & SLOT_MASK; vars->index[i];
+            i = (i + 1) & SLOT_MASK) {
+        char const * name = entry(ESH_INSTANCE, i);
+        size_t const home = hash(name, strlen(name));
+
+        if (((i - home) & SLOT_MASK) >= ((i - slot) & SLOT_MASK)) {
+            vars->index[slot] = vars->index[i];
+            vars->index[i] = 0;
+            slot = i;
+        }
+    }
+}
+
+
+/**
+ * Return whether a string is a valid variable name.
+ */
+static bool valid_name(char const * name)
+{
+    if (!isalpha((unsigned char) *name) && *name != '_') {
+        return false;
+    }
+    while (*++name) {
+        if (!isalnum((unsigned char) *name) && *name != '_') {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+char const * esh_vars_get(esh_t * esh, char const * name, size_t len)
+{
+    (void) esh;
+    size_t const slot = find(ESH_INSTANCE, name, len);
+
+    if (ESH_INSTANCE->vars.index[slot]) {
+        char const * e = entry(ESH_INSTANCE, slot);
+        return e + len + 1;
+    } else {
+        return NULL;
+    }
+}
+
+
+char const * esh_get_var(esh_t * esh, char const * name)
+{
+    return esh_vars_get(esh, name, strlen(name));
+}
+
+
+bool esh_set_var(esh_t * esh, char const * name, char const * value)
+{
+    (void) esh;
+    struct esh_vars * vars = &ESH_INSTANCE->vars;
+
+    if (!valid_name(name)) {
+        return false;
+    }
+
+    size_t const name_len = strlen(name);
+    size_t slot = find(ESH_INSTANCE, name, name_len);
+    size_t const old_size =
+        vars->index[slot] ? entry_size(entry(ESH_INSTANCE, slot)) : 0;
+    size_t const value_len = value ? strlen(value) : 0;
+    size_t const new_size = name_len + value_len + 2;
+
+    if (value && !old_size) {
+        size_t n_set = 0;
+        for (size_t i = 0; i < ESH_VARS_SLOTS; ++i) {
+            n_set += !!vars->index[i];
+        }
+        if (n_set == ESH_VARS_SLOTS - 1) {
+            return false;
+        }
+    }
+
+    if (value && vars->used - old_size + new_size > ESH_VARS_LEN) {
+        // Leave the old value alone rather than losing it.
+        return false;
+    }
+
+    if (old_size) {
+        remove_slot(ESH_INSTANCE, slot);
+        slot = find(ESH_INSTANCE, name, name_len);
+    }
+
+    if (value) {
+        char * e = &vars->arena[vars->used];
+        memcpy(e, name, name_len + 1);
+        memcpy(e + name_len + 1, value, value_len + 1);
+        vars->index[slot] = vars->used + 1;
+        vars->used += new_size;
+    }
+    return true;
+}
+
+
+bool esh_vars_command(esh_t * esh, int argc, char ** argv, int * status)
+{
+    (void) esh;
+    bool const set = !strcmp(argv[0], "set");
+
+    if (!set && strcmp(argv[0], "unset")) {
+        return false;
+    }
+
+    *status = 0;
+
+    if (set && argc == 1) {
+        // List them all, in the order they were set.
+        for (size_t i = 0; i < ESH_INSTANCE->vars.used; ) {
+            char const * e = &ESH_INSTANCE->vars.arena[i];
+            esh_puts(ESH_INSTANCE, e);
+            esh_putc(ESH_INSTANCE, '=');
+            esh_puts(ESH_INSTANCE, e + strlen(e) + 1);
+            esh_putc(ESH_INSTANCE, '\n');
+            i += entry_size(e);
+        }
+    } else if (argc != 2 && !(set && argc == 3)) {
+        esh_puts_flash(ESH_INSTANCE,
+                FSTR("usage: set [NAME [VALUE]], unset NAME\n"));
+        *status = 1;
+    } else if (!valid_name(argv[1])) {
+        esh_puts_flash(ESH_INSTANCE, FSTR("esh: bad variable name\n"));
+        *status = 1;
+    } else if (!esh_set_var(ESH_INSTANCE, argv[1],
+                set ? (argc == 3 ? argv[2] : "") : NULL)) {
+        esh_puts_flash(ESH_INSTANCE, FSTR("esh: out of variable space\n"));
+        *status = 1;
+    }
+
+    return true;
+}
+
+#endif // ESH_VARS
@@ -0,0 +1,88 @@
+/*
+ * esh - embedded shell
+ * Copyright (C) 2017 Chris Pavlina
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef ESH_INTERNAL_INCLUDE
+#error "esh_vars.h is an internal header and should not be included by the user."
+#endif // ESH_INTERNAL_INCLUDE
+
+#ifndef ESH_VARS_H
+#define ESH_VARS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <inttypes.h>
+
+/*
+ * esh variables: `set NAME value` and `$NAME`. Variables are kept in a fixed
+ * arena, found through a small open-addressing hash index. When not enabled
+ * in configuration, a placeholder implementation is provided so the main esh
+ * code need not be conditionally compiled.
+ */
+
+struct esh;
+typedef struct esh esh_t;
+
+#ifdef ESH_VARS
+// Begin actual variables implementation
+
+struct esh_vars {
+    uint16_t used;                      ///< Bytes of .arena in use
+    uint16_t index[ESH_VARS_SLOTS];     ///< Offset + 1 of entries, 0 if free
+    char arena[ESH_VARS_LEN];           ///< Entries, each "NAME\0value\0"
+};
+
+/**
+ * Look up a variable by a name that need not be NUL-terminated.
+ * @param esh - esh instance
+ * @param name - variable name
+ * @param len - length of name
+ * @return the value, or NULL if the variable is not set
+ */
+char const * esh_vars_get(esh_t * esh, char const * name, size_t len);
+
+/**
+ * Run the set and unset commands, if that's what this is.
+ * @param esh - esh instance
+ * @param argc - number of arguments, including the command name
+ * @param argv - arguments
+ * @param status - exit status, if it was a variable command
+ * @return true iff it was a variable command
+ */
+bool esh_vars_command(esh_t * esh, int argc, char ** argv, int * status);
+
+#else // ESH_VARS
+// Begin placeholder implementation
+
+#define INL static inline __attribute__((always_inline))
+
+INL bool esh_vars_command(esh_t * esh, int argc, char ** argv, int * status)
+{
+    (void) esh;
+    (void) argc;
+    (void) argv;
+    (void) status;
+    return false;
+}
+
+#undef INL
+
+#endif // ESH_VARS
+
+#endif // ESH_VARS_H
@@ -0,0 +1,205 @@
+/*
+ * esh - embedded shell
+ * Copyright (C) 2017 Chris Pavlina
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <esh.h>
+#define ESH_INTERNAL_INCLUDE
+#include <esh_internal.h>
+
+#ifdef ESH_VIEWPORT
+// Begin actual viewport implementation
+
+#define PROMPT_LEN  (sizeof(ESH_PROMPT) - 1)
+
+/**
+ * Smallest window that still leaves room for both scroll markers and a
+ * visible insertion point between them.
+ */
+#define MIN_COLS    4
+
+/**
+ * Return whether the insertion point is on a column of the window that shows
+ * a real character, not a scroll marker.
+ */
+static bool ins_visible(esh_t * esh, size_t start)
+{
+    (void) esh;
+    size_t const cols = esh_viewport_cols(ESH_INSTANCE);
+
+    if (ESH_INSTANCE->ins < start) {
+        return false;
+    }
+
+    size_t const col = ESH_INSTANCE->ins - start;
+
+    if (start && col < 1) {
+        return false;
+    } else if (ESH_INSTANCE->cnt > start + cols) {
+        return col < cols - 1;
+    } else {
+        return col <= cols;
+    }
+}
+
+
+void esh_viewport_init(esh_t * esh)
+{
+    (void) esh;
+    ESH_INSTANCE->vp.width = ESH_TERM_WIDTH;
+    ESH_INSTANCE->vp.start = 0;
+    ESH_INSTANCE->vp.num = 0;
+    ESH_INSTANCE->vp.query = false;
+}
+
+
+size_t esh_viewport_cols(esh_t * esh)
+{
+    (void) esh;
+    // The last terminal column is left empty, so that the cursor sitting past
+    // the end of the line never triggers an autowrap.
+    if (ESH_INSTANCE->vp.width > PROMPT_LEN + MIN_COLS + 1) {
+        return ESH_INSTANCE->vp.width - PROMPT_LEN - 1;
+    } else {
+        return MIN_COLS;
+    }
+}
+
+
+bool esh_viewport_adjust(esh_t * esh)
+{
+    (void) esh;
+    size_t const cols = esh_viewport_cols(ESH_INSTANCE);
+    // A line too long for the window may leave half of it empty past the
+    // end, so that typing at the end has room to go before the next scroll.
+    size_t const max_start =
+        (ESH_INSTANCE->cnt > cols) ? ESH_INSTANCE->cnt + 1 - cols / 2 : 0;
+    size_t start = ESH_INSTANCE->vp.start;
+
+    if (start > max_start) {
+        start = max_start;
+    }
+
+    if (!ins_visible(ESH_INSTANCE, start)) {
+        // Recenter rather than scrolling by one, so that typing at the edge
+        // doesn't force a full redraw on every keystroke.
+        start = (ESH_INSTANCE->ins > cols / 2)
+            ? ESH_INSTANCE->ins - cols / 2 : 0;
+        if (start > max_start) {
+            start = max_start;
+        }
+    }
+
+    if (start != ESH_INSTANCE->vp.start) {
+        ESH_INSTANCE->vp.start = start;
+        return true;
+    } else {
+        return false;
+    }
+}
+
+
+bool esh_viewport_draw(esh_t * esh)
+{
+    (void) esh;
+    esh_viewport_adjust(ESH_INSTANCE);
+
+    size_t const cols = esh_viewport_cols(ESH_INSTANCE);
+    size_t const start = ESH_INSTANCE->vp.start;
+    bool const more = ESH_INSTANCE->cnt > start + cols;
+    size_t const end = more ? start + cols - 1 : ESH_INSTANCE->cnt;
+    size_t i = start;
+
+    if (start) {
+        esh_putc(ESH_INSTANCE, '<');
+        ++i;
+    }
+
+    for (; i < end; ++i) {
+        esh_putc(ESH_INSTANCE, ESH_INSTANCE->buffer[i]);
+    }
+
+    if (more) {
+        esh_putc(ESH_INSTANCE, '>');
+    }
+
+    esh_term_cursor_move(ESH_INSTANCE,
+            (int)(ESH_INSTANCE->ins - start) - (int)(end + more - start));
+    return true;
+}
+
+
+void esh_viewport_esc(esh_t * esh, char c)
+{
+    (void) esh;
+
+    if (c >= '0' && c <= '9') {
+        // Saturate rather than overflow on garbage
+        if (ESH_INSTANCE->vp.num < 10000) {
+            ESH_INSTANCE->vp.num = ESH_INSTANCE->vp.num * 10 + (c - '0');
+        }
+    } else if (c == ';') {
+        // A cursor position report is ESC [ row ; col R. Only the last
+        // parameter is kept.
+        ESH_INSTANCE->vp.num = 0;
+    } else {
+        // Shift-F3 looks exactly like a cursor position report on some
+        // terminals, so only accept one if it was asked for.
+        if (c == 'R' && ESH_INSTANCE->vp.query) {
+            ESH_INSTANCE->vp.query = false;
+            if (ESH_INSTANCE->vp.num) {
+                ESH_INSTANCE->vp.width = ESH_INSTANCE->vp.num;
+                esh_restore(ESH_INSTANCE);
+            }
+        }
+        ESH_INSTANCE->vp.num = 0;
+    }
+}
+
+
+void esh_set_width(esh_t * esh, size_t width)
+{
+    (void) esh;
+    ESH_INSTANCE->vp.width = width;
+}
+
+
+void esh_query_width(esh_t * esh)
+{
+    (void) esh;
+    ESH_INSTANCE->vp.query = true;
+    // Save cursor, move as far right as possible, ask where we ended up, and
+    // restore.
+    esh_puts_flash(ESH_INSTANCE,
+            FSTR("\0337" "\33[999C" "\33[6n" "\0338"));
+}
+
+#else // ESH_VIEWPORT
+
+void esh_set_width(esh_t * esh, size_t width)
+{
+    (void) esh;
+    (void) width;
+}
+
+
+void esh_query_width(esh_t * esh)
+{
+    (void) esh;
+}
+
+#endif // ESH_VIEWPORT
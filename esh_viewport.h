@@ -0,0 +1,132 @@
+/*
+ * esh - embedded shell
+ * Copyright (C) 2017 Chris Pavlina
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef ESH_INTERNAL_INCLUDE
+#error "esh_viewport.h is an internal header and should not be included by the user."
+#endif // ESH_INTERNAL_INCLUDE
+
+#ifndef ESH_VIEWPORT_H
+#define ESH_VIEWPORT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * esh horizontal scrolling support. When enabled, only a window of the edit
+ * buffer around the insertion point is drawn, so lines never wrap and every
+ * redraw costs at most one terminal width. When disabled, a placeholder
+ * implementation is provided so the main esh code need not be conditionally
+ * compiled.
+ */
+
+struct esh;
+typedef struct esh esh_t;
+
+#ifdef ESH_VIEWPORT
+// Begin actual viewport implementation
+
+#ifndef ESH_TERM_WIDTH
+#   error "ESH_VIEWPORT requires ESH_TERM_WIDTH to be defined"
+#endif
+
+struct esh_viewport {
+    size_t width;   ///< Terminal width in columns
+    size_t start;   ///< Index into .buffer of the first character displayed
+    size_t num;     ///< Numeric parameter accumulator for CPR parsing
+    bool query;     ///< A cursor position report has been requested
+};
+
+/**
+ * Initialize the viewport.
+ * @param esh - esh instance
+ */
+void esh_viewport_init(esh_t * esh);
+
+/**
+ * Return the number of columns available to display the buffer, not including
+ * the prompt.
+ * @param esh - esh instance
+ * @return column count, or 0 if the viewport is not enabled (unlimited)
+ */
+size_t esh_viewport_cols(esh_t * esh);
+
+/**
+ * Scroll the viewport if needed to keep the insertion point visible. This
+ * only updates state; it does not redraw.
+ * @param esh - esh instance
+ * @return true iff the viewport scrolled and the line must be redrawn
+ */
+bool esh_viewport_adjust(esh_t * esh);
+
+/**
+ * Draw the visible window of the buffer, with scroll markers, and position the
+ * terminal cursor at the insertion point. The prompt must already have been
+ * printed.
+ * @param esh - esh instance
+ * @return true iff the buffer was drawn (false if the viewport is disabled)
+ */
+bool esh_viewport_draw(esh_t * esh);
+
+/**
+ * Feed a character from inside a bracket escape sequence, to catch cursor
+ * position reports.
+ * @param esh - esh instance
+ * @param c - character received
+ */
+void esh_viewport_esc(esh_t * esh, char c);
+
+#else // ESH_VIEWPORT
+// Begin placeholder implementation
+
+#define INL static inline __attribute__((always_inline))
+
+INL void esh_viewport_init(esh_t * esh)
+{
+    (void) esh;
+}
+
+INL size_t esh_viewport_cols(esh_t * esh)
+{
+    (void) esh;
+    return 0;
+}
+
+INL bool esh_viewport_adjust(esh_t * esh)
+{
+    (void) esh;
+    return false;
+}
+
+INL bool esh_viewport_draw(esh_t * esh)
+{
+    (void) esh;
+    return false;
+}
+
+INL void esh_viewport_esc(esh_t * esh, char c)
+{
+    (void) esh;
+    (void) c;
+}
+
+#undef INL
+
+#endif // ESH_VIEWPORT
+
+#endif // ESH_VIEWPORT_H
@@ -0,0 +1,284 @@
+/*
+ * esh - embedded shell
+ * Copyright (C) 2017 Chris Pavlina
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <esh.h>
+#define ESH_INTERNAL_INCLUDE
+#include <esh_internal.h>
+#include <string.h>
+
+#ifdef ESH_WATCH
+// Begin actual watch implementation
+
+#if !defined(ESH_WATCH_ROWS) || !defined(ESH_WATCH_COLS)
+#   error "ESH_WATCH requires ESH_WATCH_ROWS and ESH_WATCH_COLS to be defined"
+#elif ESH_WATCH_ROWS < 1 || ESH_WATCH_ROWS > 254
+#   error "ESH_WATCH_ROWS must be from 1 to 254"
+#elif ESH_WATCH_COLS < 1 || ESH_WATCH_COLS > 254
+#   error "ESH_WATCH_COLS must be from 1 to 254"
+#endif
+
+/**
+ * Terminal row of the first row of output. The command is shown on row 1.
+ */
+#define FIRST_ROW   2
+
+/**
+ * Cursor position meaning "unknown", forcing the next move to be sent.
+ */
+#define NOWHERE     UINT8_MAX
+
+/**
+ * Send to the terminal, bypassing the capture.
+ */
+static void emit(esh_t * esh, char c)
+{
+    (void) esh;
+    esh_do_print_callback(ESH_INSTANCE, c);
+}
+
+
+static void emit_str(esh_t * esh, char const * s)
+{
+    (void) esh;
+    while (*s) {
+        emit(ESH_INSTANCE, *s++);
+    }
+}
+
+
+static void emit_num(esh_t * esh, unsigned long n)
+{
+    (void) esh;
+    if (n >= 10) {
+        emit_num(ESH_INSTANCE, n / 10);
+    }
+    emit(ESH_INSTANCE, (char) ('0' + n % 10));
+}
+
+
+/**
+ * Move the terminal cursor to a cell of the output, unless it is already
+ * there.
+ */
+static void move(esh_t * esh, uint8_t row, uint8_t col)
+{
+    (void) esh;
+    struct esh_watch * w = &ESH_INSTANCE->watch;
+
+    if (w->term_row == row && w->term_col == col) {
+        return;
+    }
+    emit_str(ESH_INSTANCE, ESC_CSI);
+    emit_num(ESH_INSTANCE, row + FIRST_ROW);
+    emit(ESH_INSTANCE, ';');
+    emit_num(ESH_INSTANCE, col + 1u);
+    emit(ESH_INSTANCE, 'H');
+    w->term_row = row;
+    w->term_col = col;
+}
+
+
+/**
+ * Put a character in the next cell, sending it only if the cell changed.
+ * Output past the edges of the screen is dropped.
+ */
+static void put_cell(esh_t * esh, char c)
+{
+    (void) esh;
+    struct esh_watch * w = &ESH_INSTANCE->watch;
+
+    if (w->row >= ESH_WATCH_ROWS || w->col >= ESH_WATCH_COLS) {
+        return;
+    }
+    if (w->col >= w->lens[w->row] || w->shown[w->row][w->col] != c) {
+        move(ESH_INSTANCE, w->row, w->col);
+        emit(ESH_INSTANCE, c);
+        ++w->term_col;
+        w->shown[w->row][w->col] = c;
+    }
+    ++w->col;
+}
+
+
+/**
+ * Finish the current row, erasing whatever the last run left past its end.
+ */
+static void end_row(esh_t * esh)
+{
+    (void) esh;
+    struct esh_watch * w = &ESH_INSTANCE->watch;
+
+    if (w->row < ESH_WATCH_ROWS) {
+        if (w->lens[w->row] > w->col) {
+            move(ESH_INSTANCE, w->row, w->col);
+            emit_str(ESH_INSTANCE, ESC_CSI "K");
+        }
+        w->lens[w->row] = w->col;
+        ++w->row;
+    }
+    w->col = 0;
+}
+
+
+/**
+ * Run the command once, updating the screen.
+ */
+static void run(esh_t * esh)
+{
+    (void) esh;
+    struct esh_watch * w = &ESH_INSTANCE->watch;
+
+    w->row = w->col = 0;
+    w->capturing = true;
+    esh_do_callback(ESH_INSTANCE, w->argc, w->argv);
+    w->capturing = false;
+
+    if (w->col) {
+        end_row(ESH_INSTANCE);
+    }
+
+    // Clear rows the last run used and this one didn't.
+    for (uint8_t row = w->row; row < w->rows; ++row) {
+        if (w->lens[row]) {
+            move(ESH_INSTANCE, row, 0);
+            emit_str(ESH_INSTANCE, ESC_CSI "K");
+            w->lens[row] = 0;
+        }
+    }
+    w->rows = w->row;
+
+    // Park the cursor below the output, where the prompt will go.
+    move(ESH_INSTANCE, w->rows, 0);
+}
+
+
+/**
+ * Parse a positive decimal number.
+ * @return 0 if s isn't one
+ */
+static unsigned long parse_interval(char const * s)
+{
+    unsigned long n = 0;
+
+    do {
+        if (*s < '0' || *s > '9' || n > 0xffffu) {
+            return 0;
+        }
+        n = n * 10 + (unsigned long) (*s - '0');
+    } while (*++s);
+    return n;
+}
+
+
+bool esh_watch_command(esh_t * esh, int argc, char ** argv, int * status)
+{
+    (void) esh;
+    struct esh_watch * w = &ESH_INSTANCE->watch;
+
+    if (strcmp(argv[0], "watch")) {
+        return false;
+    }
+
+    unsigned long const interval = (argc >= 3) ? parse_interval(argv[1]) : 0;
+
+    // A filter would only apply to this run, and the screen is addressed
+    // directly, so it can't be filtered anyway.
+    if (!interval || w->interval || esh_pipe_pending(ESH_INSTANCE)) {
+        esh_puts_flash(ESH_INSTANCE, FSTR("usage: watch TICKS COMMAND...\n"));
+        *status = 1;
+        return true;
+    }
+
+    size_t len = 0;
+    w->argc = argc - 2;
+    for (int i = 0; i < w->argc; ++i) {
+        size_t const n = strlen(argv[i + 2]) + 1;
+        w->argv[i] = memcpy(&w->args[len], argv[i + 2], n);
+        len += n;
+    }
+    w->interval = w->left = interval;
+
+    // Clear the screen and show what is being watched on the top row. The
+    // command is cut short rather than let it wrap onto the output; the
+    // longest possible "Every N: " is 14 columns.
+    emit_str(ESH_INSTANCE, ESC_CSI "H" ESC_CSI "2J" "Every ");
+    emit_num(ESH_INSTANCE, interval);
+    emit_str(ESH_INSTANCE, ": ");
+    for (size_t i = 0; i + 1 < len && i + 14 < ESH_WATCH_COLS; ++i) {
+        emit(ESH_INSTANCE, w->args[i] ? w->args[i] : ' ');
+    }
+    w->term_row = w->term_col = NOWHERE;
+    w->rows = 0;
+    memset(w->lens, 0, sizeof w->lens);
+
+    run(ESH_INSTANCE);
+    *status = 0;
+    return true;
+}
+
+
+bool esh_watch_active(esh_t * esh)
+{
+    (void) esh;
+    return ESH_INSTANCE->watch.interval != 0;
+}
+
+
+void esh_watch_stop(esh_t * esh)
+{
+    (void) esh;
+    ESH_INSTANCE->watch.interval = 0;
+}
+
+
+bool esh_watch_putc(esh_t * esh, char c)
+{
+    (void) esh;
+    if (!ESH_INSTANCE->watch.capturing) {
+        return false;
+    }
+
+    if (c == '\n') {
+        end_row(ESH_INSTANCE);
+    } else if (c == '\t') {
+        put_cell(ESH_INSTANCE, ' ');
+    } else if ((unsigned char) c >= 0x20 && c != 0x7f) {
+        // Control characters, including escape sequences, would throw off
+        // the screen, so they are dropped.
+        put_cell(ESH_INSTANCE, c);
+    }
+    return true;
+}
+
+
+void esh_watch_tick(esh_t * esh)
+{
+    (void) esh;
+    struct esh_watch * w = &ESH_INSTANCE->watch;
+
+    // A command that ticks while being watched must not run itself again.
+    if (!w->interval || w->capturing || --w->left) {
+        return;
+    }
+    w->left = w->interval;
+    run(ESH_INSTANCE);
+}
+
+#endif // ESH_WATCH
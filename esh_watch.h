@@ -0,0 +1,125 @@
+/*
+ * esh - embedded shell
+ * Copyright (C) 2017 Chris Pavlina
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef ESH_INTERNAL_INCLUDE
+#error "esh_watch.h is an internal header and should not be included by the user."
+#endif // ESH_INTERNAL_INCLUDE
+
+#ifndef ESH_WATCH_H
+#define ESH_WATCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <inttypes.h>
+
+/*
+ * esh watch mode: rerun a command periodically, redrawing only what changed
+ * in its output. When not enabled in configuration, a placeholder
+ * implementation is provided so the main esh code need not be conditionally
+ * compiled.
+ */
+
+struct esh;
+typedef struct esh esh_t;
+
+#ifdef ESH_WATCH
+// Begin actual watch implementation
+
+struct esh_watch {
+    char * argv[ESH_ARGC_MAX];          ///< Command being watched
+    int argc;                           ///< Number of arguments in .argv
+    unsigned long interval;             ///< Ticks between runs, 0 if idle
+    unsigned long left;                 ///< Ticks until the next run
+    bool capturing;                     ///< Output is going to the screen
+    uint8_t row, col;                   ///< Where output goes next
+    uint8_t term_row, term_col;         ///< Where the terminal cursor is
+    uint8_t rows;                       ///< Rows used by the last run
+    uint8_t lens[ESH_WATCH_ROWS];       ///< Length of each row on screen
+    char shown[ESH_WATCH_ROWS][ESH_WATCH_COLS];     ///< What is on screen
+    char args[ESH_BUFFER_LEN + 1];      ///< Storage for .argv
+};
+
+/**
+ * If a command is `watch`, start watching.
+ * @param esh - esh instance
+ * @param argc - number of arguments, including the command name
+ * @param argv - arguments
+ * @param status - on return, the exit status, if it was watch
+ * @return true iff the command was watch, and has been handled
+ */
+bool esh_watch_command(esh_t * esh, int argc, char ** argv, int * status);
+
+/**
+ * Return whether a command is being watched.
+ * @param esh - esh instance
+ */
+bool esh_watch_active(esh_t * esh);
+
+/**
+ * Stop watching, leaving the cursor below the output.
+ * @param esh - esh instance
+ */
+void esh_watch_stop(esh_t * esh);
+
+/**
+ * Take one character of output, if a watched command is running.
+ * @param esh - esh instance
+ * @param c - character to print
+ * @return true iff the character was taken
+ */
+bool esh_watch_putc(esh_t * esh, char c);
+
+#else // ESH_WATCH
+// Begin placeholder implementation
+
+#define INL static inline __attribute__((always_inline))
+
+INL bool esh_watch_command(esh_t * esh, int argc, char ** argv, int * status)
+{
+    (void) esh;
+    (void) argc;
+    (void) argv;
+    (void) status;
+    return false;
+}
+
+INL bool esh_watch_active(esh_t * esh)
+{
+    (void) esh;
+    return false;
+}
+
+INL void esh_watch_stop(esh_t * esh)
+{
+    (void) esh;
+}
+
+INL bool esh_watch_putc(esh_t * esh, char c)
+{
+    (void) esh;
+    (void) c;
+    return false;
+}
+
+#undef INL
+
+#endif // ESH_WATCH
+
+#endif // ESH_WATCH_H
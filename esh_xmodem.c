@@ -0,0 +1,347 @@
+/*
+ * esh - embedded shell
+ * Copyright (C) 2017 Chris Pavlina
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <esh.h>
+#define ESH_INTERNAL_INCLUDE
+#include <esh_internal.h>
+#include <esh_crc.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef ESH_XMODEM
+// Begin actual XMODEM implementation
+
+#define SOH 0x01    ///< Start of a 128-byte packet
+#define STX 0x02    ///< Start of a 1024-byte packet
+#define EOT 0x04    ///< End of file
+#define ACK 0x06
+#define NAK 0x15
+#define CAN 0x18    ///< Cancel, when received twice in a row
+#define CRC 'C'     ///< Request to send, using CRC-16
+
+#define HEADER_LEN  3   ///< Start byte, block number, inverted block number
+#define CRC_LEN     2
+
+/**
+ * Give up after this many consecutive timeouts or bad packets.
+ */
+#define MAX_RETRIES 10
+
+enum xmodem_state {
+    XM_START = 1,   ///< Waiting for the first packet: block 0 or block 1
+    XM_HEADER,      ///< YMODEM: waiting for the next file's header block
+    XM_DATA,        ///< Waiting for data blocks
+};
+
+/**
+ * Return the full length of a packet, given its start byte.
+ */
+static size_t packet_len(char start)
+{
+    return HEADER_LEN + (start == STX ? 1024 : 128) + CRC_LEN;
+}
+
+
+/**
+ * End the transfer, tell the sink how it went, and return to the prompt.
+ */
+static void finish(esh_t * esh, enum esh_xmodem_event ev)
+{
+    (void) esh;
+    esh_cb_xmodem sink = ESH_INSTANCE->xmodem.sink;
+
+    ESH_INSTANCE->xmodem.sink = NULL;
+    sink(ESH_INSTANCE, ev, NULL, 0, ESH_INSTANCE->xmodem.arg);
+    esh_print_prompt(ESH_INSTANCE);
+}
+
+
+/**
+ * Abort the transfer, telling the sender to stop too.
+ */
+static void cancel(esh_t * esh)
+{
+    (void) esh;
+    esh_puts_flash(ESH_INSTANCE, FSTR("\x18\x18\x18"));
+    finish(ESH_INSTANCE, ESH_XMODEM_FAILED);
+}
+
+
+/**
+ * Reject a packet or a timeout, giving up if it keeps happening.
+ */
+static void nak(esh_t * esh)
+{
+    (void) esh;
+    ESH_INSTANCE->xmodem.pos = 0;
+
+    if (++ESH_INSTANCE->xmodem.retries > MAX_RETRIES) {
+        cancel(ESH_INSTANCE);
+    } else if (ESH_INSTANCE->xmodem.state == XM_DATA) {
+        esh_putc(ESH_INSTANCE, NAK);
+    } else {
+        esh_putc(ESH_INSTANCE, CRC);
+    }
+}
+
+
+/**
+ * Parse the file size from a YMODEM header block: the file name, a NUL, then
+ * the size in decimal, optionally followed by more fields.
+ */
+static size_t header_size(char const * payload, size_t len)
+{
+    char const * name_end = memchr(payload, 0, len);
+    size_t i = name_end ? (size_t)(name_end - payload) + 1 : len;
+    size_t size = 0;
+
+    if (i >= len || payload[i] < '0' || payload[i] > '9') {
+        return SIZE_MAX;
+    }
+
+    for (; i < len && payload[i] >= '0' && payload[i] <= '9'; ++i) {
+        size = size * 10 + (payload[i] - '0');
+    }
+    return size;
+}
+
+
+/**
+ * Handle a YMODEM header block (block 0).
+ */
+static void header(esh_t * esh, char const * payload, size_t len)
+{
+    (void) esh;
+    ESH_INSTANCE->xmodem.ymodem = true;
+    esh_putc(ESH_INSTANCE, ACK);
+
+    if (!payload[0]) {
+        // Empty file name: end of batch
+        finish(ESH_INSTANCE, ESH_XMODEM_DONE);
+        return;
+    }
+
+    if (!ESH_INSTANCE->xmodem.sink(ESH_INSTANCE, ESH_XMODEM_FILE,
+                payload, len, ESH_INSTANCE->xmodem.arg)) {
+        cancel(ESH_INSTANCE);
+        return;
+    }
+
+    ESH_INSTANCE->xmodem.remaining = header_size(payload, len);
+    ESH_INSTANCE->xmodem.state = XM_DATA;
+    ESH_INSTANCE->xmodem.block = 1;
+    ESH_INSTANCE->xmodem.started = false;
+    // YMODEM wants a second request before the data starts.
+    esh_putc(ESH_INSTANCE, CRC);
+}
+
+
+/**
+ * Handle a data block. Short of the file size, the data is passed on exactly
+ * as received, from wherever it lies.
+ */
+static void data(esh_t * esh, char const * payload, size_t len)
+{
+    (void) esh;
+    if (len > ESH_INSTANCE->xmodem.remaining) {
+        // Drop the padding of the last block, if the size is known.
+        len = ESH_INSTANCE->xmodem.remaining;
+    }
+
+    if (len && !ESH_INSTANCE->xmodem.sink(ESH_INSTANCE, ESH_XMODEM_DATA,
+                payload, len, ESH_INSTANCE->xmodem.arg)) {
+        cancel(ESH_INSTANCE);
+        return;
+    }
+
+    if (ESH_INSTANCE->xmodem.remaining != SIZE_MAX) {
+        ESH_INSTANCE->xmodem.remaining -= len;
+    }
+    ++ESH_INSTANCE->xmodem.block;
+    ESH_INSTANCE->xmodem.started = true;
+    esh_putc(ESH_INSTANCE, ACK);
+}
+
+
+/**
+ * Verify and dispatch a complete packet.
+ */
+static void packet(esh_t * esh, char const * p)
+{
+    (void) esh;
+    size_t const len = packet_len(p[0]) - HEADER_LEN - CRC_LEN;
+    char const * payload = &p[HEADER_LEN];
+    uint8_t const block = p[1];
+    uint16_t const crc = ((uint8_t) payload[len] << 8)
+        | (uint8_t) payload[len + 1];
+
+    if ((uint8_t)(block ^ (uint8_t) p[2]) != 0xff
+            || esh_crc16(0, payload, len) != crc) {
+        nak(ESH_INSTANCE);
+        return;
+    }
+
+    ESH_INSTANCE->xmodem.retries = 0;
+
+    if (ESH_INSTANCE->xmodem.state == XM_START && block == 1) {
+        // Plain XMODEM: no header, no file size.
+        ESH_INSTANCE->xmodem.state = XM_DATA;
+        ESH_INSTANCE->xmodem.block = 1;
+    }
+
+    if (ESH_INSTANCE->xmodem.state != XM_DATA) {
+        if (block == 0) {
+            header(ESH_INSTANCE, payload, len);
+        } else {
+            nak(ESH_INSTANCE);
+        }
+    } else if (block == ESH_INSTANCE->xmodem.block) {
+        data(ESH_INSTANCE, payload, len);
+    } else if (block == (uint8_t)(ESH_INSTANCE->xmodem.block - 1)) {
+        // Our ACK was lost and the sender repeated itself. If that was the
+        // YMODEM header, and not a data block numbered 0 after wrapping, it
+        // also needs asking for the data again.
+        esh_putc(ESH_INSTANCE, ACK);
+        if (block == 0 && !ESH_INSTANCE->xmodem.started) {
+            esh_putc(ESH_INSTANCE, CRC);
+        }
+    } else {
+        cancel(ESH_INSTANCE);
+    }
+}
+
+
+/**
+ * Handle end of file.
+ */
+static void eot(esh_t * esh)
+{
+    (void) esh;
+    esh_putc(ESH_INSTANCE, ACK);
+
+    if (ESH_INSTANCE->xmodem.ymodem) {
+        // Ask for the next file's header; an empty one ends the batch.
+        ESH_INSTANCE->xmodem.state = XM_HEADER;
+        esh_putc(ESH_INSTANCE, CRC);
+    } else if (ESH_INSTANCE->xmodem.state == XM_DATA) {
+        finish(ESH_INSTANCE, ESH_XMODEM_DONE);
+    }
+}
+
+
+bool esh_xmodem_active(esh_t * esh)
+{
+    (void) esh;
+    return ESH_INSTANCE->xmodem.sink != NULL;
+}
+
+
+size_t esh_xmodem_rx(esh_t * esh, char const * buf, size_t len)
+{
+    (void) esh;
+    size_t i = 0;
+
+    ESH_INSTANCE->xmodem.idle = false;
+
+    while (i < len && esh_xmodem_active(ESH_INSTANCE)) {
+        if (ESH_INSTANCE->xmodem.pos) {
+            // Continue assembling a packet that arrived in pieces
+            size_t const plen = packet_len(ESH_INSTANCE->xmodem.work[0]);
+            size_t n = plen - ESH_INSTANCE->xmodem.pos;
+            if (n > len - i) {
+                n = len - i;
+            }
+
+            memcpy(&ESH_INSTANCE->xmodem.work[ESH_INSTANCE->xmodem.pos],
+                    &buf[i], n);
+            ESH_INSTANCE->xmodem.pos += n;
+            i += n;
+
+            if (ESH_INSTANCE->xmodem.pos == plen) {
+                ESH_INSTANCE->xmodem.pos = 0;
+                packet(ESH_INSTANCE, ESH_INSTANCE->xmodem.work);
+            }
+            continue;
+        }
+
+        char const c = buf[i];
+        ESH_INSTANCE->xmodem.cans =
+            (c == CAN) ? ESH_INSTANCE->xmodem.cans + 1 : 0;
+
+        if (c == SOH || c == STX) {
+            size_t const plen = packet_len(c);
+            if (len - i >= plen) {
+                // The whole packet is here; use it where it lies.
+                packet(ESH_INSTANCE, &buf[i]);
+                i += plen;
+            } else {
+                ESH_INSTANCE->xmodem.work[0] = c;
+                ESH_INSTANCE->xmodem.pos = 1;
+                ++i;
+            }
+        } else {
+            ++i;
+            if (c == EOT) {
+                eot(ESH_INSTANCE);
+            } else if (ESH_INSTANCE->xmodem.cans >= 2) {
+                finish(ESH_INSTANCE, ESH_XMODEM_FAILED);
+            }
+            // Anything else between packets is line noise.
+        }
+    }
+
+    return i;
+}
+
+
+void esh_xmodem_receive(esh_t * esh, char * work, esh_cb_xmodem sink,
+        void * arg)
+{
+    (void) esh;
+    memset(&ESH_INSTANCE->xmodem, 0, sizeof ESH_INSTANCE->xmodem);
+    ESH_INSTANCE->xmodem.sink = sink;
+    ESH_INSTANCE->xmodem.arg = arg;
+    ESH_INSTANCE->xmodem.work = work;
+    ESH_INSTANCE->xmodem.remaining = SIZE_MAX;
+    ESH_INSTANCE->xmodem.state = XM_START;
+    esh_putc(ESH_INSTANCE, CRC);
+}
+
+
+void esh_xmodem_tick(esh_t * esh)
+{
+    (void) esh;
+    if (!esh_xmodem_active(ESH_INSTANCE)) {
+        return;
+    } else if (ESH_INSTANCE->xmodem.idle) {
+        nak(ESH_INSTANCE);
+    }
+    ESH_INSTANCE->xmodem.idle = true;
+}
+
+
+void esh_xmodem_cancel(esh_t * esh)
+{
+    (void) esh;
+    if (esh_xmodem_active(ESH_INSTANCE)) {
+        cancel(ESH_INSTANCE);
+    }
+}
+
+#endif // ESH_XMODEM
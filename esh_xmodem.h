@@ -0,0 +1,96 @@
+/*
+ * esh - embedded shell
+ * Copyright (C) 2017 Chris Pavlina
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef ESH_INTERNAL_INCLUDE
+#error "esh_xmodem.h is an internal header and should not be included by the user."
+#endif // ESH_INTERNAL_INCLUDE
+
+#ifndef ESH_XMODEM_H
+#define ESH_XMODEM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <inttypes.h>
+
+/*
+ * esh XMODEM-1K/YMODEM receive support. When not enabled in configuration, a
+ * placeholder implementation is provided so the main esh code need not be
+ * conditionally compiled.
+ */
+
+struct esh;
+typedef struct esh esh_t;
+
+#ifdef ESH_XMODEM
+// Begin actual XMODEM implementation
+
+struct esh_xmodem {
+    esh_cb_xmodem sink;     ///< Block sink, or NULL when not receiving
+    void * arg;             ///< Argument for sink
+    char * work;            ///< Packet assembly buffer
+    size_t pos;             ///< Bytes of the current packet in .work
+    size_t remaining;       ///< Bytes left in the file, or SIZE_MAX if unknown
+    uint8_t state;          ///< Receiver state
+    uint8_t block;          ///< Next expected block number
+    uint8_t retries;        ///< Consecutive timeouts or bad packets
+    uint8_t cans;           ///< Consecutive CAN bytes received
+    bool idle;              ///< Nothing received since the last tick
+    bool ymodem;            ///< Session started with a YMODEM header block
+    bool started;           ///< A data block of this file has been accepted
+};
+
+/**
+ * Return whether a transfer is in progress.
+ * @param esh - esh instance
+ */
+bool esh_xmodem_active(esh_t * esh);
+
+/**
+ * Pass received bytes to the receiver. A transfer must be in progress.
+ * @param esh - esh instance
+ * @param buf - received bytes
+ * @param len - number of bytes in buf
+ * @return number of bytes consumed. If less than len, the transfer has ended
+ *  and the rest belongs to the shell.
+ */
+size_t esh_xmodem_rx(esh_t * esh, char const * buf, size_t len);
+
+#else // ESH_XMODEM
+// Begin placeholder implementation
+
+#define INL static inline __attribute__((always_inline))
+
+INL bool esh_xmodem_active(esh_t * esh)
+{
+    (void) esh;
+    return false;
+}
+
+INL size_t esh_xmodem_rx(esh_t * esh, char const * buf, size_t len)
+{
+    (void) esh;
+    (void) buf;
+    return len;
+}
+
+#undef INL
+
+#endif // ESH_XMODEM
+
+#endif // ESH_XMODEM_H
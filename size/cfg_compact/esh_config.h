@@ -0,0 +1,10 @@
+#define ESH_PROMPT "% "
+#define ESH_BUFFER_LEN 80
+#define ESH_ARGC_MAX 8
+
+#define ESH_HIST_ALLOC STATIC
+#define ESH_HIST_LEN 255
+
+#define ESH_ALLOC STATIC
+#define ESH_STATIC_CALLBACKS
+#define ESH_COMPACT
@@ -0,0 +1,8 @@
+#define ESH_PROMPT "% "
+#define ESH_BUFFER_LEN 80
+#define ESH_ARGC_MAX 8
+
+#define ESH_HIST_ALLOC MANUAL
+#define ESH_HIST_LEN 256
+
+#define ESH_ALLOC STATIC
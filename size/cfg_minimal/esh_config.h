@@ -0,0 +1,5 @@
+#define ESH_PROMPT "% "
+#define ESH_BUFFER_LEN 80
+#define ESH_ARGC_MAX 8
+
+#define ESH_ALLOC STATIC
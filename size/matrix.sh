@@ -0,0 +1,93 @@
+#!/bin/sh
+#
+# Size matrix. Compiles the core of esh (esh.c, esh_hist.c, esh_argparser.c)
+# for each configuration in cfg_*/, with the host compiler and with avr-gcc and
+# arm-none-eabi-gcc if they are installed, and reports the .text, .data and
+# .bss of the three objects together and sizeof(esh_t). Exits with 1 if any
+# of these is over its limit in budget.txt.
+#
+# Budget lines are: toolchain config text data bss esh_t, where any limit can
+# be - for none. Results with no budget line are reported but not checked.
+
+set -e
+cd "$(dirname "$0")"
+
+SOURCES="../esh.c ../esh_hist.c ../esh_argparser.c"
+BUILD=build
+CFLAGS="-std=gnu11 -Os -Wall -Wextra -fno-common"
+
+# One line per toolchain: name, tool prefix, target flags
+toolchains() {
+    echo "host -"
+    if command -v avr-gcc > /dev/null; then
+        echo "avr avr- -mmcu=atmega328p"
+    fi
+    if command -v arm-none-eabi-gcc > /dev/null; then
+        echo "arm arm-none-eabi- -mcpu=cortex-m0 -mthumb"
+    fi
+}
+
+# Print "OVER" if a value is over its limit
+check() {
+    if [ "$2" != - ] && [ "$1" -gt "$2" ]; then
+        echo OVER
+    fi
+}
+
+printf "%-6s %-16s %7s %7s %7s %7s\n" "# tool" config text data bss esh_t
+
+status=0
+while read -r tool prefix flags; do
+    [ "$prefix" = - ] && prefix=
+    for cfg in cfg_*/; do
+        cfg=${cfg#cfg_}
+        cfg=${cfg%/}
+        out=$BUILD/$tool/$cfg
+        mkdir -p "$out"
+
+        for src in $SOURCES; do
+            obj=$out/$(basename "$src" .c).o
+            # shellcheck disable=SC2086
+            "${prefix}gcc" $CFLAGS $flags -I .. -iquote "cfg_$cfg" \
+                -c "$src" -o "$obj"
+        done
+        # shellcheck disable=SC2086
+        "${prefix}gcc" $CFLAGS $flags -I .. -iquote "cfg_$cfg" \
+            -c sizeof.c -o "$out/sizeof.o"
+
+        # Berkeley format: the totals line is text data bss dec hex
+        # shellcheck disable=SC2046
+        set -- $("${prefix}size" -t "$out"/esh*.o | tail -n 1)
+        text=$1 data=$2 bss=$3
+        # shellcheck disable=SC2046
+        set -- $("${prefix}nm" -S "$out/sizeof.o" | grep ' esh_t_size$')
+        esh_t=$((0x$2))
+
+        printf "%-6s %-16s %7d %7d %7d %7d" "$tool" "$cfg" \
+            "$text" "$data" "$bss" "$esh_t"
+
+        # shellcheck disable=SC2046
+        set -- $(awk -v t="$tool" -v c="$cfg" \
+            '$1 == t && $2 == c { print $3, $4, $5, $6 }' budget.txt)
+        if [ $# -ne 4 ]; then
+            printf "   (no budget)\n"
+            continue
+        fi
+
+        over=
+        for pair in "$text $1" "$data $2" "$bss $3" "$esh_t $4"; do
+            # shellcheck disable=SC2086
+            over=$over$(check $pair)
+        done
+        if [ -n "$over" ]; then
+            printf "   OVER BUDGET (%s %s %s %s)\n" "$1" "$2" "$3" "$4"
+            status=1
+        else
+            printf "\n"
+        fi
+    done
+done <<EOF
+$(toolchains)
+EOF
+
+exit $status
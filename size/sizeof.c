@@ -0,0 +1,9 @@
+#include <esh.h>
+#define ESH_INTERNAL_INCLUDE
+#include <esh_internal.h>
+
+/*
+ * Only compiled, never linked: the size of this symbol in the object file is
+ * sizeof(esh_t) for the target, which nm can read without running anything.
+ */
+char esh_t_size[sizeof(esh_t)];
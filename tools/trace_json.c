@@ -0,0 +1,151 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+/*
+ * Convert the output of `esh-trace dump` into Chrome trace JSON, to open in
+ * chrome://tracing or https://ui.perfetto.dev.
+ *
+ * Usage: trace_json [-f TICKS_PER_US] [FILE]
+ *
+ * Reads FILE, or standard input, and writes JSON to standard output. Lines
+ * that aren't trace events are skipped, so a whole console log will do as long
+ * as it holds one dump. TICKS_PER_US is the rate of ESH_TRACE_CLOCK in ticks
+ * per microsecond (for example, 72 for the cycle counter of a 72 MHz part);
+ * the default is 1.
+ *
+ * Clock times are 32 bits, so they are unwrapped on the assumption that less
+ * than one full wrap passes between events. The oldest events in the ring may
+ * be the ends of spans whose beginnings were overwritten; those are dropped.
+ */
+
+#define MAX_DEPTH 64
+
+
+/**
+ * Write a string as a JSON string literal.
+ */
+static void put_string(char const * s)
+{
+    putchar('"');
+    for (; *s; ++s) {
+        if (*s == '"' || *s == '\\') {
+            printf("\\%c", *s);
+        } else if ((unsigned char) *s < 0x20) {
+            printf("\\u%04x", (unsigned char) *s);
+        } else {
+            putchar(*s);
+        }
+    }
+    putchar('"');
+}
+
+
+/**
+ * Split an event line into its fields.
+ * @return false if it isn't one
+ */
+static bool parse(char * line, unsigned long * time, char * phase,
+        char ** kind, char ** arg)
+{
+    char * end;
+
+    line[strcspn(line, "\r\n")] = 0;
+    *time = strtoul(line, &end, 10);
+    if (end == line || end[0] != ' ' || (end[1] != 'B' && end[1] != 'E')
+            || end[2] != ' ' || !end[3]) {
+        return false;
+    }
+    *phase = end[1];
+    *kind = &end[3];
+
+    char * space = strchr(*kind, ' ');
+    if (space) {
+        *space = 0;
+        *arg = space + 1;
+    } else {
+        *arg = NULL;
+    }
+
+    return !strcmp(*kind, "command") || !strcmp(*kind, "input")
+        || !strcmp(*kind, "redraw") || !strncmp(*kind, "hist-", 5);
+}
+
+
+int main(int argc, char ** argv)
+{
+    double ticks_per_us = 1;
+    FILE * in = stdin;
+    int i = 1;
+
+    if (argc > 2 && !strcmp(argv[1], "-f")) {
+        ticks_per_us = strtod(argv[2], NULL);
+        i = 3;
+    }
+    if (argc > i + 1 || ticks_per_us <= 0) {
+        fprintf(stderr, "usage: %s [-f TICKS_PER_US] [FILE]\n", argv[0]);
+        return 2;
+    }
+    if (argc == i + 1 && !(in = fopen(argv[i], "r"))) {
+        perror(argv[i]);
+        return 1;
+    }
+
+    char line[256];
+    uint64_t epoch = 0;
+    unsigned long last = 0;
+    bool seen = false;
+    bool first = true;
+    int depth = 0;
+
+    printf("{\"traceEvents\": [");
+
+    while (fgets(line, sizeof line, in)) {
+        unsigned long time;
+        char phase;
+        char * kind;
+        char * arg;
+
+        if (!parse(line, &time, &phase, &kind, &arg)) {
+            continue;
+        }
+
+        if (seen && time < last) {
+            epoch += (uint64_t) 1 << 32;
+        }
+        last = time;
+        seen = true;
+
+        if (phase == 'E' && !depth) {
+            continue;
+        } else if (phase == 'B' && depth == MAX_DEPTH) {
+            fprintf(stderr, "spans nested too deeply\n");
+            return 1;
+        }
+        depth += phase == 'B' ? 1 : -1;
+
+        bool const input = !strcmp(kind, "input");
+        bool const command = !strcmp(kind, "command");
+
+        printf("%s\n  {\"name\": ", first ? "" : ",");
+        put_string(command && arg ? arg : kind);
+        printf(", \"cat\": \"%s\", \"ph\": \"%c\", \"ts\": %.3f, "
+                "\"pid\": 1, \"tid\": 1",
+                command ? "command" : input ? "input" : "editor", phase,
+                (epoch + time) / ticks_per_us);
+        if (input && arg) {
+            printf(", \"args\": {\"byte\": %d}", atoi(arg));
+        }
+        printf("}");
+        first = false;
+    }
+
+    printf("\n]}\n");
+
+    if (in != stdin) {
+        fclose(in);
+    }
+    return 0;
+}